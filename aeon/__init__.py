@@ -1,2 +1,2 @@
-from .dataloader import DataLoader, LoaderRuntimeError
+from .dataloader import DataLoader, LoaderRuntimeError, build_cache
 
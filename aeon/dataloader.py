@@ -22,6 +22,26 @@ class LoaderRuntimeError(RuntimeError):
     pass
 
 
+def build_cache(config, threads=0):
+    """
+    Fill the cache_directory of `config` with every block of its manifest
+    before training, using `threads` workers (0 for one per core).  Blocks
+    already cached are skipped.  Returns counts and throughput of the build.
+    """
+    path = os.path.dirname(os.path.dirname(os.path.realpath(__file__)))
+    loaderlib = ct.cdll.LoadLibrary(os.path.join(path, 'aeon_lib.so'))
+    loaderlib.get_error_message.restype = ct.c_char_p
+    loaderlib.build_cache.argtypes = [ct.c_char_p, ct.c_int]
+    loaderlib.build_cache.restype = ct.c_char_p
+
+    ret = loaderlib.build_cache(json.dumps(config), threads)
+    if ret is None:
+        raise LoaderRuntimeError(
+            'error in loader: {}'.format(loaderlib.get_error_message())
+        )
+    return json.loads(ret)
+
+
 class DataLoader(object):
 
     """
@@ -79,6 +99,8 @@ class DataLoader(object):
         self.loaderlib.reset.argtypes = [ct.c_void_p]
         self.loaderlib.itemCount.argtypes = [ct.c_void_p]
         self.loaderlib.itemCount.restype = ct.c_int
+        self.loaderlib.stats.argtypes = [ct.c_void_p]
+        self.loaderlib.stats.restype = ct.c_char_p
 
     def _raise_loader_error(self):
         """
@@ -150,6 +172,18 @@ class DataLoader(object):
 
         return ret
 
+    def stats(self):
+        """
+        Counters and timings for each stage of the loading pipeline, how full
+        its queues are, and a one line verdict naming the bottleneck.
+        """
+        ret = self.loaderlib.stats(self.loader)
+
+        if ret is None:
+            self._raise_loader_error()
+
+        return json.loads(ret)
+
     def _reset(self):
         """
         C api wrapper with exception handling
@@ -4,19 +4,27 @@ SRCS="
     api.cpp
     avi.cpp
     batch_iterator.cpp
+    block_iterator_mixed.cpp
     block_iterator_sequential.cpp
     block_iterator_shuffled.cpp
     block_loader.cpp
+    block_file.cpp
+    block_loader_bin.cpp
     block_loader_cpio_cache.cpp
     block_loader_file.cpp
+    block_loader_memory_cache.cpp
     block_loader_nds.cpp
+    block_loader_prefetch.cpp
     box.cpp
     buffer_in.cpp
     buffer_out.cpp
     buffer_pool.cpp
+    buffer_pool_device.cpp
     buffer_pool_in.cpp
     buffer_pool_out.cpp
+    cache_builder.cpp
     cap_mjpeg_decoder.cpp
+    compression.cpp
     cpio.cpp
     etl_audio.cpp
     etl_boundingbox.cpp
@@ -30,11 +38,14 @@ SRCS="
     etl_video.cpp
     image.cpp
     interface.cpp
+    io_engine.cpp
     loader.cpp
     log.cpp
+    manifest_bin.cpp
     manifest_csv.cpp
     manifest_nds.cpp
     noise_clips.cpp
+    pipeline_stats.cpp
     provider_audio_classifier.cpp
     provider_audio_only.cpp
     provider_audio_transcriber.cpp
@@ -73,9 +84,22 @@ if [[ $? == 0 ]]; then
     export VIDLIBS="-lavutil -lavformat -lavcodec -lswscale"
 fi
 
-export MEDIAFLAGS="${IMGFLAG} ${VIDFLAG} ${AUDFLAG}"
+# optional codecs for compressed cache blocks
+pkg-config --exists liblz4
+if [[ $? == 0 ]]; then
+    export LZ4FLAG="-DHAS_LZ4"
+    export LZ4LIBS="-llz4"
+fi
+
+pkg-config --exists libzstd
+if [[ $? == 0 ]]; then
+    export ZSTDFLAG="-DHAS_ZSTD"
+    export ZSTDLIBS="-lzstd"
+fi
+
+export MEDIAFLAGS="${IMGFLAG} ${VIDFLAG} ${AUDFLAG} ${LZ4FLAG} ${ZSTDFLAG}"
 export LDIR="${IMGLDIR} ${VIDLDIR}"
-export LIBS="-lcurl ${IMGLIBS} ${VIDLIBS}"
+export LIBS="-lcurl ${IMGLIBS} ${VIDLIBS} ${LZ4LIBS} ${ZSTDLIBS}"
 
 export INC="-I$(python -c 'from distutils.sysconfig import get_python_inc; print get_python_inc()') ${INC}"
 export INC="-I$(python -c 'import numpy; print numpy.get_include()') ${INC}"
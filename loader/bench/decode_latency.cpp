@@ -0,0 +1,140 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+/* decode_latency
+ *
+ * Drives decode_thread_pool with a synthetic provider whose per-item cost
+ * follows a Pareto distribution (a few huge JPEGs among many small ones) and
+ * reports the p50/p99 time between decoded minibatches.
+ *
+ * usage: decode_latency [threads] [minibatch_size] [minibatches] [pareto_alpha] [depth]
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <thread>
+#include <chrono>
+
+#include "loader.hpp"
+
+using namespace std;
+using namespace nervana;
+
+// Items only carry their simulated size.  provide() burns time proportional
+// to that size, which keeps the producer cheap and the decode stage the
+// bottleneck.
+class heavy_tailed_provider : public provider_interface {
+public:
+    heavy_tailed_provider()
+    {
+        num_inputs = 1;
+        oshapes.emplace_back(vector<size_t>{1}, output_type{"uint32_t"});
+        scratch.resize(1 << 16, 1);
+    }
+
+    void provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf) override
+    {
+        const buffer_item& item = in_buf[0]->get_item(idx);
+        uint32_t size = unpack<uint32_t>(item.data());
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < size; i++) {
+            sum = sum * 31 + scratch[i & (scratch.size() - 1)];
+        }
+        pack<uint32_t>(out_buf[0]->get_item(idx), sum);
+    }
+
+private:
+    vector<char> scratch;
+};
+
+static double percentile(vector<double> v, double p)
+{
+    sort(v.begin(), v.end());
+    size_t index = min(v.size() - 1, (size_t)(p * v.size()));
+    return v[index];
+}
+
+int main(int argc, char** argv)
+{
+    int   nthreads    = argc > 1 ? atoi(argv[1]) : thread::hardware_concurrency();
+    int   batch_size  = argc > 2 ? atoi(argv[2]) : 128;
+    int   nbatches    = argc > 3 ? atoi(argv[3]) : 200;
+    float alpha       = argc > 4 ? atof(argv[4]) : 1.2;
+    int   depth       = argc > 5 ? atoi(argv[5]) : 4;
+
+    // smallest item costs ~50k iterations, the tail is capped at 500x that
+    const double min_size = 50000;
+    const double max_size = min_size * 500;
+
+    auto in  = make_shared<buffer_pool_in>(1, depth);
+    auto out = make_shared<buffer_pool_out>(vector<size_t>{sizeof(uint32_t)}, batch_size, false, depth);
+
+    decode_thread_pool pool(nthreads, batch_size, in, out);
+    for (int i = 0; i < nthreads; i++) {
+        pool.add_provider(make_shared<heavy_tailed_provider>());
+    }
+
+    thread producer([&]{
+        mt19937 rand(0);
+        uniform_real_distribution<double> uniform(0.0, 1.0);
+        for (int b = 0; b < nbatches; b++) {
+            if (in->wait_for_not_full() == false) {
+                return;
+            }
+            buffer_in_array& buf = in->get_for_write();
+            for (int i = 0; i < batch_size; i++) {
+                // inverse transform sampling of a Pareto distribution
+                double size = min(max_size, min_size / pow(1.0 - uniform(rand), 1.0 / alpha));
+                vector<char> item(sizeof(uint32_t));
+                pack<uint32_t>(item.data(), (uint32_t)size);
+                buf[0]->add_item(item);
+            }
+            in->advance_write_pos();
+        }
+    });
+
+    pool.start();
+
+    vector<double> latencies;
+    auto start = chrono::steady_clock::now();
+    auto last  = start;
+    for (int b = 0; b < nbatches; b++) {
+        out->get_for_read();
+        auto now = chrono::steady_clock::now();
+        latencies.push_back(chrono::duration<double, milli>(now - last).count());
+        last = now;
+        out->advance_read_pos();
+    }
+    double total = chrono::duration<double>(last - start).count();
+
+    producer.join();
+    pool.stop();
+
+    // the first interval includes thread start up
+    latencies.erase(latencies.begin());
+
+    cout << fixed << setprecision(3);
+    cout << "threads "       << nthreads;
+    cout << " minibatch "    << batch_size;
+    cout << " alpha "        << alpha;
+    cout << " depth "        << depth;
+    cout << " p50_ms "       << percentile(latencies, 0.50);
+    cout << " p99_ms "       << percentile(latencies, 0.99);
+    cout << " items_per_sec " << (nbatches * batch_size) / total << endl;
+
+    return 0;
+}
@@ -0,0 +1,493 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+/* etl_stages
+ *
+ * Times the extract, make_params, transform and load steps of every ETL
+ * family on its own, single threaded, for a matrix of input sizes and
+ * output types.  Each row of the JSON report gives ns/item and heap
+ * allocations/item for one step.
+ *
+ * Allocations are counted by wrapping glibc's malloc family, so cv::Mat
+ * buffers are included along with operator new.  Without glibc they are
+ * not counted and allocs_per_item is null.
+ *
+ * usage: etl_stages [family] [seconds_per_step]
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <functional>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "etl_image.hpp"
+#include "etl_image_var.hpp"
+#include "etl_multicrop.hpp"
+#include "etl_pixel_mask.hpp"
+#include "etl_boundingbox.hpp"
+#include "etl_localization.hpp"
+#include "etl_audio.hpp"
+#include "etl_video.hpp"
+#include "etl_char_map.hpp"
+#include "etl_label_map.hpp"
+#include "specgram.hpp"
+#include "wav_data.hpp"
+#include "gen_video.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static atomic<uint64_t> allocations{0};
+
+#ifdef __GLIBC__
+static const bool counting_allocations = true;
+
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void* __libc_memalign(size_t, size_t);
+
+void* malloc(size_t size)
+{
+    allocations.fetch_add(1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    allocations.fetch_add(1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    allocations.fetch_add(1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    allocations.fetch_add(1, memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+    *ptr = memalign(alignment, size);
+    return *ptr ? 0 : ENOMEM;
+}
+}
+#else
+static const bool counting_allocations = false;
+#endif
+
+class report {
+public:
+    report(const string& only, double seconds) : _only(only), _seconds(seconds) {}
+
+    bool wants(const string& family) const { return _only.empty() || _only == family; }
+
+    // Call `step` until `_seconds` have passed, after one untimed call that
+    // may fill caches or produce the input of the next step.
+    void run(const string& family, const string& step, const string& input,
+             const string& dtype, const function<void()>& fn)
+    {
+        fn();
+
+        uint64_t start_allocs = allocations;
+        auto start = chrono::steady_clock::now();
+        double elapsed = 0;
+        int iterations = 0;
+        while (iterations < 10 || elapsed < _seconds) {
+            fn();
+            iterations++;
+            elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+        uint64_t allocs = allocations - start_allocs;
+
+        nlohmann::json row;
+        row["family"]          = family;
+        row["step"]            = step;
+        row["input"]           = input;
+        row["dtype"]           = dtype;
+        row["iterations"]      = iterations;
+        row["ns_per_item"]     = elapsed * 1e9 / iterations;
+        if (counting_allocations) {
+            row["allocs_per_item"] = (double)allocs / iterations;
+        } else {
+            row["allocs_per_item"] = nullptr;
+        }
+        rows.push_back(row);
+    }
+
+    nlohmann::json rows = nlohmann::json::array();
+
+private:
+    string _only;
+    double _seconds;
+};
+
+static const vector<cv::Size> image_sizes = {{320, 240}, {1024, 768}, {1920, 1080}};
+static const vector<string> image_types = {"uint8_t", "float"};
+
+static string size_name(const cv::Size& size)
+{
+    return to_string(size.width) + "x" + to_string(size.height);
+}
+
+// smooth noise, so the codec has some work to do without the worst case
+static vector<char> encode_image(const cv::Size& size, int channels, const string& ext)
+{
+    cv::Mat mat(size, CV_8UC(channels));
+    cv::randu(mat, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::GaussianBlur(mat, mat, cv::Size(0, 0), 3);
+    vector<uchar> encoded;
+    cv::imencode(ext, mat, encoded);
+    return vector<char>(encoded.begin(), encoded.end());
+}
+
+static string bbox_json(const cv::Size& size, int count)
+{
+    nlohmann::json objects = nlohmann::json::array();
+    for (int i = 0; i < count; i++) {
+        int x = (i * 37) % (size.width / 2);
+        int y = (i * 53) % (size.height / 2);
+        objects.push_back({{"bndbox", {{"xmin", x}, {"ymin", y},
+                                       {"xmax", x + size.width / 3}, {"ymax", y + size.height / 3}}},
+                           {"name", i % 2 ? "cat" : "dog"}});
+    }
+    nlohmann::json js = {{"object", objects},
+                         {"size", {{"width", size.width}, {"height", size.height}, {"depth", 3}}}};
+    return js.dump();
+}
+
+static void bench_image(report& r)
+{
+    for (auto& size : image_sizes) {
+        vector<char> encoded = encode_image(size, 3, ".jpg");
+        for (auto& dtype : image_types) {
+            image::config cfg({{"height", 224}, {"width", 224}, {"type_string", dtype},
+                               {"flip_enable", true}, {"scale", {0.5, 1.0}}, {"angle", {-10, 10}}});
+            image::extractor     extractor(cfg);
+            image::param_factory factory(cfg);
+            image::transformer   transformer(cfg);
+            image::loader        loader(cfg);
+            vector<char> out(cfg.get_shape_type().get_byte_size());
+
+            shared_ptr<image::decoded> decoded, transformed;
+            shared_ptr<image::params>  params;
+            string input = size_name(size);
+            r.run("image", "extract", input, dtype, [&]{ decoded = extractor.extract(encoded.data(), encoded.size()); });
+            r.run("image", "make_params", input, dtype, [&]{ params = factory.make_params(decoded); });
+            r.run("image", "transform", input, dtype, [&]{ transformed = transformer.transform(params, decoded); });
+            r.run("image", "load", input, dtype, [&]{ loader.load({out.data()}, transformed); });
+        }
+    }
+}
+
+static void bench_image_var(report& r)
+{
+    for (auto& size : image_sizes) {
+        vector<char> encoded = encode_image(size, 3, ".jpg");
+        for (auto& dtype : image_types) {
+            image_var::config cfg({{"min_size", 600}, {"max_size", 1000}, {"type_string", dtype},
+                                   {"flip_enable", true}});
+            image_var::extractor     extractor(cfg);
+            image_var::param_factory factory(cfg);
+            image_var::transformer   transformer(cfg);
+            image_var::loader        loader(cfg);
+            vector<char> out(cfg.get_shape_type().get_byte_size());
+
+            shared_ptr<image_var::decoded> decoded, transformed;
+            shared_ptr<image_var::params>  params;
+            string input = size_name(size);
+            r.run("image_var", "extract", input, dtype, [&]{ decoded = extractor.extract(encoded.data(), encoded.size()); });
+            r.run("image_var", "make_params", input, dtype, [&]{ params = factory.make_params(decoded); });
+            r.run("image_var", "transform", input, dtype, [&]{ transformed = transformer.transform(params, decoded); });
+            r.run("image_var", "load", input, dtype, [&]{ loader.load({out.data()}, transformed); });
+        }
+    }
+}
+
+static void bench_multicrop(report& r)
+{
+    // extraction is image::extractor, only the crops and their load differ
+    for (auto& size : image_sizes) {
+        auto decoded = make_shared<image::decoded>(cv::Mat(size, CV_8UC3, cv::Scalar::all(128)));
+        for (auto& dtype : image_types) {
+            multicrop::config cfg({{"crop_config", {{"height", 224}, {"width", 224}, {"type_string", dtype},
+                                                    {"flip_enable", true}}},
+                                   {"crop_scales", nlohmann::json::array({0.875})}, {"num_crops", 5}});
+            image::param_factory  factory(cfg.crop_config);
+            multicrop::transformer transformer(cfg);
+            image::loader         loader(cfg.crop_config);
+            vector<char> out(cfg.get_shape_type().get_byte_size());
+
+            auto params = factory.make_params(decoded);
+            shared_ptr<image::decoded> transformed;
+            string input = size_name(size);
+            r.run("multicrop", "transform", input, dtype, [&]{ transformed = transformer.transform(params, decoded); });
+            r.run("multicrop", "load", input, dtype, [&]{ loader.load({out.data()}, transformed); });
+        }
+    }
+}
+
+static void bench_pixel_mask(report& r)
+{
+    for (auto& size : image_sizes) {
+        vector<char> encoded = encode_image(size, 1, ".png");
+        for (auto& dtype : image_types) {
+            image::config cfg({{"height", 224}, {"width", 224}, {"type_string", dtype}, {"channels", 1},
+                               {"flip_enable", true}, {"scale", {0.5, 1.0}}});
+            pixel_mask::extractor  extractor(cfg);
+            image::param_factory   factory(cfg);
+            pixel_mask::transformer transformer(cfg);
+            image::loader          loader(cfg);
+            vector<char> out(cfg.get_shape_type().get_byte_size());
+
+            shared_ptr<image::decoded> decoded, transformed;
+            string input = size_name(size);
+            r.run("pixel_mask", "extract", input, dtype, [&]{ decoded = extractor.extract(encoded.data(), encoded.size()); });
+            auto params = factory.make_params(decoded);
+            r.run("pixel_mask", "transform", input, dtype, [&]{ transformed = transformer.transform(params, decoded); });
+            r.run("pixel_mask", "load", input, dtype, [&]{ loader.load({out.data()}, transformed); });
+        }
+    }
+}
+
+static void bench_boundingbox(report& r)
+{
+    cv::Size size{1024, 768};
+    image::config icfg({{"height", 224}, {"width", 224}, {"flip_enable", true}, {"scale", {0.5, 1.0}}});
+    image::param_factory factory(icfg);
+    auto params = factory.make_params(make_shared<image::decoded>(cv::Mat(size, CV_8UC3)));
+
+    for (int count : {1, 16, 64}) {
+        string annotation = bbox_json(size, count);
+        boundingbox::config cfg({{"height", 224}, {"width", 224}, {"max_bbox_count", 64},
+                                 {"labels", nlohmann::json::array({"cat", "dog"})}});
+        boundingbox::extractor   extractor(cfg.label_map);
+        boundingbox::transformer transformer(cfg);
+        boundingbox::loader      loader(cfg);
+        vector<char> out(cfg.get_shape_type().get_byte_size());
+
+        shared_ptr<boundingbox::decoded> decoded, transformed;
+        string input = to_string(count) + "_boxes";
+        r.run("boundingbox", "extract", input, cfg.type_string, [&]{ decoded = extractor.extract(annotation.data(), annotation.size()); });
+        r.run("boundingbox", "transform", input, cfg.type_string, [&]{ transformed = transformer.transform(params, decoded); });
+        r.run("boundingbox", "load", input, cfg.type_string, [&]{ loader.load({out.data()}, transformed); });
+    }
+}
+
+static void bench_localization(report& r)
+{
+    cv::Size size{1024, 768};
+    image_var::config icfg({{"min_size", 600}, {"max_size", 1000}});
+    image_var::param_factory factory(icfg);
+    auto params = factory.make_params(make_shared<image_var::decoded>(cv::Mat(size, CV_8UC3)));
+
+    for (int count : {1, 16, 64}) {
+        string annotation = bbox_json(size, count);
+        localization::config cfg({{"min_size", 600}, {"max_size", 1000}, {"max_gt_boxes", 64},
+                                  {"labels", nlohmann::json::array({"cat", "dog"})}});
+        localization::extractor   extractor(cfg);
+        localization::transformer transformer(cfg);
+        localization::loader      loader(cfg);
+        vector<vector<char>> buffers;
+        vector<void*> out;
+        for (auto& shape : cfg.get_shape_type_list()) {
+            buffers.emplace_back(shape.get_byte_size());
+            out.push_back(buffers.back().data());
+        }
+
+        shared_ptr<localization::decoded> decoded, transformed;
+        string input = to_string(count) + "_boxes";
+        r.run("localization", "extract", input, cfg.type_string, [&]{ decoded = extractor.extract(annotation.data(), annotation.size()); });
+        r.run("localization", "transform", input, cfg.type_string, [&]{ transformed = transformer.transform(params, decoded); });
+        r.run("localization", "load", input, cfg.type_string, [&]{ loader.load(out, transformed); });
+    }
+}
+
+static void bench_audio(report& r)
+{
+    for (int seconds : {1, 4}) {
+        wav_data wav(sinewave_generator(400, 200), seconds, 16000, false);
+        vector<char> encoded(wav_data::HEADER_SIZE + wav.nbytes());
+        wav.write_to_buffer(encoded.data(), encoded.size());
+
+        // audio only loads uint8_t, so vary the features instead
+        for (string feature : {"specgram", "mfsc", "mfcc"}) {
+            audio::config cfg({{"max_duration", to_string(seconds * 1000) + " milliseconds"},
+                               {"frame_length", "25 milliseconds"},
+                               {"frame_stride", "10 milliseconds"},
+                               {"sample_freq_hz", 16000},
+                               {"feature_type", feature}});
+            audio::extractor     extractor;
+            audio::param_factory factory(cfg);
+            audio::transformer   transformer(cfg);
+            audio::loader        loader(cfg);
+            vector<char> out(cfg.get_shape_type().get_byte_size());
+
+            shared_ptr<audio::decoded> decoded, transformed;
+            shared_ptr<audio::params>  params;
+            string input = to_string(seconds) + "s_16kHz";
+            string dtype = cfg.type_string + "_" + feature;
+            r.run("audio", "extract", input, dtype, [&]{ decoded = extractor.extract(encoded.data(), encoded.size()); });
+            r.run("audio", "make_params", input, dtype, [&]{ params = factory.make_params(decoded); });
+            r.run("audio", "transform", input, dtype, [&]{ transformed = transformer.transform(params, decoded); });
+            r.run("audio", "load", input, dtype, [&]{ loader.load({out.data()}, transformed); });
+
+            if (feature == "specgram") {
+                // the FFT on its own, without the resize done by transform
+                cv::Mat window, freq;
+                specgram::create_window(cfg.window_type, cfg.frame_length_tn, window);
+                cv::Mat& samples = decoded->get_time_data()->get_data();
+                r.run("audio", "wav_to_specgram", input, dtype, [&]{
+                    specgram::wav_to_specgram(samples, cfg.frame_length_tn, cfg.frame_stride_tn,
+                                              cfg.time_steps, window, freq);
+                });
+            }
+        }
+    }
+}
+
+static void bench_video(report& r)
+{
+    for (int ms : {500, 2000}) {
+        // gen_video encodes at 25 frames per second
+        vector<unsigned char> clip = gen_video().encode(ms);
+        int frames = ms * 25 / 1000;
+        for (auto& dtype : image_types) {
+            video::config cfg({{"max_frame_count", frames},
+                               {"frame", {{"height", 112}, {"width", 112}, {"type_string", dtype}}}});
+            video::extractor     extractor(cfg);
+            image::param_factory factory(cfg.frame);
+            video::transformer   transformer(cfg);
+            video::loader        loader(cfg);
+            vector<char> out(cfg.get_shape_type().get_byte_size());
+
+            shared_ptr<image::decoded> decoded, transformed;
+            shared_ptr<image::params>  params;
+            string input = to_string(frames) + "_frames_352x288";
+            r.run("video", "extract", input, dtype, [&]{ decoded = extractor.extract((char*)clip.data(), clip.size()); });
+            r.run("video", "make_params", input, dtype, [&]{ params = factory.make_params(decoded); });
+            r.run("video", "transform", input, dtype, [&]{ transformed = transformer.transform(params, decoded); });
+            r.run("video", "load", input, dtype, [&]{ loader.load({out.data()}, transformed); });
+        }
+    }
+}
+
+static void bench_char_map(report& r)
+{
+    string sentence = "THE QUICK BROWN FOX JUMPED OVER THE LAZY DOG. ";
+    for (int length : {16, 256}) {
+        string transcript;
+        while (transcript.size() < length) {
+            transcript += sentence;
+        }
+        transcript.resize(length);
+
+        char_map::config cfg({{"alphabet", "ABCDEFGHIJKLMNOPQRSTUVWXYZ .,()"}, {"max_length", length}});
+        char_map::extractor extractor(cfg);
+        char_map::loader    loader(cfg);
+        vector<char> out(cfg.get_shape_type().get_byte_size());
+
+        shared_ptr<char_map::decoded> decoded;
+        string input = to_string(length) + "_chars";
+        r.run("char_map", "extract", input, cfg.type_string, [&]{ decoded = extractor.extract(transcript.data(), transcript.size()); });
+        r.run("char_map", "load", input, cfg.type_string, [&]{ loader.load({out.data()}, decoded); });
+    }
+}
+
+static void bench_label_map(report& r)
+{
+    vector<string> labels = {"cat", "dog", "bird", "fish", "horse", "cow", "sheep", "goat"};
+    for (int count : {1, 16}) {
+        string text;
+        for (int i = 0; i < count; i++) {
+            text += labels[i % labels.size()] + " ";
+        }
+
+        label_map::config cfg({{"labels", labels}});
+        label_map::extractor   extractor(cfg);
+        label_map::transformer transformer;
+        label_map::loader      loader(cfg);
+        vector<char> out(cfg.get_shape_type().get_byte_size());
+
+        auto params = make_shared<label_map::params>();
+        shared_ptr<label_map::decoded> decoded, transformed;
+        string input = to_string(count) + "_labels";
+        r.run("label_map", "extract", input, cfg.type_string, [&]{ decoded = extractor.extract(text.data(), text.size()); });
+        r.run("label_map", "transform", input, cfg.type_string, [&]{ transformed = transformer.transform(params, decoded); });
+        r.run("label_map", "load", input, cfg.type_string, [&]{ loader.load({out.data()}, transformed); });
+    }
+}
+
+int main(int argc, char** argv)
+{
+    string only    = argc > 1 ? argv[1] : "";
+    double seconds = argc > 2 ? atof(argv[2]) : 0.2;
+
+    // OpenCV's own worker threads would hide the cost of a step
+    cv::setNumThreads(0);
+
+    vector<pair<string, function<void(report&)>>> families = {
+        {"image",        bench_image},
+        {"image_var",    bench_image_var},
+        {"multicrop",    bench_multicrop},
+        {"pixel_mask",   bench_pixel_mask},
+        {"boundingbox",  bench_boundingbox},
+        {"localization", bench_localization},
+        {"audio",        bench_audio},
+        {"video",        bench_video},
+        {"char_map",     bench_char_map},
+        {"label_map",    bench_label_map},
+    };
+
+    report r(only, seconds);
+    nlohmann::json errors = nlohmann::json::object();
+    for (auto& family : families) {
+        if (!r.wants(family.first)) {
+            continue;
+        }
+        try {
+            family.second(r);
+        } catch (std::exception& e) {
+            errors[family.first] = e.what();
+        }
+    }
+
+    nlohmann::json js;
+    js["seconds_per_step"] = seconds;
+    js["results"]          = r.rows;
+    if (!errors.empty()) {
+        js["errors"] = errors;
+    }
+    cout << js.dump(2) << endl;
+
+    return 0;
+}
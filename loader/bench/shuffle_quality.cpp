@@ -0,0 +1,218 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+/* shuffle_quality
+ *
+ * Trades shuffle quality against I/O cost for the block iterators.  A
+ * synthetic dataset of `items` records of `record_bytes` each is read in
+ * blocks of `block_size`:
+ *
+ *   sequential       blocks and records in manifest order
+ *   block_shuffle    block_iterator_shuffled: block order and records
+ *                    within a block are shuffled
+ *   mixed_<K>        block_iterator_mixed over block_shuffle, with K
+ *                    blocks resident
+ *   record_shuffle   block_iterator_shuffled with blocks of one record, a
+ *                    global shuffle that costs one read per record
+ *
+ * I/O cost is the number of reads per epoch, their size and the bytes
+ * held in memory.  Quality is measured over consecutive epochs:
+ *
+ *   pair_repeat      fraction of the record pairs sharing a minibatch that
+ *                    already shared one the epoch before.  A global
+ *                    shuffle gives about (minibatch_size - 1) / (items - 1).
+ *   blocks_per_batch distinct blocks of `block_size` a minibatch draws on
+ *   rank_corr        correlation of the position of a record in the epoch
+ *                    with its position in the manifest, 0 is ideal
+ *
+ * usage: shuffle_quality [items] [block_size] [minibatch_size] [epochs] [record_bytes]
+ */
+
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <chrono>
+#include <set>
+#include <unordered_set>
+
+#include "json.hpp"
+#include "util.hpp"
+#include "block_loader.hpp"
+#include "block_iterator_sequential.hpp"
+#include "block_iterator_shuffled.hpp"
+#include "block_iterator_mixed.hpp"
+
+using namespace std;
+using namespace nervana;
+
+// Records carry their index followed by padding.  Every loadBlock counts
+// as one read.
+class record_loader : public block_loader {
+public:
+    record_loader(uint block_size, uint items, uint record_bytes)
+    : block_loader(block_size), _items(items), _record_bytes(record_bytes) {}
+
+    void loadBlock(buffer_in_array& dest, uint block_num)
+    {
+        auto range = recordRange(block_num);
+        for (size_t r = range.first; r < range.second; r++) {
+            char* data = dest[0]->alloc_item(_record_bytes);
+            memset(data, 0, _record_bytes);
+            pack<uint32_t>(data, r);
+        }
+        reads++;
+        bytes += (range.second - range.first) * _record_bytes;
+    }
+    uint objectCount() { return _items; }
+
+    uint64_t reads = 0;
+    uint64_t bytes = 0;
+
+private:
+    uint _items;
+    uint _record_bytes;
+};
+
+static double rank_correlation(const vector<uint32_t>& order)
+{
+    // Spearman: both ranks are permutations of 0..n-1
+    double n = order.size();
+    double d2 = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        double d = (double)i - order[i];
+        d2 += d * d;
+    }
+    return 1.0 - 6.0 * d2 / (n * (n * n - 1.0));
+}
+
+static nlohmann::json run(const string& name, shared_ptr<record_loader> loader,
+                          shared_ptr<block_iterator> it, block_iterator_mixed* mixed,
+                          uint items, uint block_size, uint batch_size, int epochs,
+                          uint record_bytes)
+{
+    // read `epochs` epochs of record indexes
+    vector<vector<uint32_t>> order(epochs);
+    size_t resident = 0;
+    auto start = chrono::steady_clock::now();
+    for (int e = 0; e < epochs; e++) {
+        while (order[e].size() < items) {
+            buffer_in_array bp(1);
+            it->read(bp);
+            resident = max(resident, (size_t)bp[0]->get_item_count() * record_bytes);
+            if (mixed != nullptr) {
+                resident = max(resident, mixed->poolBytes() + bp[0]->get_item_count() * record_bytes);
+            }
+            for (int i = 0; i < bp[0]->get_item_count(); i++) {
+                order[e].push_back(unpack<uint32_t>(bp[0]->get_item(i).data()));
+            }
+        }
+        order[e].resize(items);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    double repeat = 0, blocks = 0, corr = 0;
+    int batches = items / batch_size;
+    unordered_set<uint64_t> previous;
+    for (int e = 0; e < epochs; e++) {
+        unordered_set<uint64_t> pairs;
+        uint64_t repeated = 0;
+        for (int b = 0; b < batches; b++) {
+            auto first = order[e].begin() + b * batch_size;
+            set<uint32_t> sources;
+            for (uint i = 0; i < batch_size; i++) {
+                sources.insert(first[i] / block_size);
+                for (uint j = i + 1; j < batch_size; j++) {
+                    uint64_t pair = ((uint64_t)min(first[i], first[j]) << 32) | max(first[i], first[j]);
+                    pairs.insert(pair);
+                    repeated += previous.count(pair);
+                }
+            }
+            blocks += sources.size();
+        }
+        if (e > 0) {
+            repeat += (double)repeated / pairs.size();
+        }
+        previous.swap(pairs);
+
+        vector<uint32_t> position(items);
+        for (uint i = 0; i < items; i++) {
+            position[order[e][i]] = i;
+        }
+        corr += fabs(rank_correlation(position));
+    }
+
+    nlohmann::json result;
+    result["iterator"]         = name;
+    result["reads_per_epoch"]  = (double)loader->reads / epochs;
+    result["bytes_per_read"]   = (double)loader->bytes / loader->reads;
+    result["resident_bytes"]   = resident;
+    result["pair_repeat"]      = repeat / (epochs - 1);
+    result["blocks_per_batch"] = blocks / (batches * epochs);
+    result["rank_corr"]        = corr / epochs;
+    result["seconds"]          = seconds;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    uint items        = argc > 1 ? atoi(argv[1]) : 32768;
+    uint block_size   = argc > 2 ? atoi(argv[2]) : 1024;
+    uint batch_size   = argc > 3 ? atoi(argv[3]) : 32;
+    int  epochs       = argc > 4 ? atoi(argv[4]) : 3;
+    uint record_bytes = argc > 5 ? atoi(argv[5]) : 64;
+
+    epochs       = max(epochs, 2);
+    record_bytes = max(record_bytes, (uint)sizeof(uint32_t));
+    items        = max(items / batch_size, 1u) * batch_size;
+
+    nlohmann::json results = nlohmann::json::array();
+    {
+        auto loader = make_shared<record_loader>(block_size, items, record_bytes);
+        auto it = make_shared<block_iterator_sequential>(loader);
+        results.push_back(run("sequential", loader, it, nullptr,
+                              items, block_size, batch_size, epochs, record_bytes));
+    }
+    {
+        auto loader = make_shared<record_loader>(block_size, items, record_bytes);
+        auto it = make_shared<block_iterator_shuffled>(loader, 0);
+        results.push_back(run("block_shuffle", loader, it, nullptr,
+                              items, block_size, batch_size, epochs, record_bytes));
+    }
+    for (uint k = 2; k <= 64 && k <= (items + block_size - 1) / block_size; k *= 2) {
+        auto loader = make_shared<record_loader>(block_size, items, record_bytes);
+        auto source = make_shared<block_iterator_shuffled>(loader, 0);
+        auto it = make_shared<block_iterator_mixed>(source, block_size, items, k, 0, 0);
+        results.push_back(run("mixed_" + to_string(k), loader, it, it.get(),
+                              items, block_size, batch_size, epochs, record_bytes));
+    }
+    {
+        auto loader = make_shared<record_loader>(1, items, record_bytes);
+        auto it = make_shared<block_iterator_shuffled>(loader, 0);
+        results.push_back(run("record_shuffle", loader, it, nullptr,
+                              items, block_size, batch_size, epochs, record_bytes));
+    }
+
+    nlohmann::json js;
+    js["items"]          = items;
+    js["block_size"]     = block_size;
+    js["minibatch_size"] = batch_size;
+    js["epochs"]         = epochs;
+    js["record_bytes"]   = record_bytes;
+    js["ideal_pair_repeat"] = (double)(batch_size - 1) / (items - 1);
+    js["results"]        = results;
+    cout << js.dump(2) << endl;
+
+    return 0;
+}
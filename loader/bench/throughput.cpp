@@ -0,0 +1,379 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+/* throughput
+ *
+ * End-to-end throughput of the native pipeline with no Python involved.
+ * Files are read by block_loader_file, assembled into minibatches by the
+ * read stage and decoded by decode_thread_pool with providers from
+ * provider_factory.  A null consumer takes the place of the device transfer.
+ *
+ * Synthetic datasets are written to a scratch directory first: PNG images
+ * from gen_image, MPEG clips from gen_video and WAV files from
+ * sinewave_generator.  Every provider type is run at 1, 2, 4, ... decode
+ * threads up to `max_threads` and the results are printed as JSON.
+ *
+ * usage: throughput [items] [minibatch_size] [max_threads] [epochs] [type]
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <map>
+
+#include "loader.hpp"
+#include "block_loader_file.hpp"
+#include "block_iterator_sequential.hpp"
+#include "pipeline_stats.hpp"
+#include "wav_data.hpp"
+#include "gen_image.hpp"
+#include "gen_video.hpp"
+
+using namespace std;
+using namespace nervana;
+
+// Records of one kind of media and the manifests that pair them with
+// different targets.
+class dataset_files {
+public:
+    map<string, string> manifests;
+    vector<string>      files;
+    size_t              bytes = 0;      // data files only
+};
+
+class benchmark {
+public:
+    string          dataset;
+    string          manifest;
+    nlohmann::json  config;
+};
+
+static string write_file(dataset_files& ds, const string& name, const void* data, size_t size)
+{
+    ofstream f(name, ios::binary);
+    f.write((const char*)data, size);
+    if (!f) {
+        throw runtime_error("could not write " + name);
+    }
+    ds.files.push_back(name);
+    return name;
+}
+
+static void write_manifest(dataset_files& ds, const string& dir, const string& name,
+                           const vector<vector<string>>& rows)
+{
+    string filename = dir + "/" + name + ".csv";
+    ofstream f(filename);
+    for (auto& row : rows) {
+        for (size_t i = 0; i < row.size(); i++) {
+            f << (i ? "," : "") << row[i];
+        }
+        f << "\n";
+    }
+    ds.files.push_back(filename);
+    ds.manifests[name] = filename;
+}
+
+static string write_label(dataset_files& ds, const string& dir, int i)
+{
+    int label = i % 10;
+    return write_file(ds, dir + "/label_" + to_string(i) + ".bin", &label, sizeof(label));
+}
+
+static dataset_files make_images(const string& dir, int items)
+{
+    dataset_files ds;
+
+    // gen_image writes cpio archives, unpack them into one file per record
+    gen_image images;
+    images.Directory(dir).Prefix("gen-image-").MacrobatchMaxItems(items).DatasetSize(items).Create();
+
+    string annotation = R"({"object": [{"bndbox": {"xmin": 64, "ymin": 64, "xmax": 192, "ymax": 192},
+                                        "name": "digit"}],
+                            "size": {"width": 256, "height": 256, "depth": 3}})";
+    string bbox = write_file(ds, dir + "/bbox.json", annotation.data(), annotation.size());
+
+    vector<vector<string>> data, label, mask, boxes;
+    for (const string& archive : images.GetFiles()) {
+        cpio::file_reader reader;
+        if (!reader.open(archive)) {
+            throw runtime_error("could not open " + archive);
+        }
+        buffer_in datum;
+        buffer_in target;
+        for (int i = 0; i < reader.itemCount(); i++) {
+            reader.read(datum);
+            reader.read(target);
+        }
+        reader.close();
+
+        for (int i = 0; i < datum.get_item_count(); i++) {
+            int n = data.size();
+            const buffer_item& png = datum.get_item(i);
+            string image = write_file(ds, dir + "/image_" + to_string(n) + ".png", png.data(), png.size());
+            ds.bytes += png.size();
+
+            data.push_back({image});
+            label.push_back({image, write_label(ds, dir, n)});
+            // the image itself serves as a pixel mask
+            mask.push_back({image, image});
+            boxes.push_back({image, bbox});
+        }
+    }
+    images.Delete();
+
+    write_manifest(ds, dir, "image", data);
+    write_manifest(ds, dir, "image_label", label);
+    write_manifest(ds, dir, "image_mask", mask);
+    write_manifest(ds, dir, "image_bbox", boxes);
+    return ds;
+}
+
+static dataset_files make_audio(const string& dir, int items)
+{
+    dataset_files ds;
+    wav_data wav(sinewave_generator(400, 200), 2, 16000, false);
+    vector<char> buf(wav_data::HEADER_SIZE + wav.nbytes());
+    wav.write_to_buffer(buf.data(), buf.size());
+
+    string text = "THE QUICK BROWN FOX";
+    string transcript = write_file(ds, dir + "/transcript.txt", text.data(), text.size());
+
+    vector<vector<string>> data, label, trans;
+    for (int i = 0; i < items; i++) {
+        string audio = write_file(ds, dir + "/audio_" + to_string(i) + ".wav", buf.data(), buf.size());
+        ds.bytes += buf.size();
+
+        data.push_back({audio});
+        label.push_back({audio, write_label(ds, dir, i)});
+        trans.push_back({audio, transcript});
+    }
+
+    write_manifest(ds, dir, "audio", data);
+    write_manifest(ds, dir, "audio_label", label);
+    write_manifest(ds, dir, "audio_text", trans);
+    return ds;
+}
+
+static dataset_files make_video(const string& dir, int items)
+{
+    dataset_files ds;
+    // one second at 25 frames per second
+    vector<unsigned char> clip = gen_video().encode(1000);
+
+    vector<vector<string>> data, label;
+    for (int i = 0; i < items; i++) {
+        string video = write_file(ds, dir + "/video_" + to_string(i) + ".mpg", clip.data(), clip.size());
+        ds.bytes += clip.size();
+
+        data.push_back({video});
+        label.push_back({video, write_label(ds, dir, i)});
+    }
+
+    write_manifest(ds, dir, "video", data);
+    write_manifest(ds, dir, "video_label", label);
+    return ds;
+}
+
+static vector<benchmark> benchmarks()
+{
+    nlohmann::json image = {{"height", 224}, {"width", 224}, {"channel_major", false},
+                            {"flip_enable", true}, {"scale", {0.5, 1.0}}};
+    nlohmann::json audio = {{"max_duration", "2000 milliseconds"},
+                            {"frame_length", "1024 samples"},
+                            {"frame_stride", "256 samples"},
+                            {"sample_freq_hz", 16000},
+                            {"feature_type", "specgram"}};
+    nlohmann::json video = {{"max_frame_count", 25},
+                            {"frame", {{"height", 112}, {"width", 112}}}};
+
+    return {
+        {"image", "image", {{"type", "image"}, {"image", image}}},
+        {"image", "image_label", {{"type", "image,label"}, {"image", image}, {"label", {}}}},
+        {"image", "image_mask", {{"type", "image,pixelmask"}, {"image", image},
+                                 {"pixelmask", {{"height", 224}, {"width", 224}, {"channels", 1}}}}},
+        {"image", "image_bbox", {{"type", "image,boundingbox"}, {"image", image},
+                                 {"boundingbox", {{"height", 224}, {"width", 224},
+                                                  {"max_bbox_count", 8}, {"labels", nlohmann::json::array({"digit"})}}}}},
+        {"image", "image_bbox", {{"type", "image,localization"},
+                                 {"image", {{"min_size", 256}, {"max_size", 256}, {"channel_major", false}}},
+                                 {"localization", {{"min_size", 256}, {"max_size", 256},
+                                                   {"labels", nlohmann::json::array({"digit"})}}}}},
+        {"audio", "audio", {{"type", "audio"}, {"audio", audio}}},
+        {"audio", "audio_label", {{"type", "audio,label"}, {"audio", audio}, {"label", {}}}},
+        {"audio", "audio_text", {{"type", "audio,transcription"}, {"audio", audio},
+                                 {"transcription", {{"alphabet", "ABCDEFGHIJKLMNOPQRSTUVWXYZ .,()"},
+                                                    {"max_length", 50}}}}},
+        {"video", "video", {{"type", "video"}, {"video", video}}},
+        {"video", "video_label", {{"type", "video,label"}, {"video", video}, {"label", {}}}},
+    };
+}
+
+// Run `nbatches` minibatches through the pipeline and time all but the
+// first, which includes thread start up and the first block loads.
+static nlohmann::json run(const benchmark& b, const string& manifest_file, int threads,
+                          int batch_size, int nbatches, double bytes_per_item)
+{
+    const int depth = 4;
+
+    vector<shared_ptr<provider_interface>> providers;
+    for (int i = 0; i < threads; i++) {
+        providers.push_back(provider_factory::create(b.config));
+    }
+    vector<size_t> write_sizes;
+    for (auto& o : providers[0]->get_oshapes()) {
+        write_sizes.push_back(o.get_byte_size());
+    }
+
+    auto manifest = make_shared<manifest_csv>(manifest_file, false);
+    auto files    = make_shared<block_loader_file>(manifest, 1.0, batch_size, 32);
+    auto blocks   = make_shared<block_iterator_sequential>(files);
+    auto stats    = make_shared<pipeline_stats>(threads);
+    auto batches  = make_shared<batch_iterator>(blocks, batch_size, stats->load);
+
+    auto in  = make_shared<buffer_pool_in>(providers[0]->num_inputs, depth);
+    auto out = make_shared<buffer_pool_out>(write_sizes, batch_size, false, depth);
+    read_thread_pool reader(in, batches, 0, stats->read);
+    decode_thread_pool decoder(threads, batch_size, in, out, stats->decode);
+    for (auto& p : providers) {
+        decoder.add_provider(p);
+    }
+    decoder.start();
+    reader.start();
+
+    int errors = 0;
+    chrono::steady_clock::time_point start;
+    for (int i = 0; i <= nbatches; i++) {
+        {
+            stage_timer timer(stats->consumer->wait_input_ns);
+            if (out->wait_for_not_empty() == false) {
+                break;
+            }
+        }
+        try {
+            out->get_for_read();
+        } catch (std::exception& e) {
+            errors++;
+        }
+        out->advance_read_pos();
+        stats->consumer->items++;
+        if (i == 0) {
+            start = chrono::steady_clock::now();
+        }
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    reader.stop();
+    decoder.stop();
+
+    double items_per_sec = nbatches * batch_size / elapsed;
+    nlohmann::json js;
+    js["threads"]       = threads;
+    js["items_per_sec"] = items_per_sec;
+    js["mb_per_sec"]    = items_per_sec * bytes_per_item / (1 << 20);
+    js["errors"]        = errors;
+    js["verdict"]       = stats->verdict();
+    return js;
+}
+
+int main(int argc, char** argv)
+{
+    int    items       = argc > 1 ? atoi(argv[1]) : 512;
+    int    batch_size  = argc > 2 ? atoi(argv[2]) : 64;
+    int    max_threads = argc > 3 ? atoi(argv[3]) : thread::hardware_concurrency();
+    int    epochs      = argc > 4 ? atoi(argv[4]) : 2;
+    string only        = argc > 5 ? argv[5] : "";
+
+    max_threads = max(max_threads, 1);
+    int nbatches = max(1, epochs * items / batch_size);
+
+    char dir_template[] = "/tmp/aeon_bench_XXXXXX";
+    const char* tmp = mkdtemp(dir_template);
+    if (tmp == nullptr) {
+        cerr << "could not create a scratch directory" << endl;
+        return 1;
+    }
+    string dir = tmp;
+
+    map<string, dataset_files> datasets;
+    nlohmann::json results = nlohmann::json::array();
+    for (auto& b : benchmarks()) {
+        string type = b.config["type"];
+        if (!only.empty() && type != only) {
+            continue;
+        }
+
+        nlohmann::json result;
+        result["type"] = type;
+        try {
+            if (datasets.find(b.dataset) == datasets.end()) {
+                if (b.dataset == "image") {
+                    datasets[b.dataset] = make_images(dir, items);
+                } else if (b.dataset == "audio") {
+                    datasets[b.dataset] = make_audio(dir, items);
+                } else {
+                    datasets[b.dataset] = make_video(dir, items);
+                }
+            }
+            dataset_files& ds = datasets[b.dataset];
+            double bytes_per_item = (double)ds.bytes / items;
+            result["bytes_per_item"] = bytes_per_item;
+
+            // per-core scaling: speedup and efficiency relative to one thread
+            nlohmann::json scaling = nlohmann::json::array();
+            double base = 0;
+            for (int threads = 1; ; threads = min(threads * 2, max_threads)) {
+                nlohmann::json point = run(b, ds.manifests[b.manifest], threads,
+                                           batch_size, nbatches, bytes_per_item);
+                double ips = point["items_per_sec"];
+                if (threads == 1) {
+                    base = ips;
+                }
+                point["speedup"]    = ips / base;
+                point["efficiency"] = ips / base / threads;
+                scaling.push_back(point);
+                if (threads == max_threads) {
+                    break;
+                }
+            }
+            result["scaling"] = scaling;
+        } catch (std::exception& e) {
+            result["error"] = e.what();
+        }
+        results.push_back(result);
+    }
+
+    for (auto& ds : datasets) {
+        for (auto& f : ds.second.files) {
+            remove(f.c_str());
+        }
+    }
+    rmdir(dir.c_str());
+
+    nlohmann::json js;
+    js["items"]          = items;
+    js["minibatch_size"] = batch_size;
+    js["minibatches"]    = nbatches;
+    js["hardware_concurrency"] = thread::hardware_concurrency();
+    js["results"]        = results;
+    cout << js.dump(2) << endl;
+
+    return 0;
+}
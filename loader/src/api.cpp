@@ -82,6 +82,29 @@ extern PyObject* shapes(loader* data_loader)
     }
 }
 
+extern const char* stats(loader* data_loader)
+{
+    try {
+        return data_loader->stats();
+    } catch(std::exception& ex) {
+        last_error_message = ex.what();
+        return 0;
+    }
+}
+
+extern const char* build_cache(const char* loaderConfigString, int threads)
+{
+    try {
+        cache_builder builder(loaderConfigString, threads);
+        builder.build();
+        last_build_summary = builder.progress().dump();
+        return last_build_summary.c_str();
+    } catch(std::exception& ex) {
+        last_error_message = ex.what();
+        return 0;
+    }
+}
+
 extern int itemCount(loader* data_loader)
 {
     try {
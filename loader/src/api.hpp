@@ -16,10 +16,12 @@
 #pragma once
 #include "cpio.hpp"
 #include "loader.hpp"
+#include "cache_builder.hpp"
 
 extern "C" {
 
 static std::string last_error_message;
+static std::string last_build_summary;
 
 extern const char* get_error_message();
 extern int error();
@@ -29,5 +31,7 @@ extern int reset(nervana::loader* data_loader);
 extern int stop(nervana::loader* data_loader);
 extern int itemCount(nervana::loader* data_loader);
 extern PyObject* shapes(nervana::loader* data_loader);
+extern const char* stats(nervana::loader* data_loader);
+extern const char* build_cache(const char* loaderConfigString, int threads);
 
 }
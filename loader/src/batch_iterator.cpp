@@ -18,9 +18,11 @@
 using namespace nervana;
 
 batch_iterator::batch_iterator(std::shared_ptr<block_iterator> src_block_iterator,
-                               int batch_size)
+                               int batch_size,
+                               std::shared_ptr<stage_stats> stats)
     : _src_block_iterator(src_block_iterator),
       _batch_size(batch_size),
+      _stats(stats),
       _i(0)
 {
     // Note that we don't know how many buffer_ins in we will be writing to until this.read()
@@ -44,8 +46,11 @@ void batch_iterator::read(buffer_in_array& dst_buffer_array)
 
 void batch_iterator::reset()
 {
-    for (auto m: *_src_buffer_array_ptr) {
-        m->reset();
+    // nothing has been read yet if there is no block buffer
+    if (_src_buffer_array_ptr != nullptr) {
+        for (auto m: *_src_buffer_array_ptr) {
+            m->reset();
+        }
     }
 
     _src_block_iterator->reset();
@@ -55,8 +60,10 @@ void batch_iterator::reset()
 
 void batch_iterator::transfer_buffer_item(buffer_in* dst, buffer_in* src)
 {
+    // items are taken out of the block, so views of a mapped cache file
+    // are handed on without copying the data
     try {
-        dst->add_item(src->get_item(_i));
+        dst->add_item(std::move(src->get_item(_i)));
     } catch (std::exception& e) {
         dst->add_exception(std::current_exception());
     }
@@ -72,7 +79,7 @@ void batch_iterator::pop_item_from_block(buffer_in_array& dst_buffer_array)
             m->reset();
         }
 
-        _src_block_iterator->read(src_buffer_array);
+        read_block(src_buffer_array);
 
         _i = 0;
     }
@@ -87,3 +94,24 @@ void batch_iterator::pop_item_from_block(buffer_in_array& dst_buffer_array)
 
     _i += 1;
 }
+
+void batch_iterator::read_block(buffer_in_array& src_buffer_array)
+{
+    {
+        stage_timer timer(_stats->busy_ns);
+        _src_block_iterator->read(src_buffer_array);
+    }
+
+    uint64_t bytes = 0;
+    for (auto m: src_buffer_array) {
+        for (int i = 0; i < m->get_item_count(); ++i) {
+            try {
+                bytes += m->get_item(i).size();
+            } catch (std::exception& e) {
+                _stats->exceptions++;
+            }
+        }
+    }
+    _stats->bytes += bytes;
+    _stats->items++;
+}
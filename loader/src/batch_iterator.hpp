@@ -19,6 +19,7 @@
 
 #include "buffer_in.hpp"
 #include "block_iterator.hpp"
+#include "pipeline_stats.hpp"
 
 namespace nervana {
     class batch_iterator;
@@ -26,16 +27,20 @@ namespace nervana {
 
 class nervana::batch_iterator {
 public:
-    batch_iterator(std::shared_ptr<block_iterator> src_block_iterator, int batch_size);
+    // `stats` accumulates the time spent loading blocks and their size
+    batch_iterator(std::shared_ptr<block_iterator> src_block_iterator, int batch_size,
+                   std::shared_ptr<nervana::stage_stats> stats = std::make_shared<nervana::stage_stats>());
 
     void read(nervana::buffer_in_array& dst_buffer_array);
     void reset();
 protected:
     void pop_item_from_block(nervana::buffer_in_array& dst_buffer_array);
     void transfer_buffer_item(nervana::buffer_in* dst, nervana::buffer_in* src);
+    void read_block(nervana::buffer_in_array& src_buffer_array);
 
     std::shared_ptr<block_iterator> _src_block_iterator;
     int _batch_size;
+    std::shared_ptr<nervana::stage_stats> _stats;
 
     std::shared_ptr<nervana::buffer_in_array> _src_buffer_array_ptr;
     // the index into the _macrobatch to read next
@@ -0,0 +1,332 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include <stdexcept>
+#include <algorithm>
+
+#include "block_file.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static uint64_t align_up(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+block_file::header::header()
+: version(BLOCK_FILE_VERSION), alignment(0), record_count(0), element_count(0), index_offset(0),
+  codec(compression::none), reserved(0), raw_size_offset(0)
+{
+    static_assert(sizeof(header) == 64, "block file header is not 64 bytes");
+    memcpy(magic, BLOCK_FILE_MAGIC, sizeof(magic));
+    memset(unused, 0, sizeof(unused));
+}
+
+void block_file::header::verify(const string& fileName) const
+{
+    if (memcmp(magic, BLOCK_FILE_MAGIC, sizeof(magic)) != 0) {
+        throw runtime_error("not a block file: " + fileName);
+    }
+    if (version != BLOCK_FILE_VERSION) {
+        throw runtime_error("unsupported block file version " + to_string(version) + " in " + fileName);
+    }
+}
+
+block_file::reader::reader()
+{
+}
+
+block_file::reader::~reader()
+{
+    close();
+}
+
+bool block_file::reader::open(const string& fileName, bool mapped)
+{
+    // returns true if file was opened successfully.
+    assert(_fd < 0);
+
+    _fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_fd < 0) {
+        return false;
+    }
+    struct stat stats;
+    if (fstat(_fd, &stats) != 0) {
+        close();
+        return false;
+    }
+    _fileName = fileName;
+    _size     = stats.st_size;
+
+    try {
+        if (_size < sizeof(_header)) {
+            throw runtime_error("block file is truncated: " + fileName);
+        }
+        pread_exact((char*)&_header, sizeof(_header), 0);
+        _header.verify(fileName);
+
+        uint64_t count = (uint64_t)_header.record_count * _header.element_count;
+        if (_header.index_offset > _size || count > (_size - _header.index_offset) / sizeof(entry)) {
+            throw runtime_error("block file index is out of range: " + fileName);
+        }
+        _index.resize(count);
+        pread_exact((char*)_index.data(), count * sizeof(entry), _header.index_offset);
+
+        if (_header.codec != compression::none) {
+            // throws if this build lacks the codec
+            compression::parse(compression::name((compression::codec)_header.codec));
+            if (_header.raw_size_offset > _size ||
+                count > (_size - _header.raw_size_offset) / sizeof(uint64_t)) {
+                throw runtime_error("block file raw sizes are out of range: " + fileName);
+            }
+            _raw_sizes.resize(count);
+            pread_exact((char*)_raw_sizes.data(), count * sizeof(uint64_t), _header.raw_size_offset);
+        }
+
+        // elements are laid out in index order, the readers rely on it
+        uint64_t end = sizeof(_header);
+        for (auto& e : _index) {
+            if (e.offset < end || e.offset > _header.index_offset ||
+                e.size > _header.index_offset - e.offset) {
+                throw runtime_error("block file index is corrupt: " + fileName);
+            }
+            end = e.offset + e.size;
+        }
+
+        if (mapped) {
+            void* base = mmap(0, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (base == MAP_FAILED) {
+                throw runtime_error("error mapping " + fileName + ": " + strerror(errno));
+            }
+            madvise(base, _size, MADV_WILLNEED);
+            uint64_t size = _size;
+            _map = shared_ptr<const char>((const char*)base, [size](const char* p) {
+                munmap((void*)p, size);
+            });
+        }
+    } catch (std::exception&) {
+        close();
+        throw;
+    }
+
+    return true;
+}
+
+void block_file::reader::close()
+{
+    // records already handed out keep the mapping alive
+    _map = nullptr;
+    _index.clear();
+    _raw_sizes.clear();
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+const block_file::entry& block_file::reader::get_entry(int record, int element) const
+{
+    if (record < 0 || record >= recordCount()) {
+        throw out_of_range("record " + to_string(record) + " not in " + _fileName);
+    }
+    return _index[(size_t)record * _header.element_count + element];
+}
+
+void block_file::reader::read_record(int record, buffer_in_array& dest)
+{
+    if ((int)dest.size() != elementCount()) {
+        throw invalid_argument("block file has " + to_string(elementCount()) + " elements per record");
+    }
+    for (int i = 0; i < elementCount(); i++) {
+        const entry& e = get_entry(record, i);
+        if (_map) {
+            dest[i]->add_item(buffer_item(_map.get() + e.offset, e.size, _map));
+        } else {
+            pread_exact(dest[i]->alloc_item(e.size), e.size, e.offset);
+        }
+        mark_compressed(*dest[i], (size_t)record * _header.element_count + i);
+    }
+}
+
+void block_file::reader::mark_compressed(buffer_in& dest, size_t index)
+{
+    // flag the item just added if it was stored compressed
+    if (!_raw_sizes.empty() && _raw_sizes[index] != _index[index].size) {
+        dest.get_item(dest.get_item_count() - 1).set_compressed(_header.codec, _raw_sizes[index]);
+    }
+}
+
+void block_file::reader::read_all(buffer_in_array& dest)
+{
+    if (_map || _index.empty()) {
+        for (int r = 0; r < recordCount(); r++) {
+            read_record(r, dest);
+        }
+        return;
+    }
+    if ((int)dest.size() != elementCount()) {
+        throw invalid_argument("block file has " + to_string(elementCount()) + " elements per record");
+    }
+
+    // One read from the first element to the end of the last into a single
+    // allocation.  The items are views of it, padding included.
+    uint64_t start = _index.front().offset;
+    uint64_t end   = start;
+    for (const entry& e : _index) {
+        end = max(end, e.offset + e.size);
+    }
+    shared_ptr<char> data(new char[max<uint64_t>(end - start, 1)], default_delete<char[]>());
+    pread_exact(data.get(), end - start, start);
+
+    for (size_t i = 0; i < _index.size(); i++) {
+        buffer_in& b = *dest[i % elementCount()];
+        b.add_item(buffer_item(data.get() + (_index[i].offset - start), _index[i].size, data));
+        mark_compressed(b, i);
+    }
+}
+
+void block_file::reader::pread_exact(char* data, size_t size, uint64_t offset)
+{
+    while (size > 0) {
+        ssize_t n = pread(_fd, data, size, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            string reason = n < 0 ? strerror(errno) : "unexpected end of file";
+            throw runtime_error("error reading block file: " + _fileName + " " + reason);
+        }
+        data   += n;
+        size   -= n;
+        offset += n;
+    }
+}
+
+block_file::file_writer::~file_writer()
+{
+    // a block that was never closed is incomplete, leave nothing behind
+    if (_ofs.is_open()) {
+        _ofs.close();
+        remove(_tempName.c_str());
+    }
+}
+
+void block_file::file_writer::open(const string& fileName, uint32_t alignment,
+                                   compression::codec codec)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        throw invalid_argument("block file alignment must be a power of two");
+    }
+    _fileName = fileName;
+    _tempName = fileName + ".tmp";
+    assert(_ofs.is_open() == false);
+    _ofs.open(_tempName, ostream::binary);
+    if (!_ofs) {
+        throw runtime_error("Could not create " + _tempName);
+    }
+
+    _header = header();
+    _header.alignment = alignment;
+    _header.codec = codec;
+    _index.clear();
+    _raw_sizes.clear();
+    // This will be incomplete until the write on close()
+    _ofs.write((char*)&_header, sizeof(_header));
+    _offset = sizeof(_header);
+}
+
+void block_file::file_writer::close()
+{
+    if (_ofs.is_open() == true) {
+        pad_to(align_up(_offset, sizeof(entry)));
+        _header.index_offset = _offset;
+        _ofs.write((char*)_index.data(), _index.size() * sizeof(entry));
+        _offset += _index.size() * sizeof(entry);
+        if (_header.codec != compression::none) {
+            _header.raw_size_offset = _offset;
+            _ofs.write((char*)_raw_sizes.data(), _raw_sizes.size() * sizeof(uint64_t));
+        }
+        _ofs.seekp(0, _ofs.beg);
+        _ofs.write((char*)&_header, sizeof(_header));
+        _ofs.close();
+        if (!_ofs) {
+            remove(_tempName.c_str());
+            throw runtime_error("error writing " + _tempName);
+        }
+        if (rename(_tempName.c_str(), _fileName.c_str()) != 0) {
+            throw runtime_error("Could not create " + _fileName + ": " + strerror(errno));
+        }
+    }
+}
+
+void block_file::file_writer::write_all_records(buffer_in_array& buff)
+{
+    int num_records = buff[0]->get_item_count();
+    for (int i = 0; i < num_records; ++i) {
+        write_record(buff, i);
+    }
+}
+
+void block_file::file_writer::write_record(buffer_in_array& buff, int record_idx)
+{
+    if (_header.record_count == 0) {
+        _header.element_count = buff.size();
+    } else if (_header.element_count != buff.size()) {
+        throw invalid_argument("every record of a block file needs the same number of elements");
+    }
+
+    // fetch every element first, so an item holding an exception leaves
+    // nothing half written
+    vector<const buffer_item*> elements;
+    for (auto b : buff) {
+        elements.push_back(&b->get_item(record_idx));
+    }
+    vector<char> compressed;
+    for (auto e : elements) {
+        const char* data = e->data();
+        size_t      size = e->size();
+        if (compression::compress((compression::codec)_header.codec, data, size, compressed)) {
+            data = compressed.data();
+            size = compressed.size();
+        }
+        _raw_sizes.push_back(e->size());
+
+        pad_to(align_up(_offset, _header.alignment));
+        _index.push_back({_offset, size});
+        _ofs.write(data, size);
+        _offset += size;
+    }
+    _header.record_count++;
+}
+
+void block_file::file_writer::pad_to(uint64_t offset)
+{
+    static const char zeros[4096] = {};
+    while (_offset < offset) {
+        size_t count = min((uint64_t)sizeof(zeros), offset - _offset);
+        _ofs.write(zeros, count);
+        _offset += count;
+    }
+}
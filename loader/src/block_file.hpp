@@ -0,0 +1,149 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+
+#include "buffer_in.hpp"
+#include "compression.hpp"
+
+#define BLOCK_FILE_MAGIC    "AEONBLK2"
+#define BLOCK_FILE_VERSION  2
+
+namespace nervana {
+    namespace block_file {
+        class header;
+        class entry;
+        class reader;
+        class file_writer;
+    }
+}
+
+/*
+
+Block files replace cpio as the on disk format of cached macroblocks.
+
+    - header, 64 bytes
+    - element 0 of record 0
+    - element 1 of record 0
+    - element 0 of record 1
+      ...
+    - index
+    - raw sizes, only if `codec` is set
+
+Every element starts at a multiple of the alignment given to the writer,
+64 bytes by default or a page for direct I/O.  The index at the end holds
+the offset and length of each element, record by record, so any record is
+found without walking the ones before it.
+
+A writer given a codec compresses each element on its own, so records stay
+randomly accessible and can be decompressed by different threads.  The
+raw size table then holds the original length of every element.  An
+element stored as is has the same raw and stored size.
+
+*/
+
+class nervana::block_file::header {
+public:
+    header();
+    // throws if `magic` or `version` are not ours
+    void verify(const std::string& fileName) const;
+
+#pragma pack(1)
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    alignment;
+    uint32_t    record_count;
+    uint32_t    element_count;
+    uint64_t    index_offset;
+    uint32_t    codec;
+    uint32_t    reserved;
+    uint64_t    raw_size_offset;
+    uint8_t     unused[16];
+#pragma pack()
+};
+
+class nervana::block_file::entry {
+public:
+    uint64_t    offset;
+    uint64_t    size;
+};
+
+/*
+ * reader gives random access to the records of a block file.  A mapped
+ * file hands its elements out as views into the mapping.  Otherwise a
+ * whole block is read with a single pread, padding and all, into one
+ * allocation that its elements are views of.
+ *
+ * Compressed elements are handed out as they are, marked with their codec.
+ * They are decompressed later by whoever uses them.
+ */
+
+class nervana::block_file::reader {
+public:
+    reader();
+    ~reader();
+
+    bool open(const std::string& fileName, bool mapped = true);
+    void close();
+
+    int recordCount() const { return _header.record_count; }
+    int elementCount() const { return _header.element_count; }
+
+    // append record `record` to `dest`, one element per buffer_in
+    void read_record(int record, nervana::buffer_in_array& dest);
+    // append every record in file order
+    void read_all(nervana::buffer_in_array& dest);
+
+private:
+    const entry& get_entry(int record, int element) const;
+    void mark_compressed(nervana::buffer_in& dest, size_t index);
+    void pread_exact(char* data, size_t size, uint64_t offset);
+
+    int                         _fd = -1;
+    std::shared_ptr<const char> _map;
+    uint64_t                    _size = 0;
+    std::string                 _fileName;
+    header                      _header;
+    std::vector<entry>          _index;
+    std::vector<uint64_t>       _raw_sizes;
+};
+
+class nervana::block_file::file_writer {
+public:
+    ~file_writer();
+
+    void open(const std::string& fileName, uint32_t alignment = 64,
+              nervana::compression::codec codec = nervana::compression::none);
+    void close();
+
+    void write_all_records(nervana::buffer_in_array& buff);
+    void write_record(nervana::buffer_in_array& buff, int record_idx);
+
+private:
+    void pad_to(uint64_t offset);
+
+    std::ofstream               _ofs;
+    header                      _header;
+    std::vector<entry>          _index;
+    std::vector<uint64_t>       _raw_sizes;
+    uint64_t                    _offset = 0;
+    std::string                 _fileName;
+    std::string                 _tempName;
+};
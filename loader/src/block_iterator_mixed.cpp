@@ -0,0 +1,105 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "block_iterator_mixed.hpp"
+
+using namespace std;
+using namespace nervana;
+
+block_iterator_mixed::block_iterator_mixed(shared_ptr<block_iterator> source, uint block_size,
+                                           size_t epoch_records, uint blocks, size_t max_bytes,
+                                           uint seed)
+: _source(source), _block_size(block_size), _epochRecords(epoch_records),
+  _capacity((size_t)block_size * blocks), _maxBytes(max_bytes), _rand(seed)
+{
+}
+
+void block_iterator_mixed::read(buffer_in_array& dest)
+{
+    if (_pool == nullptr) {
+        _pool.reset(new buffer_in_array(dest.size()));
+        _incoming.reset(new buffer_in_array(dest.size()));
+    }
+
+    if (_bytes.empty() && _epochRead >= _epochRecords) {
+        // the last epoch is drained, start on the next one
+        _epochRead = 0;
+    }
+    for (uint k = 0; k < _block_size; k++) {
+        fill();
+        if (_bytes.empty()) {
+            break;
+        }
+        size_t r = uniform_int_distribution<size_t>(0, _bytes.size() - 1)(_rand);
+        for (size_t i = 0; i < dest.size(); i++) {
+            (*_pool)[i]->move_item(r, *dest[i]);
+        }
+        _poolBytes -= _bytes[r];
+        _bytes[r] = _bytes.back();
+        _bytes.pop_back();
+    }
+}
+
+void block_iterator_mixed::fill()
+{
+    // whole blocks are read, so the pool may go one block over
+    while (_epochRead < _epochRecords &&
+           (_bytes.empty() || (_bytes.size() < _capacity && (_maxBytes == 0 || _poolBytes < _maxBytes)))) {
+        if (!readBlock()) {
+            break;
+        }
+    }
+}
+
+bool block_iterator_mixed::readBlock()
+{
+    buffer_in_array& in = *_incoming;
+    for (auto d : in) {
+        d->reset();
+    }
+    _source->read(in);
+
+    int count = in.size() > 0 ? in[0]->get_item_count() : 0;
+    for (int j = 0; j < count; j++) {
+        size_t bytes = 0;
+        for (auto d : in) {
+            try {
+                bytes += d->get_item(j).size();
+            } catch (std::exception&) {
+                // the exception moves with its record
+            }
+        }
+        _bytes.push_back(bytes);
+        _poolBytes += bytes;
+    }
+    for (size_t i = 0; i < in.size(); i++) {
+        (*_pool)[i]->append(*in[i]);
+    }
+    _epochRead += count;
+    return count > 0;
+}
+
+void block_iterator_mixed::reset()
+{
+    if (_pool != nullptr) {
+        for (auto d : *_pool) {
+            d->reset();
+        }
+    }
+    _bytes.clear();
+    _poolBytes = 0;
+    _epochRead = 0;
+    _source->reset();
+}
@@ -0,0 +1,76 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "block_iterator.hpp"
+
+/* block_iterator_mixed
+ *
+ * Mixes the records of several blocks of `source`.  Blocks are still read
+ * whole and in sequence, but they go into a pool holding up to `blocks`
+ * of them, fewer if they would take more than `max_bytes` (0 for no
+ * limit).  Each read() draws `block_size` records from the pool at random
+ * and tops the pool up with whole blocks as it drains.  A record can thus
+ * share a minibatch with records of any block resident at the same time,
+ * not only with the records of its own block.
+ *
+ * An epoch of `source` holds `epoch_records` records.  Once they have all
+ * been read the pool is drained before the next epoch is read, so every
+ * epoch still returns each record exactly once, and its last read may be
+ * short.  The first read of an epoch fills the pool before it returns.
+ */
+
+namespace nervana {
+    class block_iterator_mixed;
+}
+
+class nervana::block_iterator_mixed : public block_iterator {
+public:
+    block_iterator_mixed(std::shared_ptr<block_iterator> source, uint block_size,
+                         size_t epoch_records, uint blocks, size_t max_bytes, uint seed);
+    void read(nervana::buffer_in_array& dest);
+    void reset();
+
+    // records and bytes in the pool
+    size_t poolRecords() const { return _bytes.size(); }
+    size_t poolBytes() const { return _poolBytes; }
+
+private:
+    block_iterator_mixed();
+    block_iterator_mixed(const block_iterator_mixed&);
+
+    void fill();
+    bool readBlock();
+
+    std::shared_ptr<block_iterator> _source;
+    uint _block_size;
+    size_t _epochRecords;
+    size_t _capacity;
+    size_t _maxBytes;
+    std::minstd_rand0 _rand;
+
+    std::unique_ptr<nervana::buffer_in_array> _pool;
+    std::unique_ptr<nervana::buffer_in_array> _incoming;
+    // bytes of each record in the pool, in pool order
+    std::vector<size_t> _bytes;
+    size_t _poolBytes = 0;
+    // records of the current epoch read from `source`
+    size_t _epochRead = 0;
+};
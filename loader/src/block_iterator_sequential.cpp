@@ -13,18 +13,32 @@
  limitations under the License.
 */
 
+#include <algorithm>
+
 #include "block_iterator_sequential.hpp"
 
 using namespace std;
 using namespace nervana;
 
-block_iterator_sequential::block_iterator_sequential(shared_ptr<block_loader> loader)
-: _loader(loader), _count(_loader->blockCount()), _i(0)
+block_iterator_sequential::block_iterator_sequential(shared_ptr<block_loader> loader,
+                                                     uint lookahead)
+: _loader(loader), _count(_loader->blockCount()), _i(0),
+  _lookahead(min(lookahead, _count - 1))
 {
 }
 
 void block_iterator_sequential::read(nervana::buffer_in_array& dest)
 {
+    if (_lookahead > 0) {
+        // the window wraps into the next epoch, which visits blocks in the
+        // same order
+        vector<uint> upcoming;
+        for (uint k = 0; k <= _lookahead; k++) {
+            upcoming.push_back((_i + k) % _count);
+        }
+        _loader->prefetch(upcoming);
+    }
+
     _loader->loadBlock(dest, _i);
     if (++_i == _count) {
         reset();
@@ -24,7 +24,8 @@ namespace nervana {
 
 class nervana::block_iterator_sequential : public block_iterator {
 public:
-    block_iterator_sequential(std::shared_ptr<block_loader> loader);
+    // `lookahead` blocks past the current one are hinted to the loader
+    block_iterator_sequential(std::shared_ptr<block_loader> loader, uint lookahead = 0);
     void read(nervana::buffer_in_array& dest);
     void reset();
 
@@ -32,4 +33,5 @@ private:
     std::shared_ptr<block_loader> _loader;
     uint _count;
     uint _i;
+    uint _lookahead;
 };
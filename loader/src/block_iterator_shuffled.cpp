@@ -22,8 +22,9 @@
 using namespace std;
 using namespace nervana;
 
-block_iterator_shuffled::block_iterator_shuffled(shared_ptr<block_loader> loader, uint seed)
-: _rand(seed), _loader(loader), _seed(seed), _epoch(0)
+block_iterator_shuffled::block_iterator_shuffled(shared_ptr<block_loader> loader,
+                                                 uint seed, uint lookahead)
+: _rand(seed), _loader(loader), _seed(seed), _epoch(0), _lookahead(lookahead)
 {
     // fill indices with integers from  0 to _count.  indices can then be
     // shuffled and used to iterate randomly through the blocks.
@@ -40,6 +41,13 @@ void block_iterator_shuffled::shuffle()
 
 void block_iterator_shuffled::read(nervana::buffer_in_array &dest)
 {
+    if (_lookahead > 0) {
+        // the next epoch is not shuffled yet, so the window stops at the
+        // end of this one
+        auto end = _it + min((size_t)_lookahead + 1, (size_t)(_indices.end() - _it));
+        _loader->prefetch(vector<uint>(_it, end));
+    }
+
     _loader->loadBlock(dest, *_it);
 
     // shuffle the objects in BufferPair dest
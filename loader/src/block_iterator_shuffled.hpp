@@ -26,7 +26,8 @@ namespace nervana {
 // well as shuffling the data in the buffers.
 class nervana::block_iterator_shuffled : public block_iterator {
 public:
-    block_iterator_shuffled(std::shared_ptr<block_loader> loader, uint seed);
+    // `lookahead` blocks past the current one are hinted to the loader
+    block_iterator_shuffled(std::shared_ptr<block_loader> loader, uint seed, uint lookahead = 0);
     void read(nervana::buffer_in_array& dest);
     void reset();
 
@@ -40,4 +41,5 @@ private:
     std::vector<uint>::iterator _it;
     uint _seed;
     uint _epoch;
+    uint _lookahead;
 };
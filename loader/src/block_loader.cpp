@@ -15,7 +15,10 @@
 
 #include <math.h>
 #include <sstream>
+#include <iomanip>
+#include <algorithm>
 #include "block_loader.hpp"
+#include "util.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -29,11 +32,48 @@ uint block_loader::blockSize()
     return _block_size;
 }
 
+pair<size_t, size_t> block_loader::recordRange(uint block_num)
+{
+    size_t begin = (size_t)block_num * _block_size;
+    return make_pair(begin, min(begin + _block_size, (size_t)objectCount()));
+}
+
 uint block_loader::blockCount()
 {
     return ceil((float)objectCount() / (float)_block_size);
 }
 
+uint block_loader::subsetObjectCount(size_t count, float subset_fraction)
+{
+    if (subset_fraction == 1.0) {
+        return count;
+    } else {
+        uint full_block_count = int(count / _block_size);
+        uint subset_object_count = full_block_count * int(_block_size * subset_fraction);
+        uint leftover_object_count = count - full_block_count * _block_size;
+        subset_object_count += (leftover_object_count * subset_fraction);
+        return subset_object_count;
+    }
+}
+
+string block_loader::fingerprintRecords(size_t begin, size_t end, size_t count,
+                                        const function<void(uint64_t&, size_t)>& hash_record)
+{
+    // records past the end of the dataset hash as missing
+    end = min(end, count);
+    begin = min(begin, end);
+
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t record = begin; record < end; record++) {
+        hash_record(h, record);
+        fnv1a(h, "\n", 1);
+    }
+
+    stringstream ss;
+    ss << hex << setw(16) << setfill('0') << h;
+    return ss.str();
+}
+
 
 void block_loader_alphabet::loadBlock(buffer_in_array &dest, uint block_num)
 {
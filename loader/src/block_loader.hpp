@@ -15,6 +15,11 @@
 
 #pragma once
 #include <random>
+#include <vector>
+#include <utility>
+#include <string>
+#include <functional>
+#include <cstdint>
 #include "buffer_in.hpp"
 
 /*
@@ -32,11 +37,34 @@ public:
     virtual void loadBlock(nervana::buffer_in_array& dest, uint block_num) = 0;
     virtual uint objectCount() = 0;
 
+    // hint that `block_nums` are the next blocks loadBlock will be asked
+    // for, in that order.  Each call replaces the previous hint.
+    virtual void prefetch(const std::vector<uint>& block_nums) {}
+
+    // first and one past the last record of `block_num`, as indexes
+    // into the dataset
+    virtual std::pair<size_t, size_t> recordRange(uint block_num);
+
+    // fingerprint of the content of records [begin, end).  It changes
+    // whenever one of them would load differently.  Empty if the loader
+    // cannot tell.
+    virtual std::string fingerprint(size_t begin, size_t end) { return ""; }
+
     uint blockCount();
     uint blockSize();
 
 protected:
     block_loader(uint block_size);
+
+    // objectCount() of a loader keeping the first `subset_fraction` of
+    // every block of `count` records
+    uint subsetObjectCount(size_t count, float subset_fraction);
+
+    // fingerprint() of records [begin, end) of `count`.  `hash_record`
+    // adds one record to a 64 bit FNV-1a hash, see util.hpp.
+    static std::string fingerprintRecords(size_t begin, size_t end, size_t count,
+                                          const std::function<void(uint64_t&, size_t)>& hash_record);
+
     uint _block_size;
 };
 
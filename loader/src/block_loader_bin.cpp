@@ -0,0 +1,116 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+
+#include "block_loader_bin.hpp"
+#include "util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+block_loader_bin::block_loader_bin(shared_ptr<nervana::manifest_bin> manifest,
+                                   float subset_fraction,
+                                   uint block_size,
+                                   int io_queue_depth)
+: block_loader(block_size),
+  _manifest(manifest),
+  _subset_fraction(subset_fraction)
+{
+    assert(_subset_fraction > 0.0 && _subset_fraction <= 1.0);
+    // with a depth of 1 the engine reads in the calling thread
+    _io = io_engine::create(max(1, io_queue_depth));
+}
+
+void block_loader_bin::loadBlock(nervana::buffer_in_array& dest, uint block_num)
+{
+    size_t begin, end;
+    tie(begin, end) = recordRange(block_num);
+
+    // every item is added in order first, then the files are read into
+    // the items waiting for them
+    vector<io_engine::request> requests;
+    vector<pair<uint, int>> items;
+    for (size_t row = begin; row < end; row++) {
+        for (uint i = 0; i < _manifest->fieldCount(); i++) {
+            const manifest_bin::entry& e = _manifest->at(row, i);
+            if (_manifest->isInline(e)) {
+                dest[i]->add_item(buffer_item(_manifest->data(e), e.size, _manifest->mapping()));
+            } else if (_manifest->isMissing(e)) {
+                string filename = _manifest->path(e);
+                dest[i]->add_exception(make_exception_ptr(
+                    runtime_error("Could not find file: \"" + filename + "\"")));
+            } else {
+                io_engine::request r;
+                r.filename = _manifest->path(e);
+                r.size     = e.size;
+                r.buffer   = dest[i]->alloc_item(e.size);
+                requests.push_back(r);
+                items.emplace_back(i, dest[i]->get_item_count() - 1);
+            }
+        }
+    }
+
+    _io->read(requests);
+
+    for (size_t r = 0; r < requests.size(); r++) {
+        if (requests[r].exception) {
+            dest[items[r].first]->set_exception(items[r].second, requests[r].exception);
+        }
+    }
+}
+
+pair<size_t, size_t> block_loader_bin::recordRange(uint block_num)
+{
+    size_t begin_i, end_i;
+    if (_block_size == _manifest->blockSize()) {
+        tie(begin_i, end_i) = _manifest->blockRange(block_num);
+    } else {
+        begin_i = min((size_t)block_num * _block_size, _manifest->objectCount());
+        end_i = min(begin_i + _block_size, _manifest->objectCount());
+    }
+
+    if (_subset_fraction != 1.0) {
+        // the first _subset_fraction of the block, as block_loader_file
+        end_i = begin_i + (((end_i - begin_i) * _subset_fraction));
+    }
+
+    return make_pair(begin_i, end_i);
+}
+
+string block_loader_bin::fingerprint(size_t begin, size_t end)
+{
+    return fingerprintRecords(begin, end, _manifest->objectCount(), [this](uint64_t& h, size_t record) {
+        for (uint i = 0; i < _manifest->fieldCount(); i++) {
+            const manifest_bin::entry& e = _manifest->at(record, i);
+            if (_manifest->isInline(e)) {
+                fnv1a(h, _manifest->data(e), e.size);
+            } else {
+                const char* path = _manifest->path(e);
+                fnv1a(h, path, strlen(path) + 1);
+            }
+            int64_t meta[2] = {(int64_t)e.size, e.mtime};
+            fnv1a(h, meta, sizeof(meta));
+        }
+    });
+}
+
+uint block_loader_bin::objectCount()
+{
+    return subsetObjectCount(_manifest->objectCount(), _subset_fraction);
+}
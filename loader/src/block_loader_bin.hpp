@@ -0,0 +1,57 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include "manifest_bin.hpp"
+#include "buffer_in.hpp"
+#include "block_loader.hpp"
+#include "io_engine.hpp"
+
+/* block_loader_bin
+ *
+ * Loads blocks of files from a binary manifest, see manifest_bin.hpp.
+ *
+ * The manifest knows the size of every file, so items are carved out of
+ * the buffer's arena up front and the files are read straight into them
+ * without a stat.  Inline fields are views of the mapped manifest and
+ * cost no system call at all.  With an `io_queue_depth` above 1 the
+ * files of a block are read by an io_engine.
+ *
+ * The fingerprint of a range of records hashes the paths, sizes and
+ * modification times recorded when the manifest was compiled.
+ */
+
+namespace nervana {
+    class block_loader_bin;
+}
+
+class nervana::block_loader_bin : public block_loader {
+public:
+    block_loader_bin(std::shared_ptr<nervana::manifest_bin> manifest,
+                     float subset_fraction,
+                     uint block_size,
+                     int io_queue_depth = 1);
+
+    void loadBlock(nervana::buffer_in_array& dest, uint block_num);
+    std::pair<size_t, size_t> recordRange(uint block_num);
+    std::string fingerprint(size_t begin, size_t end);
+    uint objectCount();
+
+private:
+    const std::shared_ptr<nervana::manifest_bin> _manifest;
+    float _subset_fraction;
+    std::shared_ptr<nervana::io_engine> _io;
+};
@@ -19,8 +19,16 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <ftw.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 
 #include "cpio.hpp"
+#include "block_file.hpp"
 #include "block_loader_cpio_cache.hpp"
 
 using namespace std;
@@ -29,42 +37,485 @@ using namespace nervana;
 // maximum number of files opened by nftw file enumeration function
 #define OPEN_MAX 128
 
+// least time between two scans of the cache directory after a miss
+#define RESCAN_INTERVAL_MS 1000
+
+// the legacy version blocks cached per block number were written for
+#define LEGACY_VERSION_FILE "legacy.version"
+
 block_loader_cpio_cache::block_loader_cpio_cache(const string& rootCacheDir,
                                                  const string& hash,
                                                  const string& version,
-                                                 shared_ptr<block_loader> loader)
-: block_loader(loader->blockSize()), _loader(loader)
+                                                 shared_ptr<block_loader> loader,
+                                                 bool mapped,
+                                                 const string& codec,
+                                                 size_t max_bytes,
+                                                 size_t write_behind_bytes,
+                                                 const string& legacy_version,
+                                                 int claim_timeout)
+: block_loader(loader->blockSize()), _loader(loader), _mapped(mapped),
+  _codec(compression::parse(codec)), _maxBytes(max_bytes),
+  _claimTimeout(claim_timeout), _writeBehindBytes(write_behind_bytes)
 {
-    invalidateOldCache(rootCacheDir, hash, version);
+    char host[256] = {0};
+    gethostname(host, sizeof(host) - 1);
+    _claimOwner = string(host) + " " + to_string(getpid());
 
     _cacheDir = rootCacheDir + "/" + hash + "_" + version;
 
+    bool legacy = !legacy_version.empty() && legacy_version != version;
+    if (legacy) {
+        adoptLegacyCache(rootCacheDir + "/" + hash + "_" + legacy_version, legacy_version);
+    }
+
+    invalidateOldCache(rootCacheDir, hash, version);
+
     makeDirectory(_cacheDir);
+    if (legacy || access((_cacheDir + "/" LEGACY_VERSION_FILE).c_str(), F_OK) == 0) {
+        // blocks adopted earlier are removed when there is no legacy
+        // version any more
+        _legacy = checkLegacyCache(legacy_version);
+    }
+    scanRecords();
+
+    if (_maxBytes > 0) {
+        _usage = make_shared<usage>();
+        scanCache();
+    }
+
+    if (_writeBehindBytes > 0) {
+        _writer = thread(&block_loader_cpio_cache::write, this);
+    }
+}
+
+block_loader_cpio_cache::~block_loader_cpio_cache()
+{
+    if (_writer.joinable()) {
+        {
+            lock_guard<mutex> lock(_writeMutex);
+            _stopWriter = true;
+        }
+        _writeReady.notify_all();
+        _writer.join();
+    }
 }
 
 void block_loader_cpio_cache::loadBlock(buffer_in_array& dest, uint block_num)
 {
-    if(loadBlockFromCache(dest, block_num)) {
+    // A block leaves the write queue only once its file is in place, so
+    // looking in the queue first cannot miss a block being written.
+    if(_writeBehindBytes > 0 && loadBlockFromQueue(dest, block_num)) {
+        return;
+    } else if(loadBlockFromCache(dest, block_num)) {
         return;
-    } else {
+    }
+
+    // build the block only if no other process or thread is building it
+    bool claimed = false;
+    while(!claimBlock(block_num, claimed)) {
+        if(waitForBlock(dest, block_num)) {
+            return;
+        }
+    }
+
+    vector<int> start;
+    for (auto d : dest) {
+        start.push_back(d->get_item_count());
+    }
+    try {
         _loader->loadBlock(dest, block_num);
+    } catch (std::exception&) {
+        if (claimed) {
+            releaseClaim(block_num);
+        }
+        throw;
+    }
+
+    if(_writeBehindBytes > 0) {
+        writeBehind(dest, start, block_num, claimed);
+        return;
+    }
+    try {
+        writeBlockToCache(dest, start.empty() ? 0 : start[0], block_num);
+    } catch (std::exception& e) {
+        // failure to write block to cache doesn't stop execution, only print an error
+        cerr << "ERROR writing block to cache: " << e.what() << endl;
+    }
+    if (claimed) {
+        releaseClaim(block_num);
+    }
+}
+
+bool block_loader_cpio_cache::claimBlock(uint block_num, bool& claimed)
+{
+    // true if this caller should build the block
+    string filename = claimFilename(block_num);
+    int fd = open(filename.c_str(), O_CREAT | O_EXCL | O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+        // without a usable claim file there is nothing to coordinate on
+        return errno != EEXIST;
+    }
+    string owner = _claimOwner + "\n";
+    if (::write(fd, owner.data(), owner.size()) != (ssize_t)owner.size()) {
+        cerr << "ERROR writing cache claim " << filename << ": " << strerror(errno) << endl;
+    }
+    ::close(fd);
+    claimed = true;
+    return true;
+}
+
+bool block_loader_cpio_cache::waitForBlock(buffer_in_array& dest, uint block_num)
+{
+    // Waits for whoever holds the claim to publish the block.  Returns
+    // false once the claim is gone or stale, to claim the block again.
+    string filename = claimFilename(block_num);
+    while (true) {
+        if (_writeBehindBytes > 0 && loadBlockFromQueue(dest, block_num)) {
+            return true;
+        }
+        if (access(filename.c_str(), F_OK) != 0) {
+            // released, normally because the block is written.  If not,
+            // the build failed.
+            return loadBlockFromCache(dest, block_num);
+        }
+        if (claimIsStale(filename)) {
+            unlink(filename.c_str());
+            return false;
+        }
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+}
+
+bool block_loader_cpio_cache::claimIsStale(const string& filename)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return false;
+    }
+    if (time(nullptr) - st.st_mtime > _claimTimeout) {
+        return true;
+    }
+
+    string host;
+    pid_t pid = 0;
+    ifstream f(filename);
+    if (!(f >> host >> pid)) {
+        // still being written by its owner
+        return false;
+    }
+    char ours[256] = {0};
+    gethostname(ours, sizeof(ours) - 1);
+    return host == ours && kill(pid, 0) != 0 && errno == ESRCH;
+}
+
+void block_loader_cpio_cache::releaseClaim(uint block_num)
+{
+    unlink(claimFilename(block_num).c_str());
+}
+
+void block_loader_cpio_cache::writeBehind(buffer_in_array& dest, const vector<int>& start,
+                                          uint block_num, bool claimed)
+{
+    // the writer gets shared views of the new items, nothing is copied
+    pending_write p;
+    p.block = make_shared<buffer_in_array>(dest.size());
+    p.bytes = 0;
+    p.claimed = claimed;
+    for (size_t i = 0; i < dest.size(); i++) {
+        for (int j = start[i]; j < dest[i]->get_item_count(); j++) {
+            try {
+                buffer_item& item = dest[i]->get_item(j);
+                item.share();
+                (*p.block)[i]->add_item(item);
+                p.bytes += item.size();
+            } catch (std::exception&) {
+                (*p.block)[i]->add_exception(current_exception());
+            }
+        }
+    }
+
+    unique_lock<mutex> lock(_writeMutex);
+    // a block over the whole budget waits for the queue to drain
+    _writeDone.wait(lock, [&]{
+        return _pendingBytes + p.bytes <= _writeBehindBytes || _pending.empty();
+    });
+    if (_pending.count(block_num) != 0) {
+        // loaded by another reader at the same time
+        if (claimed) {
+            releaseClaim(block_num);
+        }
+        return;
+    }
+    _pending[block_num] = p;
+    _writeOrder.push_back(block_num);
+    _pendingBytes += p.bytes;
+    _writeReady.notify_one();
+}
+
+bool block_loader_cpio_cache::loadBlockFromQueue(buffer_in_array& dest, uint block_num)
+{
+    shared_ptr<buffer_in_array> block;
+    {
+        lock_guard<mutex> lock(_writeMutex);
+        auto it = _pending.find(block_num);
+        if (it == _pending.end()) {
+            return false;
+        }
+        block = it->second.block;
+    }
+
+    for (size_t i = 0; i < dest.size(); i++) {
+        buffer_in& b = *(*block)[i];
+        for (int j = 0; j < b.get_item_count(); j++) {
+            try {
+                dest[i]->add_item(b.get_item(j));
+            } catch (std::exception&) {
+                dest[i]->add_exception(current_exception());
+            }
+        }
+    }
+    return true;
+}
+
+void block_loader_cpio_cache::write()
+{
+    // Thread function.  Pending blocks are still written after a stop.
+    unique_lock<mutex> lock(_writeMutex);
+    while (true) {
+        _writeReady.wait(lock, [this]{ return !_writeOrder.empty() || _stopWriter; });
+        if (_writeOrder.empty()) {
+            return;
+        }
+        uint block_num = _writeOrder.front();
+        _writeOrder.pop_front();
+        pending_write p = _pending[block_num];
 
+        lock.unlock();
         try {
-            writeBlockToCache(dest, block_num);
+            writeBlockToCache(*p.block, 0, block_num);
         } catch (std::exception& e) {
             // failure to write block to cache doesn't stop execution, only print an error
             cerr << "ERROR writing block to cache: " << e.what() << endl;
         }
+        if (p.claimed) {
+            releaseClaim(block_num);
+        }
+        lock.lock();
+
+        _pending.erase(block_num);
+        _pendingBytes -= p.bytes;
+        _writeDone.notify_all();
+    }
+}
+
+void block_loader_cpio_cache::flush()
+{
+    unique_lock<mutex> lock(_writeMutex);
+    _writeDone.wait(lock, [this]{ return _pending.empty(); });
+}
+
+void block_loader_cpio_cache::scanRecords()
+{
+    map<size_t, pair<size_t, string>> records;
+    vector<string> stale;
+    DIR *dir;
+    struct dirent *ent;
+    if((dir = opendir(_cacheDir.c_str())) != NULL) {
+        while((ent = readdir(dir)) != NULL) {
+            size_t first, count;
+            char fp[17] = {0};
+            int length = 0;
+            auto parsed = [&](int n, int expected) {
+                return n == expected && length > 0 && ent->d_name[length] == 0 && count > 0;
+            };
+            if(!parsed(sscanf(ent->d_name, "r%zu-%zu.block%n", &first, &count, &length), 2) &&
+               !parsed(sscanf(ent->d_name, "r%zu-%zu-%16[0-9a-f].block%n", &first, &count, fp, &length), 3)) {
+                continue;
+            }
+            string path = _cacheDir + "/" + ent->d_name;
+            bool verified;
+            {
+                lock_guard<mutex> lock(_recordsMutex);
+                verified = _verified.count(path) > 0;
+            }
+            if(!verified && fingerprint(first, first + count) != fp) {
+                // written from rows or files that have changed since
+                stale.push_back(path);
+                continue;
+            }
+            records[first] = make_pair(count, path);
+        }
+        closedir(dir);
+    }
+
+    for (auto& path : stale) {
+        removeFile(path);
+    }
+
+    // files written by other processes since the last scan
+    vector<string> found;
+    {
+        lock_guard<mutex> lock(_recordsMutex);
+        // files written by other threads while the directory was read are
+        // not in the listing, keep them unless they are gone
+        for (auto& r : _records) {
+            if (records.count(r.first) == 0 && access(r.second.second.c_str(), F_OK) == 0) {
+                records.insert(r);
+            }
+        }
+        for (auto& r : records) {
+            auto known = _records.find(r.first);
+            if (known == _records.end() || known->second.second != r.second.second) {
+                found.push_back(r.second.second);
+            }
+        }
+        _records.swap(records);
+        for (auto& r : _records) {
+            _verified.insert(r.second.second);
+        }
+        _lastScan = chrono::steady_clock::now();
+    }
+
+    // they count against the budget of this process too, or a directory
+    // shared by N processes could grow to N times the budget
+    if (_usage) {
+        for (auto& path : found) {
+            addFile(path);
+        }
+    }
+}
+
+vector<block_loader_cpio_cache::segment> block_loader_cpio_cache::segments(size_t begin, size_t end)
+{
+    // split [begin, end) into runs held by one file and runs not cached
+    vector<segment> result;
+    lock_guard<mutex> lock(_recordsMutex);
+    for (size_t r = begin; r < end; r = result.back().end) {
+        segment s;
+        s.begin = r;
+        auto next = _records.upper_bound(r);
+        if (next != _records.begin() && prev(next)->first + prev(next)->second.first > r) {
+            auto held = prev(next);
+            s.first    = held->first;
+            s.filename = held->second.second;
+            s.end      = min(end, held->first + held->second.first);
+        } else {
+            s.first = r;
+            s.end   = next == _records.end() ? end : min(end, next->first);
+        }
+        result.push_back(s);
+    }
+    return result;
+}
+
+bool block_loader_cpio_cache::loadRecordsFromCache(buffer_in_array& dest, uint block_num)
+{
+    auto range = recordRange(block_num);
+    auto cached = [](const segment& s) { return !s.filename.empty(); };
+    auto segs = segments(range.first, range.second);
+    if (segs.empty()) {
+        return false;
+    }
+    if (!all_of(segs.begin(), segs.end(), cached)) {
+        // other processes may have written the rest
+        if (!probeRecords(segs) && scanDue()) {
+            scanRecords();
+        }
+        segs = segments(range.first, range.second);
+        if (!all_of(segs.begin(), segs.end(), cached)) {
+            return false;
+        }
+    }
+
+    // open every file first so a missing one leaves dest untouched
+    vector<unique_ptr<block_file::reader>> readers;
+    for (auto& seg : segs) {
+        readers.emplace_back(new block_file::reader());
+        if (!readers.back()->open(seg.filename, _mapped) ||
+            readers.back()->elementCount() != (int)dest.size()) {
+            // evicted since the scan
+            scanRecords();
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < segs.size(); i++) {
+        const segment& seg = segs[i];
+        if (seg.begin == seg.first && seg.end - seg.first == (size_t)readers[i]->recordCount()) {
+            readers[i]->read_all(dest);
+        } else {
+            for (size_t r = seg.begin; r < seg.end; r++) {
+                readers[i]->read_record(r - seg.first, dest);
+            }
+        }
+        touch(seg.filename);
     }
+    return true;
+}
+
+bool block_loader_cpio_cache::scanDue()
+{
+    lock_guard<mutex> lock(_recordsMutex);
+    return chrono::steady_clock::now() - _lastScan >= chrono::milliseconds(RESCAN_INTERVAL_MS);
+}
+
+bool block_loader_cpio_cache::probeRecords(const vector<segment>& segs)
+{
+    // True if every segment not cached has the file this process would
+    // write for it, as another process with the same block size would.
+    vector<pair<const segment*, string>> found;
+    for (auto& seg : segs) {
+        if (!seg.filename.empty()) {
+            continue;
+        }
+        string filename = recordFilename(seg.begin, seg.end - seg.begin,
+                                         fingerprint(seg.begin, seg.end));
+        if (access(filename.c_str(), F_OK) != 0) {
+            return false;
+        }
+        found.emplace_back(&seg, filename);
+    }
+
+    {
+        lock_guard<mutex> lock(_recordsMutex);
+        for (auto& f : found) {
+            _records[f.first->begin] = make_pair(f.first->end - f.first->begin, f.second);
+            _verified.insert(f.second);
+        }
+    }
+    if (_usage) {
+        for (auto& f : found) {
+            addFile(f.second);
+        }
+    }
+    return true;
 }
 
 bool block_loader_cpio_cache::loadBlockFromCache(buffer_in_array& dest, uint block_num)
 {
-    // load a block from cpio cache into dest.  If file doesn't exist, return false.
-    //  If loading from cpio cache was successful return true.
-    cpio::file_reader reader;
+    // load a block from cache into dest.  If file doesn't exist, return false.
+    //  If loading from cache was successful return true.
+    if(loadRecordsFromCache(dest, block_num)) {
+        return true;
+    }
+
+    if(!_legacy) {
+        return false;
+    }
+
+    // a block file written per block number by an older version
+    block_file::reader block;
+    if(block.open(blockFilename(block_num), _mapped)) {
+        block.read_all(dest);
+        touch(blockFilename(block_num));
+        return true;
+    }
+
+    // a cpio file left by an older version.  Items are views into the
+    // mapped file, nothing is copied.
+    cpio::mmap_reader reader;
 
-    if(!reader.open(blockFilename(block_num))) {
+    if(!reader.open(cpioFilename(block_num))) {
         // couldn't load the file
         return false;
     }
@@ -80,18 +531,255 @@ bool block_loader_cpio_cache::loadBlockFromCache(buffer_in_array& dest, uint blo
     }
 
     reader.close();
+    touch(cpioFilename(block_num));
 
     // cpio file was read successfully, no need to hit primary data
     // source
     return true;
 }
 
-void block_loader_cpio_cache::writeBlockToCache(buffer_in_array& buff, uint block_num)
+void block_loader_cpio_cache::writeBlockToCache(buffer_in_array& buff, int first_item, uint block_num)
+{
+    // write the records of the block no file holds yet
+    auto range = recordRange(block_num);
+    if (buff.size() == 0) {
+        return;
+    }
+    size_t count = buff[0]->get_item_count() - first_item;
+    if (count != range.second - range.first) {
+        throw runtime_error("block " + to_string(block_num) + " has " + to_string(count) +
+                            " records, expected " + to_string(range.second - range.first));
+    }
+
+    for (auto& seg : segments(range.first, range.second)) {
+        if (!seg.filename.empty()) {
+            continue;
+        }
+        int first = first_item + (seg.begin - range.first);
+        int last  = first_item + (seg.end - range.first);
+        if (_usage) {
+            // room for the uncompressed elements, their padding and the index
+            size_t estimate = sizeof(block_file::header);
+            for (auto b : buff) {
+                for (int i = first; i < last; i++) {
+                    estimate += b->get_item(i).size() + 64 + sizeof(block_file::entry) + sizeof(uint64_t);
+                }
+            }
+            reserve(estimate);
+        }
+
+        string filename = recordFilename(seg.begin, seg.end - seg.begin,
+                                         fingerprint(seg.begin, seg.end));
+        block_file::file_writer writer;
+        writer.open(filename, 64, _codec);
+        for (int i = first; i < last; i++) {
+            writer.write_record(buff, i);
+        }
+        writer.close();
+
+        {
+            lock_guard<mutex> lock(_recordsMutex);
+            _records[seg.begin] = make_pair(seg.end - seg.begin, filename);
+            _verified.insert(filename);
+        }
+        if (_usage) {
+            addFile(filename);
+        }
+    }
+}
+
+void block_loader_cpio_cache::scanCache()
+{
+    // pick up the blocks cached by earlier runs, most recently used first
+    vector<pair<time_t, string>> found;
+    DIR *dir;
+    struct dirent *ent;
+    if((dir = opendir(_cacheDir.c_str())) != NULL) {
+        while((ent = readdir(dir)) != NULL) {
+            string name = ent->d_name;
+            size_t dot = name.rfind('.');
+            if(dot == string::npos || (name.substr(dot) != ".block" && name.substr(dot) != ".cpio")) {
+                continue;
+            }
+            string path = _cacheDir + "/" + name;
+            struct stat st;
+            if(stat(path.c_str(), &st) == 0) {
+                found.emplace_back(st.st_atime, path);
+            }
+        }
+        closedir(dir);
+    }
+    sort(found.begin(), found.end(), [](const pair<time_t, string>& a, const pair<time_t, string>& b) {
+        return a.first > b.first;
+    });
+    for (auto it = found.rbegin(); it != found.rend(); ++it) {
+        addFile(it->second);
+    }
+}
+
+void block_loader_cpio_cache::touch(const string& filename)
+{
+    if (!_usage) {
+        return;
+    }
+    // mark the file used for the next run as well.  An explicit time is
+    // stored even on noatime mounts.
+    struct timespec times[2] = {{0, UTIME_NOW}, {0, UTIME_OMIT}};
+    utimensat(AT_FDCWD, filename.c_str(), times, 0);
+
+    lock_guard<mutex> lock(_usage->mutex);
+    auto it = _usage->files.find(filename);
+    if (it != _usage->files.end()) {
+        _usage->lru.splice(_usage->lru.begin(), _usage->lru, it->second.second);
+    }
+}
+
+void block_loader_cpio_cache::reserve(size_t bytes)
+{
+    lock_guard<mutex> lock(_usage->mutex);
+    evictLocked(bytes);
+}
+
+void block_loader_cpio_cache::addFile(const string& filename)
+{
+    struct stat st;
+    if(stat(filename.c_str(), &st) != 0) {
+        return;
+    }
+    size_t bytes = st.st_size;
+
+    lock_guard<mutex> lock(_usage->mutex);
+    auto it = _usage->files.find(filename);
+    if (it != _usage->files.end()) {
+        // written again, by another reader of the same block
+        _usage->bytes -= it->second.first;
+        _usage->lru.erase(it->second.second);
+        _usage->files.erase(it);
+    }
+    evictLocked(bytes);
+    if (bytes > _maxBytes) {
+        // would not fit even in an empty cache
+        unlink(filename.c_str());
+        forgetRecords(filename);
+        return;
+    }
+    _usage->lru.push_front(filename);
+    _usage->files[filename] = make_pair(bytes, _usage->lru.begin());
+    _usage->bytes += bytes;
+}
+
+void block_loader_cpio_cache::removeFile(const string& filename)
+{
+    unlink(filename.c_str());
+    if (!_usage) {
+        return;
+    }
+    lock_guard<mutex> lock(_usage->mutex);
+    auto it = _usage->files.find(filename);
+    if (it != _usage->files.end()) {
+        _usage->bytes -= it->second.first;
+        _usage->lru.erase(it->second.second);
+        _usage->files.erase(it);
+    }
+}
+
+void block_loader_cpio_cache::evictLocked(size_t bytes)
+{
+    // drop least recently used files until `bytes` more fit the budget
+    while (!_usage->lru.empty() && _usage->bytes + bytes > _maxBytes) {
+        const string& victim = _usage->lru.back();
+        unlink(victim.c_str());
+        forgetRecords(victim);
+        _usage->bytes -= _usage->files[victim].first;
+        _usage->files.erase(victim);
+        _usage->lru.pop_back();
+    }
+}
+
+void block_loader_cpio_cache::forgetRecords(const string& filename)
+{
+    // Drops a removed record file, so its records are built again instead
+    // of being looked for in it.  Called with _usage->mutex held, which is
+    // always taken before _recordsMutex.
+    size_t first, count;
+    if (filename.compare(0, _cacheDir.size() + 1, _cacheDir + "/") != 0 ||
+        sscanf(filename.c_str() + _cacheDir.size() + 1, "r%zu-%zu", &first, &count) != 2) {
+        return;
+    }
+    lock_guard<mutex> lock(_recordsMutex);
+    auto it = _records.find(first);
+    if (it != _records.end() && it->second.second == filename) {
+        _records.erase(it);
+    }
+    _verified.erase(filename);
+}
+
+size_t block_loader_cpio_cache::cacheBytes()
 {
-    cpio::file_writer writer;
-    writer.open(blockFilename(block_num));
-    writer.write_all_records(buff);
-    writer.close();
+    if (!_usage) {
+        return 0;
+    }
+    lock_guard<mutex> lock(_usage->mutex);
+    return _usage->bytes;
+}
+
+void block_loader_cpio_cache::adoptLegacyCache(const string& legacyDir,
+                                               const string& legacy_version)
+{
+    // take over the directory of an older version before it is removed as
+    // invalid, noting which version its blocks were cached for
+    struct stat st;
+    if(stat(legacyDir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) ||
+       access(_cacheDir.c_str(), F_OK) == 0) {
+        return;
+    }
+    {
+        ofstream f(legacyDir + "/" LEGACY_VERSION_FILE, ios::trunc);
+        f << legacy_version;
+        if(!f) {
+            return;
+        }
+    }
+    // another process may have renamed it first
+    rename(legacyDir.c_str(), _cacheDir.c_str());
+}
+
+bool block_loader_cpio_cache::checkLegacyCache(const string& legacy_version)
+{
+    // true if the adopted blocks were cached for `legacy_version`.
+    // Otherwise the dataset changed since and they are removed.
+    string marker = _cacheDir + "/" LEGACY_VERSION_FILE;
+    string cached;
+    {
+        ifstream f(marker);
+        if(!f) {
+            return false;
+        }
+        getline(f, cached);
+    }
+    if(cached == legacy_version) {
+        return true;
+    }
+
+    DIR *dir;
+    struct dirent *ent;
+    if((dir = opendir(_cacheDir.c_str())) != NULL) {
+        while((ent = readdir(dir)) != NULL) {
+            uint block_num, block_size;
+            int length = 0;
+            auto parsed = [&](const char* format) {
+                length = 0;
+                return sscanf(ent->d_name, format, &block_num, &block_size, &length) == 2 &&
+                       length > 0 && ent->d_name[length] == 0;
+            };
+            if(parsed("%u-%u.block%n") || parsed("%u-%u.cpio%n")) {
+                unlink((_cacheDir + "/" + ent->d_name).c_str());
+            }
+        }
+        closedir(dir);
+    }
+    unlink(marker.c_str());
+    return false;
 }
 
 void block_loader_cpio_cache::invalidateOldCache(const string& rootCacheDir,
@@ -177,11 +865,53 @@ void block_loader_cpio_cache::makeDirectory(const string& dir)
 }
 
 string block_loader_cpio_cache::blockFilename(uint block_num)
+{
+     return _cacheDir + "/" + to_string(block_num) + "-" + to_string(_block_size) + ".block";
+}
+
+string block_loader_cpio_cache::recordFilename(size_t first, size_t count, const string& fingerprint)
+{
+     string name = _cacheDir + "/r" + to_string(first) + "-" + to_string(count);
+     if (!fingerprint.empty()) {
+         name += "-" + fingerprint;
+     }
+     return name + ".block";
+}
+
+string block_loader_cpio_cache::claimFilename(uint block_num)
+{
+     auto range = recordRange(block_num);
+     return recordFilename(range.first, range.second - range.first, "") + ".claim";
+}
+
+string block_loader_cpio_cache::cpioFilename(uint block_num)
 {
      return _cacheDir + "/" + to_string(block_num) + "-" + to_string(_block_size) + ".cpio";
 }
 
+bool block_loader_cpio_cache::isCached(uint block_num)
+{
+    auto range = recordRange(block_num);
+    auto segs = segments(range.first, range.second);
+    if (!segs.empty() && all_of(segs.begin(), segs.end(),
+                                [](const segment& s) { return !s.filename.empty(); })) {
+        return true;
+    }
+    return _legacy && (access(blockFilename(block_num).c_str(), F_OK) == 0 ||
+                       access(cpioFilename(block_num).c_str(), F_OK) == 0);
+}
+
 uint block_loader_cpio_cache::objectCount()
 {
     return _loader->objectCount();
 }
+
+pair<size_t, size_t> block_loader_cpio_cache::recordRange(uint block_num)
+{
+    return _loader->recordRange(block_num);
+}
+
+string block_loader_cpio_cache::fingerprint(size_t begin, size_t end)
+{
+    return _loader->fingerprint(begin, end);
+}
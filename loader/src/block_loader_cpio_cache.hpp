@@ -16,8 +16,18 @@
 #pragma once
 
 #include <string>
+#include <list>
+#include <map>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <unordered_map>
+#include <condition_variable>
 
 #include "block_loader_file.hpp"
+#include "compression.hpp"
 
 /* block_loader_cpio_cache
  *
@@ -28,6 +38,60 @@
  * is used to help invalidate old versions of the same dataset.  If a cache is
  * created with the same hash as an existing cache, but a different version,
  * old version is deleted.
+ *
+ * Records are cached in block files, see block_file.hpp, named after the
+ * range of records they hold: r<first>-<count>.block.  A block is put
+ * together from whichever files cover its records, so changing the block
+ * size reuses the cache.  Only the records of a missed block that no file
+ * holds yet are written.  Blocks cached per block number by older versions,
+ * as block or cpio files, are still read.
+ *
+ * A `legacy_version` names the directory older versions cached the same
+ * dataset in, `<hash>_<legacy_version>`, when it differs from `version`.
+ * That directory is renamed to the new one if the new one does not exist
+ * yet, and its blocks are read for as long as the legacy version stays
+ * the same.  Once it changes, or no legacy version is given, they are
+ * removed.
+ *
+ * When the loader fingerprints its records the fingerprint of a file's
+ * records is part of its name: r<first>-<count>-<fingerprint>.block.  A
+ * file whose fingerprint no longer matches, because its rows of the
+ * manifest or its source files changed, is removed when the directory is
+ * scanned and its records are built again.  The rest of the cache stays.
+ *
+ * By default block files are memory mapped and their items point into
+ * the mapping, so a dataset that fits in RAM is served straight from the
+ * page cache.  With `mapped` false a file is read with a single pread
+ * and its items are views of that one allocation.
+ *
+ * With a `codec` other than "none" each element is compressed as it
+ * is written, skipping media that is compressed already.  The decode
+ * threads decompress them, not the read thread.
+ *
+ * With `max_bytes` set the cache directory is kept under that size.
+ * Before a block is written the least recently used block files are
+ * removed to make room.  Use is tracked through the access time of the
+ * files, set explicitly on every read, so it survives restarts and
+ * noatime mounts.
+ *
+ * With `write_behind_bytes` set a missed block is handed back at once and
+ * written by a background thread.  Up to that many bytes of blocks wait
+ * to be written; past it loadBlock waits for the writer.  A block read
+ * again before it is written is served from the queue.  Pending writes
+ * are flushed when the cache is destroyed.
+ *
+ * Several processes may share a cache directory.  Before building a
+ * missed block a process creates `<block>.claim` with O_EXCL, holding its
+ * host and pid, and removes it once the block file is renamed into place.
+ * A process that finds the claim taken waits for the block file instead
+ * of reading the source again.  A claim is taken over when its owner is a
+ * dead process on this host, or when it is older than `claim_timeout`
+ * seconds.
+ *
+ * On a miss a process looks for the files it would have written for the
+ * missing records, in case another process did.  The whole directory is
+ * read again at most once a second, or at once when a file it knows of
+ * has gone, so a cold cache does not cost a scan per block.
  */
 
 namespace nervana {
@@ -38,16 +102,94 @@ class nervana::block_loader_cpio_cache : public block_loader {
 public:
     block_loader_cpio_cache(const std::string& rootCacheDir,
                             const std::string& hash, const std::string& version,
-                            std::shared_ptr<block_loader> loader);
+                            std::shared_ptr<block_loader> loader,
+                            bool mapped = true,
+                            const std::string& codec = "none",
+                            size_t max_bytes = 0,
+                            size_t write_behind_bytes = 0,
+                            const std::string& legacy_version = "",
+                            int claim_timeout = 600);
+    ~block_loader_cpio_cache();
 
     void loadBlock(nervana::buffer_in_array& dest, uint block_num);
     uint objectCount();
+    std::pair<size_t, size_t> recordRange(uint block_num);
+    std::string fingerprint(size_t begin, size_t end);
+
+    // true if every record of `block_num` is in the cache
+    bool isCached(uint block_num);
+
+    // bytes of block files in the cache directory, only tracked with a
+    // `max_bytes` budget
+    size_t cacheBytes();
+
+    // wait until every block handed to the background writer is written
+    void flush();
 
 private:
+    block_loader_cpio_cache();
+    block_loader_cpio_cache(const block_loader_cpio_cache&);
+
+    // block files by least recent use, kept with a `max_bytes` budget
+    class usage {
+    public:
+        std::mutex                      mutex;
+        // most recently used first
+        std::list<std::string>          lru;
+        std::unordered_map<std::string, std::pair<size_t, std::list<std::string>::iterator>> files;
+        size_t                          bytes = 0;
+    };
+
+    void scanCache();
+    void touch(const std::string& filename);
+    void reserve(size_t bytes);
+    void addFile(const std::string& filename);
+    void removeFile(const std::string& filename);
+    void evictLocked(size_t bytes);
+    void forgetRecords(const std::string& filename);
+
+    class pending_write {
+    public:
+        std::shared_ptr<nervana::buffer_in_array>   block;
+        size_t                                      bytes;
+        bool                                        claimed;
+    };
+
+    bool claimBlock(uint block_num, bool& claimed);
+    bool waitForBlock(nervana::buffer_in_array& dest, uint block_num);
+    bool claimIsStale(const std::string& filename);
+    void releaseClaim(uint block_num);
+    std::string claimFilename(uint block_num);
+
+    void writeBehind(nervana::buffer_in_array& dest, const std::vector<int>& start,
+                     uint block_num, bool claimed);
+    bool loadBlockFromQueue(nervana::buffer_in_array& dest, uint block_num);
+    void write();
+
+    // records [begin, end) held by `filename`, whose first record is
+    // `first`.  An empty filename marks records not cached.
+    class segment {
+    public:
+        size_t          begin;
+        size_t          end;
+        size_t          first;
+        std::string     filename;
+    };
+
+    void scanRecords();
+    bool scanDue();
+    bool probeRecords(const std::vector<segment>& segs);
+    std::vector<segment> segments(size_t begin, size_t end);
+    bool loadRecordsFromCache(nervana::buffer_in_array& dest, uint block_num);
+
     bool loadBlockFromCache(nervana::buffer_in_array& dest, uint block_num);
-    void writeBlockToCache(nervana::buffer_in_array& dest, uint block_num);
+    void writeBlockToCache(nervana::buffer_in_array& dest, int first_item, uint block_num);
+    std::string recordFilename(size_t first, size_t count, const std::string& fingerprint);
     std::string blockFilename(uint block_num);
+    std::string cpioFilename(uint block_num);
 
+    void adoptLegacyCache(const std::string& legacyDir, const std::string& legacy_version);
+    bool checkLegacyCache(const std::string& legacy_version);
     void invalidateOldCache(const std::string& rootCacheDir, const std::string& hash, const std::string& version);
     bool filenameHoldsInvalidCache(const std::string& filename, const std::string& hash, const std::string& version);
     void removeDirectory(const std::string& dir);
@@ -55,5 +197,33 @@ private:
     static int rm(const char *path, const struct stat *s, int flag, struct FTW *f);
 
     std::string _cacheDir;
+    // blocks cached per block number are still valid
+    bool _legacy = true;
     std::shared_ptr<block_loader> _loader;
+    bool _mapped;
+    nervana::compression::codec _codec;
+    size_t _maxBytes;
+    std::shared_ptr<usage> _usage;
+
+    // record files by first record: record count and file name.  Files
+    // may have been evicted or added by other processes since the scan.
+    std::mutex _recordsMutex;
+    std::map<size_t, std::pair<size_t, std::string>> _records;
+    // record files whose fingerprint has been checked
+    std::set<std::string> _verified;
+    std::chrono::steady_clock::time_point _lastScan;
+
+    int _claimTimeout;
+    std::string _claimOwner;
+
+    size_t _writeBehindBytes;
+    std::thread _writer;
+    std::mutex _writeMutex;
+    std::condition_variable _writeReady;
+    std::condition_variable _writeDone;
+    // blocks waiting for or being written, and the order to write them in
+    std::map<uint, pending_write> _pending;
+    std::deque<uint> _writeOrder;
+    size_t _pendingBytes = 0;
+    bool _stopWriter = false;
 };
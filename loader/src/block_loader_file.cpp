@@ -18,20 +18,28 @@
 #include <cassert>
 #include <sstream>
 #include <fstream>
+#include <tuple>
 
 #include "block_loader_file.hpp"
+#include "util.hpp"
 
 using namespace std;
 using namespace nervana;
 
 block_loader_file::block_loader_file(shared_ptr<nervana::manifest_csv> mfst,
                                      float subset_fraction,
-                                     uint block_size)
+                                     uint block_size,
+                                     int io_queue_depth,
+                                     bool fingerprint_files)
 : block_loader(block_size),
   _manifest(mfst),
-  _subset_fraction(subset_fraction)
+  _subset_fraction(subset_fraction),
+  _fingerprint_files(fingerprint_files)
 {
     assert(_subset_fraction > 0.0 && _subset_fraction <= 1.0);
+    if (io_queue_depth > 1) {
+        _io = io_engine::create(io_queue_depth);
+    }
 }
 
 void block_loader_file::loadBlock(nervana::buffer_in_array& dest, uint block_num)
@@ -43,17 +51,8 @@ void block_loader_file::loadBlock(nervana::buffer_in_array& dest, uint block_num
 
     // begin_i and end_i contain the indexes into the manifest file which
     // hold the requested block
-    size_t begin_i = block_num * _block_size;
-    size_t end_i = min((block_num + 1) * (size_t)_block_size, _manifest->objectCount());
-
-    if (_subset_fraction != 1.0) {
-        // adjust end_i in relation to begin_i.  We want to scale (end_i
-        // - begin_i) by _subset_fraction.  In the case of a smaller block
-        // than block_size (in the last block), we want _subset_fraction
-        // of them so we need to make sure we first shorten the end_i to
-        // the corrent smaller block size, and then scale that.
-        end_i = begin_i + (((end_i - begin_i) * _subset_fraction));
-    }
+    size_t begin_i, end_i;
+    tie(begin_i, end_i) = recordRange(block_num);
 
     // ensure we stay within bounds of manifest
     assert(begin_i <= _manifest->objectCount());
@@ -70,17 +69,21 @@ void block_loader_file::loadBlock(nervana::buffer_in_array& dest, uint block_num
     auto begin_it = _manifest->begin() + begin_i;
     auto end_it = _manifest->begin() + end_i;
 
+    if (_io != nullptr) {
+        loadFiles(dest, begin_it, end_it);
+        return;
+    }
+
     for(auto it = begin_it; it != end_it; ++it) {
         // load both object and target files into respective buffers
-        //
-        // NOTE: if at some point in the future, loadFile is loading
-        // files from a network like s3 it may make sense to use multiple
-        // threads to make loads faster.  multiple threads would only
-        // slow down reads from a magnetic disk.
         auto file_list = *it;
         for (uint i = 0; i < file_list.size(); i++) {
             try {
-                loadFile(dest[i], file_list[i]);
+                if (manifest_csv::is_inline(file_list[i])) {
+                    dest[i]->add_item(manifest_csv::inline_value(file_list[i]));
+                } else {
+                    loadFile(dest[i], file_list[i]);
+                }
             } catch (std::exception& e) {
                 dest[i]->add_exception(std::current_exception());
             }
@@ -88,6 +91,81 @@ void block_loader_file::loadBlock(nervana::buffer_in_array& dest, uint block_num
     }
 }
 
+pair<size_t, size_t> block_loader_file::recordRange(uint block_num)
+{
+    size_t begin_i = (size_t)block_num * _block_size;
+    size_t end_i = min((block_num + 1) * (size_t)_block_size, _manifest->objectCount());
+
+    if (_subset_fraction != 1.0) {
+        // adjust end_i in relation to begin_i.  We want to scale (end_i
+        // - begin_i) by _subset_fraction.  In the case of a smaller block
+        // than block_size (in the last block), we want _subset_fraction
+        // of them so we need to make sure we first shorten the end_i to
+        // the corrent smaller block size, and then scale that.
+        end_i = begin_i + (((end_i - begin_i) * _subset_fraction));
+    }
+
+    return make_pair(begin_i, end_i);
+}
+
+string block_loader_file::fingerprint(size_t begin, size_t end)
+{
+    return fingerprintRecords(begin, end, _manifest->objectCount(), [this](uint64_t& h, size_t record) {
+        for (const string& filename : _manifest->row(record)) {
+            fnv1a(h, filename.c_str(), filename.size() + 1);
+            if (_fingerprint_files && !manifest_csv::is_inline(filename)) {
+                struct stat stats;
+                int64_t meta[2] = {-1, -1};
+                if (stat(filename.c_str(), &stats) == 0) {
+                    meta[0] = stats.st_size;
+                    meta[1] = mtime_ns(stats);
+                }
+                fnv1a(h, meta, sizeof(meta));
+            }
+        }
+    });
+}
+
+void block_loader_file::loadFiles(nervana::buffer_in_array& dest,
+                                  manifest_csv::iter begin, manifest_csv::iter end)
+{
+    // Every item is added in order first, each file's sized from a stat
+    // and carved from the buffer's arena, then the io_engine reads the
+    // files straight into the items waiting for them.  Inline values are
+    // filled in without a request.
+    vector<io_engine::request> requests;
+    // the buffer and item of each request
+    vector<pair<uint, int>> items;
+    for(auto it = begin; it != end; ++it) {
+        // rows are put together from the manifest's pool on every read
+        manifest_csv::FilenameList row = *it;
+        for (uint i = 0; i < row.size(); i++) {
+            try {
+                if (manifest_csv::is_inline(row[i])) {
+                    dest[i]->add_item(manifest_csv::inline_value(row[i]));
+                    continue;
+                }
+                io_engine::request r;
+                r.filename = row[i];
+                r.size     = getFileSize(row[i]);
+                r.buffer   = dest[i]->alloc_item(r.size);
+                requests.push_back(r);
+                items.emplace_back(i, dest[i]->get_item_count() - 1);
+            } catch (std::exception&) {
+                dest[i]->add_exception(std::current_exception());
+            }
+        }
+    }
+
+    _io->read(requests);
+
+    for (size_t r = 0; r < requests.size(); r++) {
+        if (requests[r].exception) {
+            dest[items[r].first]->set_exception(items[r].second, requests[r].exception);
+        }
+    }
+}
+
 void block_loader_file::loadFile(nervana::buffer_in* buff, const string& filename)
 {
     off_t size = getFileSize(filename);
@@ -109,13 +187,5 @@ off_t block_loader_file::getFileSize(const string& filename)
 
 uint block_loader_file::objectCount()
 {
-    if (_subset_fraction == 1.0) {
-        return _manifest->objectCount();
-    } else {
-        uint full_block_count = int(_manifest->objectCount() / _block_size);
-        uint subset_object_count = full_block_count * int(_block_size * _subset_fraction);
-        uint leftover_object_count = _manifest->objectCount() - full_block_count * _block_size;
-        subset_object_count += (leftover_object_count * _subset_fraction);
-        return subset_object_count;
-    }
+    return subsetObjectCount(_manifest->objectCount(), _subset_fraction);
 }
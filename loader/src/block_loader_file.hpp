@@ -18,11 +18,20 @@
 #include "manifest_csv.hpp"
 #include "buffer_in.hpp"
 #include "block_loader.hpp"
+#include "io_engine.hpp"
 
 /* block_loader_file
  *
  * Loads blocks of files from a Manifest into a BufferPair.
  *
+ * With an `io_queue_depth` above 1 every file of a block is handed to an
+ * io_engine at once instead of being read one after another.  Fields
+ * holding their value inline, see manifest_csv.hpp, are not read at all.
+ *
+ * The fingerprint of a range of records hashes their manifest rows.  With
+ * `fingerprint_files` the size and modification time of every file they
+ * name are hashed as well, so replacing a file in place is noticed too.
+ *
  */
 
 namespace nervana {
@@ -33,15 +42,23 @@ class nervana::block_loader_file : public block_loader {
 public:
     block_loader_file(std::shared_ptr<nervana::manifest_csv> manifest,
                       float subset_fraction,
-                      uint block_size);
+                      uint block_size,
+                      int io_queue_depth = 1,
+                      bool fingerprint_files = false);
 
     void loadBlock(nervana::buffer_in_array& dest, uint block_num);
+    std::pair<size_t, size_t> recordRange(uint block_num);
+    std::string fingerprint(size_t begin, size_t end);
     void loadFile(nervana::buffer_in* buff, const std::string& filename);
     uint objectCount();
 
 private:
     off_t getFileSize(const std::string& filename);
+    void loadFiles(nervana::buffer_in_array& dest,
+                   nervana::manifest_csv::iter begin, nervana::manifest_csv::iter end);
 
     const std::shared_ptr<nervana::manifest_csv> _manifest;
     float _subset_fraction;
+    bool _fingerprint_files;
+    std::shared_ptr<nervana::io_engine> _io;
 };
@@ -0,0 +1,149 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <algorithm>
+
+#include "block_loader_memory_cache.hpp"
+
+using namespace std;
+using namespace nervana;
+
+block_loader_memory_cache::block_loader_memory_cache(shared_ptr<block_loader> loader,
+                                                     size_t byte_budget)
+: block_loader(loader->blockSize()), _loader(loader), _byte_budget(byte_budget)
+{
+}
+
+void block_loader_memory_cache::loadBlock(buffer_in_array& dest, uint block_num)
+{
+    shared_ptr<entry> e;
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto it = _blocks.find(block_num);
+        if (it != _blocks.end()) {
+            e = it->second;
+            _lru.splice(_lru.begin(), _lru, e->lru);
+        }
+    }
+
+    if (e != nullptr) {
+        _hits++;
+        // copies of shared items, the bytes stay where they are
+        for (size_t i = 0; i < dest.size(); i++) {
+            for (auto& item : e->items[i]) {
+                dest[i]->add_item(item);
+            }
+        }
+        return;
+    }
+
+    _misses++;
+    vector<int> start;
+    for (auto d : dest) {
+        start.push_back(d->get_item_count());
+    }
+    _loader->loadBlock(dest, block_num);
+
+    e = make_shared<entry>();
+    e->items.resize(dest.size());
+    try {
+        for (size_t i = 0; i < dest.size(); i++) {
+            for (int j = start[i]; j < dest[i]->get_item_count(); j++) {
+                e->items[i].push_back(dest[i]->get_item(j));
+                e->bytes += e->items[i].back().size();
+            }
+        }
+    } catch (std::exception&) {
+        // a block with a bad item is loaded again next time
+        return;
+    }
+    if (e->bytes > _byte_budget) {
+        return;
+    }
+
+    // The loaded items may be views of arena chunks or mapped files much
+    // larger than the block.  The cached copy is packed into one
+    // allocation of exactly e->bytes, so the budget holds.
+    shared_ptr<char> storage(new char[max<size_t>(e->bytes, 1)], default_delete<char[]>());
+    char* data = storage.get();
+    for (auto& items : e->items) {
+        for (auto& item : items) {
+            size_t size = item.size();
+            item.copy_to(data, storage);
+            data += size;
+        }
+    }
+    insert(block_num, e);
+}
+
+void block_loader_memory_cache::insert(uint block_num, shared_ptr<entry> e)
+{
+    if (e->bytes > _byte_budget) {
+        return;
+    }
+
+    lock_guard<mutex> lock(_mutex);
+    if (_blocks.count(block_num) != 0) {
+        // loaded by another thread at the same time
+        return;
+    }
+    while (_bytes + e->bytes > _byte_budget) {
+        auto last = _blocks.find(_lru.back());
+        _bytes -= last->second->bytes;
+        _blocks.erase(last);
+        _lru.pop_back();
+        _evictions++;
+    }
+    _lru.push_front(block_num);
+    e->lru = _lru.begin();
+    _blocks[block_num] = e;
+    _bytes += e->bytes;
+}
+
+void block_loader_memory_cache::prefetch(const vector<uint>& block_nums)
+{
+    // only the blocks not already in memory are worth reading ahead
+    vector<uint> missing;
+    {
+        lock_guard<mutex> lock(_mutex);
+        for (uint block_num : block_nums) {
+            if (_blocks.count(block_num) == 0) {
+                missing.push_back(block_num);
+            }
+        }
+    }
+    _loader->prefetch(missing);
+}
+
+size_t block_loader_memory_cache::bytes()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _bytes;
+}
+
+uint block_loader_memory_cache::objectCount()
+{
+    return _loader->objectCount();
+}
+
+pair<size_t, size_t> block_loader_memory_cache::recordRange(uint block_num)
+{
+    return _loader->recordRange(block_num);
+}
+
+string block_loader_memory_cache::fingerprint(size_t begin, size_t end)
+{
+    return _loader->fingerprint(begin, end);
+}
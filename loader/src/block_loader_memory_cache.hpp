@@ -0,0 +1,85 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+#include "block_loader.hpp"
+
+/* block_loader_memory_cache
+ *
+ * Keeps the blocks loaded by another block_loader in memory, up to
+ * `byte_budget` bytes of item data.  When a new block does not fit the
+ * least recently used ones are dropped.  A block larger than the whole
+ * budget, or one holding an exception, is not kept.
+ *
+ * A missed block is copied once into a single allocation of its item
+ * bytes, so the budget counts the memory actually kept.  The cached items
+ * are views of it, so a hit hands out the block without copying it.
+ * Compressed items stay compressed.
+ *
+ * loadBlock may be called from several threads at once, as
+ * block_loader_prefetch does.
+ */
+
+namespace nervana {
+    class block_loader_memory_cache;
+}
+
+class nervana::block_loader_memory_cache : public block_loader {
+public:
+    block_loader_memory_cache(std::shared_ptr<block_loader> loader, size_t byte_budget);
+
+    void loadBlock(nervana::buffer_in_array& dest, uint block_num);
+    void prefetch(const std::vector<uint>& block_nums);
+    uint objectCount();
+    std::pair<size_t, size_t> recordRange(uint block_num);
+    std::string fingerprint(size_t begin, size_t end);
+
+    uint64_t hits() const { return _hits; }
+    uint64_t misses() const { return _misses; }
+    uint64_t evictions() const { return _evictions; }
+    size_t   bytes();
+
+private:
+    block_loader_memory_cache();
+    block_loader_memory_cache(const block_loader_memory_cache&);
+
+    class entry {
+    public:
+        // items of each buffer_in, in record order
+        std::vector<std::vector<nervana::buffer_item>>  items;
+        size_t                                          bytes = 0;
+        std::list<uint>::iterator                       lru;
+    };
+
+    void insert(uint block_num, std::shared_ptr<entry> e);
+
+    std::shared_ptr<block_loader>                       _loader;
+    const size_t                                        _byte_budget;
+    std::mutex                                          _mutex;
+    std::unordered_map<uint, std::shared_ptr<entry>>    _blocks;
+    // most recently used first
+    std::list<uint>                                     _lru;
+    size_t                                              _bytes = 0;
+    std::atomic<uint64_t>                               _hits{0};
+    std::atomic<uint64_t>                               _misses{0};
+    std::atomic<uint64_t>                               _evictions{0};
+};
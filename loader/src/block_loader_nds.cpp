@@ -71,22 +71,32 @@ void block_loader_nds::get(const string url, stringstream &stream) {
     // given a url, make an HTTP GET request and fill stream with
     // the body of the response
 
-    curl_easy_setopt(_curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(_curl, CURLOPT_FOLLOWLOCATION, 1L);
+    // a curl handle can only serve one request at a time.  Concurrent
+    // readers that find the shared handle busy use one of their own.
+    unique_lock<mutex> lock(_curlMutex, try_to_lock);
+    void* curl = lock.owns_lock() ? _curl : curl_easy_init();
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
     // Prevent "longjmp causes uninitialized stack frame" bug
-    curl_easy_setopt(_curl, CURLOPT_NOSIGNAL, 1);
-    curl_easy_setopt(_curl, CURLOPT_ACCEPT_ENCODING, "deflate");
-    curl_easy_setopt(_curl, CURLOPT_WRITEFUNCTION, write_data);
-    curl_easy_setopt(_curl, CURLOPT_WRITEDATA, &stream);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "deflate");
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &stream);
 
     // Perform the request, res will get the return code
-    CURLcode res = curl_easy_perform(_curl);
+    CURLcode res = curl_easy_perform(curl);
 
-    // Check for errors
+    long http_code = 0;
     if (res != CURLE_OK) {
-        long http_code = 0;
-        curl_easy_getinfo (_curl, CURLINFO_RESPONSE_CODE, &http_code);
+        curl_easy_getinfo (curl, CURLINFO_RESPONSE_CODE, &http_code);
+    }
+    if (curl != _curl) {
+        curl_easy_cleanup(curl);
+    }
 
+    // Check for errors
+    if (res != CURLE_OK) {
         stringstream ss;
         ss << "HTTP GET on " << url << "failed. ";
         ss << "status code: " << http_code << ". ";
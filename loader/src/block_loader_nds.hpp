@@ -17,6 +17,7 @@
 
 #include <sstream>
 #include <string>
+#include <mutex>
 
 #include "buffer_in.hpp"
 #include "cpio.hpp"
@@ -54,4 +55,5 @@ private:
 
     // reuse connection across requests
     void* _curl;
+    std::mutex _curlMutex;
 };
@@ -0,0 +1,183 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdexcept>
+#include <algorithm>
+
+#include "block_loader_prefetch.hpp"
+
+using namespace std;
+using namespace nervana;
+
+block_loader_prefetch::block_loader_prefetch(shared_ptr<block_loader> loader, int readers,
+                                             const shared_ptr<stage_stats>& stats)
+: block_loader(loader->blockSize()), _loader(loader), _stats(stats)
+{
+    if (readers < 1) {
+        throw invalid_argument("block_loader_prefetch needs at least one reader");
+    }
+    for (int i = 0; i < readers; i++) {
+        _threads.emplace_back(&block_loader_prefetch::read, this);
+    }
+}
+
+block_loader_prefetch::~block_loader_prefetch()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _done = true;
+    }
+    _work.notify_all();
+    for (auto& t : _threads) {
+        t.join();
+    }
+}
+
+void block_loader_prefetch::prefetch(const vector<uint>& block_nums)
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        for (auto& r : _requests) {
+            r.second->wanted = false;
+        }
+
+        _pending.clear();
+        for (uint block_num : block_nums) {
+            auto& r = _requests[block_num];
+            if (r == nullptr) {
+                r = make_shared<request>();
+            }
+            r->wanted = true;
+            if (!r->started) {
+                _pending.push_back(block_num);
+            }
+        }
+
+        // drop blocks that fell out of the window.  Ones still being read
+        // are dropped by their reader when it finishes.
+        for (auto it = _requests.begin(); it != _requests.end(); ) {
+            if (!it->second->wanted && (it->second->ready || !it->second->started)) {
+                it = _requests.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    _work.notify_all();
+}
+
+void block_loader_prefetch::loadBlock(buffer_in_array& dest, uint block_num)
+{
+    shared_ptr<request> r;
+    {
+        unique_lock<mutex> lock(_mutex);
+        if (_nbuffers == 0) {
+            _nbuffers = dest.size();
+            _work.notify_all();
+        }
+
+        auto it = _requests.find(block_num);
+        if (it != _requests.end() && it->second->started) {
+            r = it->second;
+            _requests.erase(it);
+            _ready.wait(lock, [&]{ return r->ready; });
+        } else if (it != _requests.end()) {
+            // nobody has started on it, cheaper to load it here than to wait
+            _requests.erase(it);
+            _pending.erase(find(_pending.begin(), _pending.end(), block_num));
+        }
+    }
+
+    if (r == nullptr) {
+        load(dest, block_num);
+        return;
+    }
+
+    if (r->exception) {
+        rethrow_exception(r->exception);
+    }
+    for (size_t i = 0; i < dest.size(); i++) {
+        dest[i]->append(*(*r->data)[i]);
+    }
+}
+
+void block_loader_prefetch::read()
+{
+    // Thread function.
+    while (true) {
+        uint block_num;
+        shared_ptr<request> r;
+        size_t nbuffers;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _work.wait(lock, [this]{ return (!_pending.empty() && _nbuffers > 0) || _done; });
+            if (_done) {
+                return;
+            }
+            block_num = _pending.front();
+            _pending.pop_front();
+            r = _requests[block_num];
+            r->started = true;
+            nbuffers = _nbuffers;
+        }
+
+        auto data = make_shared<buffer_in_array>(nbuffers);
+        exception_ptr exception;
+        try {
+            load(*data, block_num);
+        } catch (std::exception& e) {
+            exception = current_exception();
+        }
+
+        {
+            lock_guard<mutex> lock(_mutex);
+            r->data      = data;
+            r->exception = exception;
+            r->ready     = true;
+            auto it = _requests.find(block_num);
+            if (!r->wanted && it != _requests.end() && it->second == r) {
+                _requests.erase(it);
+            }
+        }
+        _ready.notify_all();
+    }
+}
+
+void block_loader_prefetch::load(buffer_in_array& dest, uint block_num)
+{
+    stage_timer timer(_stats->busy_ns);
+    try {
+        _loader->loadBlock(dest, block_num);
+    } catch (std::exception&) {
+        _stats->exceptions++;
+        throw;
+    }
+    _stats->items++;
+}
+
+uint block_loader_prefetch::objectCount()
+{
+    return _loader->objectCount();
+}
+
+pair<size_t, size_t> block_loader_prefetch::recordRange(uint block_num)
+{
+    return _loader->recordRange(block_num);
+}
+
+string block_loader_prefetch::fingerprint(size_t begin, size_t end)
+{
+    return _loader->fingerprint(begin, end);
+}
@@ -0,0 +1,88 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <condition_variable>
+
+#include "block_loader.hpp"
+#include "pipeline_stats.hpp"
+
+/* block_loader_prefetch
+ *
+ * Wraps another block_loader and loads the blocks named by prefetch() on
+ * `readers` background threads.  loadBlock still returns blocks in
+ * whatever order it is called in: a block that has been prefetched is
+ * handed over, one that is still loading is waited for, and anything else
+ * is loaded on the calling thread.
+ *
+ * The wrapped loader must allow concurrent loadBlock calls for different
+ * blocks.
+ *
+ * `stats` counts the blocks loaded and the time spent in the wrapped
+ * loader, whichever thread loads them.  Its busy time is summed over all
+ * readers.
+ */
+
+namespace nervana {
+    class block_loader_prefetch;
+}
+
+class nervana::block_loader_prefetch : public block_loader {
+public:
+    block_loader_prefetch(std::shared_ptr<block_loader> loader, int readers,
+                          const std::shared_ptr<nervana::stage_stats>& stats = std::make_shared<nervana::stage_stats>());
+    ~block_loader_prefetch();
+
+    void loadBlock(nervana::buffer_in_array& dest, uint block_num);
+    void prefetch(const std::vector<uint>& block_nums);
+    uint objectCount();
+    std::pair<size_t, size_t> recordRange(uint block_num);
+    std::string fingerprint(size_t begin, size_t end);
+
+private:
+    block_loader_prefetch();
+    block_loader_prefetch(const block_loader_prefetch&);
+
+    class request {
+    public:
+        std::shared_ptr<nervana::buffer_in_array> data;
+        std::exception_ptr                        exception;
+        bool                                      started = false;
+        bool                                      ready   = false;
+        bool                                      wanted  = true;
+    };
+
+    void read();
+    void load(nervana::buffer_in_array& dest, uint block_num);
+
+    std::shared_ptr<block_loader>               _loader;
+    std::shared_ptr<nervana::stage_stats>       _stats;
+    std::vector<std::thread>                    _threads;
+    std::mutex                                  _mutex;
+    std::condition_variable                     _work;
+    std::condition_variable                     _ready;
+    std::map<uint, std::shared_ptr<request>>    _requests;
+    // requested blocks no reader has picked up yet, in hint order
+    std::deque<uint>                            _pending;
+    // buffers per record, learned from the first loadBlock
+    size_t                                      _nbuffers = 0;
+    bool                                        _done     = false;
+};
@@ -16,6 +16,7 @@
 #include <assert.h>
 #include <random>
 #include <algorithm>
+#include <numeric>
 #include <vector>
 #include <thread>
 #include <mutex>
@@ -23,24 +24,100 @@
 #include <fstream>
 
 #include "buffer_in.hpp"
+#include "compression.hpp"
 
 using namespace std;
 using namespace nervana;
 
+vector<char>& buffer_item::bytes() {
+    if (_owner) {
+        clear();
+    }
+    _codec = 0;
+    return _bytes;
+}
+
+void buffer_item::share() {
+    if (_owner) {
+        return;
+    }
+    auto owner = make_shared<vector<char>>(std::move(_bytes));
+    _bytes.clear();
+    _view = owner->data();
+    _view_size = owner->size();
+    _owner = owner;
+}
+
+void buffer_item::copy_to(char* data, const std::shared_ptr<const void>& owner) {
+    size_t count = size();
+    if (count > 0) {
+        memcpy(data, this->data(), count);
+    }
+    _bytes.clear();
+    _view = data;
+    _view_size = count;
+    _owner = owner;
+}
+
+void buffer_item::clear() {
+    _bytes.clear();
+    _view = nullptr;
+    _view_size = 0;
+    _owner = nullptr;
+    _codec = 0;
+}
+
+void buffer_item::set_compressed(uint32_t codec, size_t raw_size) {
+    _codec = codec;
+    _raw_size = raw_size;
+}
+
+void buffer_item::decompress() {
+    if (_codec == 0) {
+        return;
+    }
+    vector<char> raw(_raw_size);
+    compression::decompress((compression::codec)_codec, data(), size(), raw.data(), raw.size());
+    clear();
+    _bytes.swap(raw);
+}
+
+bool buffer_item::operator==(const buffer_item& other) const {
+    return size() == other.size() && std::equal(begin(), end(), other.begin());
+}
+
+// smallest arena chunk, and the alignment of items within it
+static const size_t arena_chunk = 64 * 1024;
+static const size_t arena_align = 16;
+
 void buffer_in::reset() {
     buffers.clear();
+    exceptions.clear();
+    _order.clear();
+
+    // items handed out keep their chunks alive
+    _arena = nullptr;
+    _arena_size = 0;
+    _arena_used = 0;
+    _arena_next = _arena_total + _arena_total / 8;
+    _arena_total = 0;
 }
 
 void buffer_in::shuffle(uint seed) {
     // TODO: instead of reseeding the shuffle, store these in a pair
     std::minstd_rand0 rand_items(seed);
-    std::shuffle(buffers.begin(), buffers.end(), rand_items);
+    if (_order.empty()) {
+        _order.resize(buffers.size());
+        std::iota(_order.begin(), _order.end(), 0);
+    }
+    std::shuffle(_order.begin(), _order.end(), rand_items);
 }
 
-vector<char>& buffer_in::get_item(int index) {
+buffer_item& buffer_in::get_item(int index) {
     if (index >= (int) buffers.size()) {
         throw invalid_argument("index out-of-range");
     }
+    index = physical(index);
 
     auto it = exceptions.find(index);
     if (it != exceptions.end()) {
@@ -50,17 +127,123 @@ vector<char>& buffer_in::get_item(int index) {
     return buffers[index];
 }
 
-void buffer_in::add_item(const std::vector<char>& buf) {
-    buffers.push_back(buf);
+void buffer_in::add_item(buffer_item item) {
+    if (!_order.empty()) {
+        _order.push_back(buffers.size());
+    }
+    buffers.push_back(std::move(item));
+}
+
+char* buffer_in::alloc_item(size_t size) {
+    size_t offset = (_arena_used + arena_align - 1) & ~(arena_align - 1);
+    if (!_arena || offset + size > _arena_size) {
+        // a block like the last one fits the first chunk, and chunks
+        // double after that
+        size_t chunk = max(size, max(_arena_next, arena_chunk));
+        _arena = shared_ptr<char>(new char[chunk], default_delete<char[]>());
+        _arena_size = chunk;
+        _arena_next = chunk * 2;
+        offset = 0;
+    }
+    _arena_used = offset + size;
+    _arena_total += (size + arena_align - 1) & ~(arena_align - 1);
+
+    char* data = _arena.get() + offset;
+    add_item(buffer_item(data, size, _arena));
+    return data;
 }
 
 void buffer_in::add_exception(std::exception_ptr e) {
     // add an axception to exceptions
     exceptions[buffers.size()] = e;
 
-    // also add an empty vector to buffers to that indicies line up
-    std::vector<char> empty;
-    buffers.push_back(empty);
+    // also add an empty item to buffers to that indicies line up
+    add_item(buffer_item());
+}
+
+void buffer_in::set_exception(int index, std::exception_ptr e) {
+    if (index >= (int) buffers.size()) {
+        throw invalid_argument("index out-of-range");
+    }
+    index = physical(index);
+    exceptions[index] = e;
+    buffers[index].clear();
+}
+
+void buffer_in::decompress(int index) {
+    if (index >= (int) buffers.size()) {
+        return;
+    }
+    index = physical(index);
+    if (exceptions.count(index) == 0) {
+        buffers[index].decompress();
+    }
+}
+
+void buffer_in::append(buffer_in& other) {
+    if (buffers.empty() && exceptions.empty()) {
+        buffers.swap(other.buffers);
+        exceptions.swap(other.exceptions);
+        _order.swap(other._order);
+        other.reset();
+        return;
+    }
+
+    // take the items of `other` in its order
+    for (int i = 0; i < (int) other.buffers.size(); i++) {
+        int index = other.physical(i);
+        auto it = other.exceptions.find(index);
+        if (it != other.exceptions.end()) {
+            exceptions[buffers.size()] = it->second;
+        }
+        add_item(std::move(other.buffers[index]));
+    }
+    other.reset();
+}
+
+void buffer_in::move_item(int index, buffer_in& dest) {
+    if (index >= (int) buffers.size()) {
+        throw invalid_argument("index out-of-range");
+    }
+    apply_order();
+
+    auto it = exceptions.find(index);
+    if (it != exceptions.end()) {
+        dest.add_exception(it->second);
+        exceptions.erase(it);
+    } else {
+        dest.add_item(std::move(buffers[index]));
+    }
+
+    int last = buffers.size() - 1;
+    if (index != last) {
+        buffers[index] = std::move(buffers[last]);
+        auto l = exceptions.find(last);
+        if (l != exceptions.end()) {
+            exceptions[index] = l->second;
+            exceptions.erase(l);
+        }
+    }
+    buffers.pop_back();
+}
+
+void buffer_in::apply_order() {
+    if (_order.empty()) {
+        return;
+    }
+    vector<buffer_item> ordered;
+    map<int, exception_ptr> moved;
+    ordered.reserve(buffers.size());
+    for (size_t i = 0; i < _order.size(); i++) {
+        auto it = exceptions.find(_order[i]);
+        if (it != exceptions.end()) {
+            moved[i] = it->second;
+        }
+        ordered.push_back(std::move(buffers[_order[i]]));
+    }
+    buffers.swap(ordered);
+    exceptions.swap(moved);
+    _order.clear();
 }
 
 int buffer_in::get_item_count() {
@@ -69,7 +252,9 @@ int buffer_in::get_item_count() {
 
 void buffer_in::read(istream& is, int size) {
     // read `size` bytes out of `ifs` and push into buffer
-    vector<char> b(size);
-    is.read(b.data(), size);
-    buffers.push_back(b);
+    char* data = alloc_item(size);
+    is.read(data, size);
+    if (is.gcount() < size) {
+        memset(data + is.gcount(), 0, size - is.gcount());
+    }
 }
@@ -23,12 +23,77 @@
 #include <cstring>
 #include <iostream>
 #include <map>
+#include <memory>
 
 namespace nervana {
+    class buffer_item;
     class buffer_in;
     class buffer_in_array;
 }
 
+/* buffer_item
+ *
+ * One element of a record.  It either owns its bytes or points into memory
+ * kept alive by `owner`, such as a block cache file mapped by
+ * cpio::mmap_reader.  Moving a view around never copies the data.
+ */
+class nervana::buffer_item {
+public:
+    buffer_item() {}
+    buffer_item(const std::vector<char>& bytes) : _bytes(bytes) {}
+    buffer_item(std::vector<char>&& bytes) : _bytes(std::move(bytes)) {}
+    buffer_item(const char* data, size_t size, const std::shared_ptr<const void>& owner)
+    : _view(data), _view_size(size), _owner(owner) {}
+
+    const char* data() const { return _owner ? _view : _bytes.data(); }
+    size_t size() const { return _owner ? _view_size : _bytes.size(); }
+    bool empty() const { return size() == 0; }
+    const char* begin() const { return data(); }
+    const char* end() const { return data() + size(); }
+    const char& operator[](size_t index) const { return data()[index]; }
+    bool is_view() const { return _owner != nullptr; }
+
+    // Marks the bytes as compressed with `codec`, see compression.hpp.
+    // decompress() restores the `raw_size` original bytes; the decode
+    // threads call it before a provider sees the item.
+    void set_compressed(uint32_t codec, size_t raw_size);
+    bool is_compressed() const { return _codec != 0; }
+    void decompress();
+
+    // owned storage to fill the item in place.  Turns a view into an
+    // empty owned item.
+    std::vector<char>& bytes();
+    // moves owned bytes to shared storage and makes the item a view of
+    // them, so copies of it share the bytes.  A view is left alone.
+    void share();
+    // copies the bytes to `data` and makes the item a view of them there,
+    // kept alive by `owner`
+    void copy_to(char* data, const std::shared_ptr<const void>& owner);
+    void clear();
+
+    bool operator==(const buffer_item& other) const;
+    bool operator!=(const buffer_item& other) const { return !(*this == other); }
+
+private:
+    std::vector<char>           _bytes;
+    const char*                 _view = nullptr;
+    size_t                      _view_size = 0;
+    std::shared_ptr<const void> _owner;
+    uint32_t                    _codec = 0;
+    size_t                      _raw_size = 0;
+};
+
+/* buffer_in
+ *
+ * The items of one element of a block.  Bytes read into the buffer are
+ * carved out of a shared arena, a few large chunks per block, and the
+ * items are views of them.  Records cost no allocation of their own and
+ * move on to a minibatch without being copied.  After a reset the next
+ * block starts with one chunk as large as the last block needed.
+ *
+ * shuffle() permutes an index over the items instead of the items.
+ * Indexes passed to the buffer are in shuffled order.
+ */
 class nervana::buffer_in {
 public:
     buffer_in() {}
@@ -36,9 +101,20 @@ public:
 
     void read(std::istream& is, int size);
     void reset();
-    std::vector<char>& get_item(int index);
-    void add_item(const std::vector<char>&);
+    nervana::buffer_item& get_item(int index);
+    void add_item(nervana::buffer_item);
+    // add an item of `size` bytes from the arena and return them to fill
+    char* alloc_item(size_t size);
     void add_exception(std::exception_ptr);
+    // replace the item at `index` with an exception
+    void set_exception(int index, std::exception_ptr);
+    // decompress the item at `index` if it is compressed and not an exception
+    void decompress(int index);
+    // move every item (and exception) of `other` to the end of this buffer
+    void append(buffer_in& other);
+    // move item `index`, or its exception, to the end of `dest`.  The last
+    // item takes its place, so the order of the rest changes.
+    void move_item(int index, buffer_in& dest);
 
     void shuffle(uint seed);
 
@@ -46,8 +122,23 @@ public:
     uint size();
 
 private:
-    std::vector<std::vector<char>> buffers;
+    // position in `buffers` of item `index`
+    int physical(int index) const { return _order.empty() ? index : _order[index]; }
+    // put the items in shuffled order and drop the index
+    void apply_order();
+
+    std::vector<nervana::buffer_item> buffers;
+    // keyed by position in `buffers`, so they follow a shuffle
     std::map<int, std::exception_ptr> exceptions;
+    // items in shuffled order, empty before a shuffle
+    std::vector<uint32_t> _order;
+
+    std::shared_ptr<char>   _arena;
+    size_t                  _arena_size = 0;
+    size_t                  _arena_used = 0;
+    // bytes allocated since the last reset, and the size of the next chunk
+    size_t                  _arena_total = 0;
+    size_t                  _arena_next = 0;
 };
 
 // buffer_in_array holds a vector of buffer_in*.  Each buffer_in* holds one component
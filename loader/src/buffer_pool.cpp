@@ -13,26 +13,127 @@
  limitations under the License.
 */
 
+#include <assert.h>
+#include <stdexcept>
+
 #include "buffer_pool.hpp"
 
+using namespace std;
 using namespace nervana;
 
-buffer_pool::buffer_pool() {
-    _exceptions.push_back(nullptr);
-    _exceptions.push_back(nullptr);
+buffer_pool::buffer_pool(int count)
+: _count(count)
+{
+    if (_count <= 0) {
+        throw invalid_argument("buffer_pool depth must be > 0");
+    }
+    _exceptions.resize(_count, nullptr);
 }
 
 void buffer_pool::write_exception(std::exception_ptr exception_ptr) {
+    lock_guard<mutex> lock(_mutex);
+    assert(_writeClaimed > 0);
     _exceptions[_writePos] = exception_ptr;
 }
 
-void buffer_pool::clear_exception() {
-    _exceptions[_writePos] = nullptr;
+void buffer_pool::reraise_exception(int index) {
+    if(auto e = _exceptions[index]) {
+        std::rethrow_exception(e);
+    }
+}
+
+bool buffer_pool::wait_for_not_empty()
+{
+    unique_lock<mutex> lock(_mutex);
+    _nonEmpty.wait(lock, [this]{ return _used > _readClaimed || _shutdown; });
+    return !_shutdown;
 }
 
-void buffer_pool::reraise_exception() {
-    if(auto e = _exceptions[_readPos]) {
-        clear_exception();
-        std::rethrow_exception(e);
+bool buffer_pool::wait_for_not_full()
+{
+    unique_lock<mutex> lock(_mutex);
+    _nonFull.wait(lock, [this]{ return _used + _writeClaimed < _count || _shutdown; });
+    return !_shutdown;
+}
+
+int buffer_pool::claim_for_write()
+{
+    unique_lock<mutex> lock(_mutex);
+    _nonFull.wait(lock, [this]{ return _used + _writeClaimed < _count || _shutdown; });
+    if (_shutdown) {
+        throw runtime_error("buffer_pool has been shut down");
+    }
+    return (_writePos + _writeClaimed++) % _count;
+}
+
+int buffer_pool::claim_for_read()
+{
+    unique_lock<mutex> lock(_mutex);
+    _nonEmpty.wait(lock, [this]{ return _used > _readClaimed || _shutdown; });
+    if (_shutdown) {
+        throw runtime_error("buffer_pool has been shut down");
+    }
+    return (_readPos + _readClaimed++) % _count;
+}
+
+void buffer_pool::advance_read_pos()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        assert(_readClaimed > 0);
+        // the slot goes back to the producer clean
+        _exceptions[_readPos] = nullptr;
+        advance(_readPos);
+        _readClaimed--;
+        _used--;
+    }
+    _nonFull.notify_all();
+}
+
+void buffer_pool::advance_write_pos()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        assert(_writeClaimed > 0);
+        advance(_writePos);
+        _writeClaimed--;
+        _used++;
+    }
+    _nonEmpty.notify_all();
+}
+
+bool buffer_pool::empty()
+{
+    lock_guard<mutex> lock(_mutex);
+    return (_used == 0);
+}
+
+bool buffer_pool::full()
+{
+    lock_guard<mutex> lock(_mutex);
+    return (_used == _count);
+}
+
+int buffer_pool::used()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _used;
+}
+
+void buffer_pool::shutdown()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _shutdown = true;
+    }
+    _nonFull.notify_all();
+    _nonEmpty.notify_all();
+}
+
+void buffer_pool::advance(int& index)
+{
+    // increment index and reset to 0 when index hits `_count`
+    if (++index == _count) {
+        index = 0;
     }
 }
@@ -16,24 +16,71 @@
 #pragma once
 
 #include <vector>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
 
 namespace nervana {
     class buffer_pool;
 }
 
-/* Base class buffer_pool only deals in exception handling for now */
+/* buffer_pool
+ *
+ * Base class for a fixed depth ring of buffers passed from a producer stage
+ * to a consumer stage.  get_for_write() claims the next free slot and
+ * get_for_read() claims the next filled one.  A claimed slot belongs to the
+ * claiming stage until advance_write_pos() publishes it or
+ * advance_read_pos() releases it, so nobody holds the pool mutex while a
+ * slot is being filled or drained.  The mutex only guards the ring indices.
+ *
+ * A stage may hold several claimed slots at once (e.g. to work on more than
+ * one minibatch concurrently).  Slots are always published and released in
+ * the order they were claimed.
+ *
+ * Exceptions raised while filling a slot travel with that slot and are
+ * rethrown when the slot is claimed for reading.
+ */
 
 class nervana::buffer_pool {
 protected:
-    buffer_pool();
+    buffer_pool(int count);
 public:
+    virtual ~buffer_pool() {}
+
+    // applies to the oldest slot claimed for writing
     void write_exception(std::exception_ptr exception_ptr);
-    void reraise_exception();
+
+    // block until a slot can be claimed.  returns false if the pool was
+    // shut down while waiting
+    bool wait_for_not_empty();
+    bool wait_for_not_full();
+
+    void advance_read_pos();
+    void advance_write_pos();
+    bool empty();
+    bool full();
+    // filled slots, including ones claimed for reading
+    int  used();
+    int  count() const { return _count; }
+
+    // wake up any blocked producer or consumer and make further waits fail
+    void shutdown();
 
 protected:
-    void clear_exception();
+    int claim_for_write();
+    int claim_for_read();
+    void reraise_exception(int index);
+    void advance(int& index);
 
+    const int                       _count;
     std::vector<std::exception_ptr> _exceptions;
     int                             _readPos = 0;
     int                             _writePos = 0;
+    int                             _readClaimed = 0;
+    int                             _writeClaimed = 0;
+    int                             _used = 0;
+    bool                            _shutdown = false;
+    std::mutex                      _mutex;
+    std::condition_variable         _nonFull;
+    std::condition_variable         _nonEmpty;
 };
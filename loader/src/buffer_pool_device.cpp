@@ -0,0 +1,38 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "buffer_pool_device.hpp"
+
+using namespace std;
+using namespace nervana;
+
+buffer_pool_device::buffer_pool_device(int count)
+: buffer_pool(count)
+{
+}
+
+buffer_pool_device::~buffer_pool_device() {}
+
+int buffer_pool_device::get_for_write()
+{
+    return claim_for_write();
+}
+
+int buffer_pool_device::get_for_read()
+{
+    int index = claim_for_read();
+    reraise_exception(index);
+    return index;
+}
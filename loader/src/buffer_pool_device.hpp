@@ -0,0 +1,36 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include "buffer_pool.hpp"
+
+namespace nervana {
+    class buffer_pool_device;
+}
+
+/* buffer_pool_device
+ *
+ * Ring of the python backend's device buffers.  A slot holds no memory of
+ * its own, only its index, which is the buf_index handed to the backend.
+ * The backends double buffer, so the default depth is 2.
+ */
+class nervana::buffer_pool_device : public nervana::buffer_pool {
+public:
+    buffer_pool_device(int count = 2);
+    virtual ~buffer_pool_device();
+    int get_for_write();
+    int get_for_read();
+};
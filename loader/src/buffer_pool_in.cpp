@@ -21,9 +21,6 @@
 #include <random>
 #include <algorithm>
 #include <vector>
-#include <thread>
-#include <mutex>
-#include <condition_variable>
 #include <fstream>
 
 #include "buffer_pool_in.hpp"
@@ -31,20 +28,19 @@
 using namespace std;
 using namespace nervana;
 
-buffer_pool_in::buffer_pool_in(unsigned int nbuffers_in)
-: buffer_pool()
+buffer_pool_in::buffer_pool_in(unsigned int nbuffers_in, int count)
+: buffer_pool(count)
 {
     for (int i = 0; i < _count; i++) {
         _bufs.push_back(make_shared<buffer_in_array>(nbuffers_in));
     }
-
 }
 
 buffer_pool_in::~buffer_pool_in() {}
 
 buffer_in_array& buffer_pool_in::get_for_write()
 {
-    buffer_in_array& buf_ary = *_bufs[_writePos];
+    buffer_in_array& buf_ary = *_bufs[claim_for_write()];
     for (auto &b : buf_ary) {
         b->reset();
     }
@@ -53,65 +49,7 @@ buffer_in_array& buffer_pool_in::get_for_write()
 
 buffer_in_array& buffer_pool_in::get_for_read()
 {
-    reraise_exception();
-    return *_bufs[_readPos];
+    int index = claim_for_read();
+    reraise_exception(index);
+    return *_bufs[index];
 }
-
-void buffer_pool_in::advance_read_pos()
-{
-    _used--;
-    advance(_readPos);
-}
-
-void buffer_pool_in::advance_write_pos()
-{
-    _used++;
-    advance(_writePos);
-    clear_exception();
-}
-
-bool buffer_pool_in::empty()
-{
-    assert(_used >= 0);
-    return (_used == 0);
-}
-
-bool buffer_pool_in::full()
-{
-    assert(_used <= _count);
-    return (_used == _count);
-}
-
-std::mutex& buffer_pool_in::get_mutex()
-{
-    return _mutex;
-}
-
-void buffer_pool_in::wait_for_not_empty(std::unique_lock<std::mutex>& lock)
-{
-    _nonEmpty.wait(lock);
-}
-
-void buffer_pool_in::wait_for_non_full(std::unique_lock<std::mutex>& lock)
-{
-    _nonFull.wait(lock);
-}
-
-void buffer_pool_in::signal_not_empty()
-{
-    _nonEmpty.notify_all();
-}
-
-void buffer_pool_in::signal_not_full()
-{
-    _nonFull.notify_all();
-}
-
-void buffer_pool_in::advance(int& index)
-{
-    // increment index and reset to 0 when index hits `_count`
-    if (++index == _count) {
-        index = 0;
-    }
-}
-
@@ -16,8 +16,7 @@
 #pragma once
 
 #include <vector>
-#include <mutex>
-#include <condition_variable>
+#include <memory>
 #include <cstring>
 
 #include "buffer_pool.hpp"
@@ -29,29 +28,11 @@ namespace nervana {
 
 class nervana::buffer_pool_in : public nervana::buffer_pool {
 public:
-    buffer_pool_in(unsigned int nbuffers_in);
+    buffer_pool_in(unsigned int nbuffers_in, int count = 2);
     virtual ~buffer_pool_in();
     buffer_in_array& get_for_write();
     buffer_in_array& get_for_read();
 
-    void advance_read_pos();
-    void advance_write_pos();
-    bool empty();
-    bool full();
-    std::mutex& get_mutex();
-    void wait_for_not_empty(std::unique_lock<std::mutex>& lock);
-    void wait_for_non_full(std::unique_lock<std::mutex>& lock);
-    void signal_not_empty();
-    void signal_not_full();
-
-protected:
-    void advance(int& index);
-
 protected:
-    static constexpr int        _count = 2;
-    int                         _used = 0;
     std::vector<std::shared_ptr<buffer_in_array>> _bufs;
-    std::mutex                  _mutex;
-    std::condition_variable     _nonFull;
-    std::condition_variable     _nonEmpty;
 };
@@ -21,9 +21,6 @@
 #include <random>
 #include <algorithm>
 #include <vector>
-#include <thread>
-#include <mutex>
-#include <condition_variable>
 #include <fstream>
 
 #include "buffer_pool_out.hpp"
@@ -32,13 +29,12 @@ using namespace std;
 using namespace nervana;
 
 buffer_pool_out::buffer_pool_out(const std::vector<size_t>& writeSizes,
-                                 size_t batchSize, bool pinned)
-: buffer_pool()
+                                 size_t batchSize, bool pinned, int count)
+: buffer_pool(count)
 {
     for (int i = 0; i < _count; i++) {
         _bufs.push_back(make_shared<buffer_out_array>(writeSizes, batchSize, pinned));
     }
-
 }
 
 buffer_pool_out::~buffer_pool_out()
@@ -46,69 +42,12 @@ buffer_pool_out::~buffer_pool_out()
 
 buffer_out_array& buffer_pool_out::get_for_write()
 {
-    return *_bufs[_writePos];
+    return *_bufs[claim_for_write()];
 }
 
 buffer_out_array& buffer_pool_out::get_for_read()
 {
-    return *_bufs[_readPos];
+    int index = claim_for_read();
+    reraise_exception(index);
+    return *_bufs[index];
 }
-
-void buffer_pool_out::advance_read_pos()
-{
-    _used--;
-    advance(_readPos);
-}
-
-void buffer_pool_out::advance_write_pos()
-{
-    _used++;
-    advance(_writePos);
-    clear_exception();
-}
-
-bool buffer_pool_out::empty()
-{
-    assert(_used >= 0);
-    return (_used == 0);
-}
-
-bool buffer_pool_out::full()
-{
-    assert(_used <= _count);
-    return (_used == _count);
-}
-
-std::mutex& buffer_pool_out::get_mutex()
-{
-    return _mutex;
-}
-
-void buffer_pool_out::wait_for_not_empty(std::unique_lock<std::mutex>& lock)
-{
-    _nonEmpty.wait(lock);
-}
-
-void buffer_pool_out::wait_for_non_full(std::unique_lock<std::mutex>& lock)
-{
-    _nonFull.wait(lock);
-}
-
-void buffer_pool_out::signal_not_empty()
-{
-    _nonEmpty.notify_all();
-}
-
-void buffer_pool_out::signal_not_full()
-{
-    _nonFull.notify_all();
-}
-
-void buffer_pool_out::advance(int& index)
-{
-    // increment index and reset to 0 when index hits `_count`
-    if (++index == _count) {
-        index = 0;
-    }
-}
-
@@ -0,0 +1,146 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <thread>
+#include <vector>
+#include <stdexcept>
+
+#include "cache_builder.hpp"
+#include "loader.hpp"
+#include "provider_factory.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static shared_ptr<block_loader_cpio_cache> make_cache(const nlohmann::json& js)
+{
+    loader_config lcfg(js);
+    if (lcfg.cache_directory.empty()) {
+        throw invalid_argument("cache_directory is needed to build a cache");
+    }
+    return dynamic_pointer_cast<block_loader_cpio_cache>(loader::make_block_loader(lcfg));
+}
+
+cache_builder::cache_builder(const string& config, int threads)
+: cache_builder(make_cache(nlohmann::json::parse(config)),
+                provider_factory::create(nlohmann::json::parse(config))->num_inputs,
+                threads)
+{
+}
+
+cache_builder::cache_builder(shared_ptr<block_loader_cpio_cache> cache, size_t nbuffers, int threads)
+: _cache(cache), _nbuffers(nbuffers), _threads(threads), _blocks(cache->blockCount())
+{
+    if (_threads <= 0) {
+        _threads = thread::hardware_concurrency();
+    }
+}
+
+void cache_builder::build(function<void(const nlohmann::json&)> report, double interval)
+{
+    _start = chrono::steady_clock::now();
+    _running = _threads;
+    vector<thread> workers;
+    for (int i = 0; i < _threads; i++) {
+        workers.emplace_back(&cache_builder::work, this);
+    }
+
+    {
+        unique_lock<mutex> lock(_mutex);
+        auto period = chrono::duration<double>(interval);
+        while (!_finished.wait_for(lock, period, [this]{ return _running == 0; })) {
+            if (report) {
+                report(progress());
+            }
+        }
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+    // blocks handed to a write-behind queue are not on disk yet
+    _cache->flush();
+    for (uint block_num : _unwritten) {
+        if (_cache->isCached(block_num)) {
+            _done++;
+        } else {
+            _failed++;
+        }
+    }
+    _unwritten.clear();
+
+    if (report) {
+        report(progress());
+    }
+    if (_exception) {
+        rethrow_exception(_exception);
+    }
+}
+
+void cache_builder::work()
+{
+    // Thread function.
+    try {
+        for (uint block_num = _next++; block_num < _blocks; block_num = _next++) {
+            if (_cache->isCached(block_num)) {
+                _skipped++;
+                continue;
+            }
+            buffer_in_array dest(_nbuffers);
+            _cache->loadBlock(dest, block_num);
+            for (auto d : dest) {
+                for (int i = 0; i < d->get_item_count(); i++) {
+                    try {
+                        _bytes += d->get_item(i).size();
+                    } catch (std::exception&) {
+                        // records that failed to load add no bytes
+                    }
+                }
+            }
+            if (_cache->isCached(block_num)) {
+                _done++;
+            } else {
+                lock_guard<mutex> lock(_mutex);
+                _unwritten.push_back(block_num);
+            }
+        }
+    } catch (std::exception&) {
+        // stop the other workers at their next block
+        _next = _blocks;
+        lock_guard<mutex> lock(_mutex);
+        if (!_exception) {
+            _exception = current_exception();
+        }
+    }
+
+    lock_guard<mutex> lock(_mutex);
+    if (--_running == 0) {
+        _finished.notify_all();
+    }
+}
+
+nlohmann::json cache_builder::progress() const
+{
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - _start).count();
+    nlohmann::json js;
+    js["blocks"]         = _blocks;
+    js["blocks_done"]    = _done.load();
+    js["blocks_skipped"] = _skipped.load();
+    js["blocks_failed"]  = _failed.load();
+    js["bytes"]          = _bytes.load();
+    js["elapsed_sec"]    = elapsed;
+    js["blocks_per_sec"] = elapsed > 0 ? _done / elapsed : 0;
+    js["mb_per_sec"]     = elapsed > 0 ? _bytes / elapsed / (1 << 20) : 0;
+    return js;
+}
@@ -0,0 +1,81 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include "json.hpp"
+#include "block_loader_cpio_cache.hpp"
+
+/* cache_builder
+ *
+ * Fills the disk cache of a dataset ahead of training, so the first
+ * epoch does not wait on the source.  `threads` workers claim blocks from
+ * a shared cursor and load each one through block_loader_cpio_cache,
+ * which writes it out.  Blocks already in the cache are skipped.  A block
+ * still missing from the cache once every write has finished counts as
+ * failed; the cache only logs why.
+ *
+ * The config is the one given to the loader and must set
+ * cache_directory.  build() calls `report` every `interval` seconds from
+ * the calling thread, and once more at the end.
+ */
+
+namespace nervana {
+    class cache_builder;
+}
+
+class nervana::cache_builder {
+public:
+    cache_builder(const std::string& config, int threads);
+    cache_builder(std::shared_ptr<block_loader_cpio_cache> cache, size_t nbuffers, int threads);
+
+    void build(std::function<void(const nlohmann::json&)> report = nullptr, double interval = 1.0);
+
+    // blocks done, skipped and failed out of the total, bytes loaded and
+    // the rate
+    nlohmann::json progress() const;
+
+private:
+    cache_builder();
+    cache_builder(const cache_builder&);
+
+    void work();
+
+    std::shared_ptr<block_loader_cpio_cache>    _cache;
+    size_t                                      _nbuffers;
+    int                                         _threads;
+    uint                                        _blocks;
+    std::atomic<uint>                           _next{0};
+    std::atomic<uint>                           _done{0};
+    std::atomic<uint>                           _skipped{0};
+    std::atomic<uint>                           _failed{0};
+    std::atomic<uint64_t>                       _bytes{0};
+    std::chrono::steady_clock::time_point       _start;
+
+    std::mutex                                  _mutex;
+    std::condition_variable                     _finished;
+    int                                         _running = 0;
+    // blocks loaded whose write had not finished when they were loaded
+    std::vector<uint>                           _unwritten;
+    std::exception_ptr                          _exception;
+};
@@ -0,0 +1,156 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <string.h>
+#include <limits.h>
+
+#include <stdexcept>
+
+#ifdef HAS_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAS_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compression.hpp"
+
+using namespace std;
+using namespace nervana;
+
+// below this an element does not gain enough to pay for decompressing it
+static const size_t min_compress_size = 64;
+
+compression::codec compression::parse(const string& name)
+{
+    if (name == "none" || name == "") {
+        return none;
+    } else if (name == "lz4") {
+#ifdef HAS_LZ4
+        return lz4;
+#else
+        throw invalid_argument("lz4 compression is not available in this build");
+#endif
+    } else if (name == "zstd") {
+#ifdef HAS_ZSTD
+        return zstd;
+#else
+        throw invalid_argument("zstd compression is not available in this build");
+#endif
+    }
+    throw invalid_argument("unknown compression " + name);
+}
+
+const char* compression::name(codec c)
+{
+    switch (c) {
+        case none: return "none";
+        case lz4:  return "lz4";
+        case zstd: return "zstd";
+    }
+    return "unknown";
+}
+
+bool compression::compress(codec c, const char* data, size_t size, vector<char>& out)
+{
+    if (c == none || !worth_compressing(data, size)) {
+        return false;
+    }
+
+    vector<char> buffer;
+    size_t result = 0;
+    switch (c) {
+#ifdef HAS_LZ4
+    case lz4:
+        if (size > LZ4_MAX_INPUT_SIZE) {
+            return false;
+        }
+        buffer.resize(LZ4_compressBound(size));
+        result = LZ4_compress_default(data, buffer.data(), size, buffer.size());
+        break;
+#endif
+#ifdef HAS_ZSTD
+    case zstd:
+        buffer.resize(ZSTD_compressBound(size));
+        result = ZSTD_compress(buffer.data(), buffer.size(), data, size, ZSTD_CLEVEL_DEFAULT);
+        if (ZSTD_isError(result)) {
+            return false;
+        }
+        break;
+#endif
+    default:
+        throw invalid_argument(string("compression not available: ") + name(c));
+    }
+
+    // keep the original unless it saves at least an eighth
+    if (result == 0 || result > size - size / 8) {
+        return false;
+    }
+    buffer.resize(result);
+    out.swap(buffer);
+    return true;
+}
+
+void compression::decompress(codec c, const char* data, size_t size, char* out, size_t raw_size)
+{
+    switch (c) {
+#ifdef HAS_LZ4
+    case lz4:
+        if (size > INT_MAX || raw_size > INT_MAX ||
+            LZ4_decompress_safe(data, out, size, raw_size) != (int)raw_size) {
+            throw runtime_error("corrupt lz4 element");
+        }
+        return;
+#endif
+#ifdef HAS_ZSTD
+    case zstd:
+        if (ZSTD_decompress(out, raw_size, data, size) != raw_size) {
+            throw runtime_error("corrupt zstd element");
+        }
+        return;
+#endif
+    default:
+        throw runtime_error(string("compression not available: ") + name(c));
+    }
+}
+
+bool compression::worth_compressing(const char* data, size_t size)
+{
+    if (size < min_compress_size) {
+        return false;
+    }
+
+    auto starts_with = [&](size_t offset, const char* magic, size_t length) {
+        return size >= offset + length && memcmp(data + offset, magic, length) == 0;
+    };
+
+    // RIFF holds both compressed (AVI, WebP) and raw (WAV) media
+    if (starts_with(0, "RIFF", 4)) {
+        return starts_with(8, "WAVE", 4);
+    }
+    return !(starts_with(0, "\xFF\xD8\xFF", 3) ||          // JPEG
+             starts_with(0, "\x89PNG", 4) ||               // PNG
+             starts_with(0, "GIF8", 4) ||                  // GIF
+             starts_with(4, "ftyp", 4) ||                  // MP4, MOV
+             starts_with(0, "\x1A\x45\xDF\xA3", 4) ||      // Matroska, WebM
+             starts_with(0, "ID3", 3) ||                   // MP3
+             starts_with(0, "\xFF\xFB", 2) ||              // MP3 frame
+             starts_with(0, "fLaC", 4) ||                  // FLAC
+             starts_with(0, "OggS", 4) ||                  // Ogg
+             starts_with(0, "\x1F\x8B", 2) ||              // gzip
+             starts_with(0, "PK\x03\x04", 4) ||            // zip
+             starts_with(0, "\x28\xB5\x2F\xFD", 4) ||      // zstd
+             starts_with(0, "\x04\x22\x4D\x18", 4));       // lz4 frame
+}
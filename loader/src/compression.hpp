@@ -0,0 +1,56 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace nervana {
+    class compression;
+}
+
+/* compression
+ *
+ * Codecs for cached record elements.  LZ4 and zstd are only available
+ * when the build found them (HAS_LZ4, HAS_ZSTD), asking for a missing one
+ * is an error.
+ *
+ * Elements that are already compressed media (JPEG, PNG, MP4, ...) or too
+ * small to gain anything are stored as they are.
+ */
+class nervana::compression {
+public:
+    enum codec : uint32_t {
+        none = 0,
+        lz4  = 1,
+        zstd = 2,
+    };
+
+    // "none", "lz4" or "zstd"
+    static codec parse(const std::string& name);
+    static const char* name(codec c);
+
+    // Compress `data` into `out`.  Returns false, leaving `out` alone, if
+    // the element is better stored as is.
+    static bool compress(codec c, const char* data, size_t size, std::vector<char>& out);
+    // `out` must hold the `raw_size` bytes the element had before compress()
+    static void decompress(codec c, const char* data, size_t size, char* out, size_t raw_size);
+
+    // false for formats that do not shrink any further
+    static bool worth_compressing(const char* data, size_t size);
+};
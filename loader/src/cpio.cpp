@@ -13,6 +13,12 @@
  limitations under the License.
 */
 
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
 #include "cpio.hpp"
 
 using namespace std;
@@ -213,6 +219,107 @@ void cpio::file_reader::close() {
     }
 }
 
+cpio::mmap_reader::mmap_reader() {
+}
+
+cpio::mmap_reader::~mmap_reader() {
+    close();
+}
+
+bool cpio::mmap_reader::open(const string& fileName) {
+    // returns true if file was opened successfully.
+    assert(_map == nullptr);
+
+    int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat stats;
+    if(fstat(fd, &stats) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    _fileName = fileName;
+    _size     = stats.st_size;
+    _offset   = 0;
+    if(_size > 0) {
+        void* base = mmap(0, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(base == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("error mapping " + fileName + ": " + strerror(errno));
+        }
+        // the whole block is about to be decoded
+        madvise(base, _size, MADV_WILLNEED);
+        size_t size = _size;
+        _map = shared_ptr<const char>((const char*)base, [size](const char* p) {
+            munmap((void*)p, size);
+        });
+    }
+    ::close(fd);
+
+    uint fileSize;
+    const char* data = readRecord(&fileSize);
+    if(fileSize != sizeof(_header)) {
+        stringstream ss;
+        ss << "unexpected header size.  expected " << sizeof(_header);
+        ss << " found " << fileSize;
+        throw std::runtime_error(ss.str());
+    }
+    memcpy(&_header, data, sizeof(_header));
+    if (strncmp(_header._magic, MAGIC_STRING, 4) != 0) {
+        throw std::runtime_error("Unrecognized format\n");
+    }
+
+    return true;
+}
+
+void cpio::mmap_reader::close() {
+    // records already handed out keep the mapping alive
+    _map = nullptr;
+    _size = 0;
+    _offset = 0;
+}
+
+void cpio::mmap_reader::read(nervana::buffer_in& dest) {
+    uint datumSize;
+    const char* data = readRecord(&datumSize);
+    dest.add_item(buffer_item(data, datumSize, _map));
+}
+
+int cpio::mmap_reader::itemCount() {
+    return _header._itemCount;
+}
+
+const char* cpio::mmap_reader::take(size_t size) {
+    // advance past `size` bytes of the mapping and return where they start
+    if(size > _size - _offset) {
+        throw std::runtime_error("unexpected end of file in " + _fileName);
+    }
+    const char* p = _map.get() + _offset;
+    _offset += size;
+    return p;
+}
+
+const char* cpio::mmap_reader::readRecord(uint* fileSize) {
+    // same layout as record_header::read: 13 shorts, the name and the data,
+    // each of the last two padded to an even length
+    record_header h;
+    const char* p = take(26);
+    memcpy(&h._magic, p, 2);
+    memcpy(&h._namesize, p + 20, 2);
+    memcpy(h._filesize, p + 22, 4);
+    if(h._magic != 070707) {
+        throw std::runtime_error("corrupt record in " + _fileName);
+    }
+    h.loadDoubleShort(fileSize, h._filesize);
+    take(h._namesize + h._namesize % 2);
+
+    const char* data = take(*fileSize);
+    take(*fileSize % 2);
+    return data;
+}
+
 cpio::file_writer::~file_writer()
 {
     close();
@@ -271,7 +378,7 @@ void cpio::file_writer::write_record(nervana::buffer_in_array& buff, int record_
     uint element_idx = 0;
     for (auto b : buff)
     {
-        const vector<char>& record_element = b->get_item(record_idx);
+        const buffer_item& record_element = b->get_item(record_idx);
         write_record_element(record_element.data(), record_element.size(), element_idx++);
     }
     increment_record_count();
@@ -41,6 +41,7 @@ namespace nervana {
         class trailer;
         class reader;
         class file_reader;
+        class mmap_reader;
         class file_writer;
     }
 }
@@ -92,6 +93,7 @@ public:
 
 class nervana::cpio::header {
 friend class reader;
+friend class mmap_reader;
 friend class file_writer;
 public:
     header();
@@ -155,6 +157,35 @@ private:
     std::ifstream               _ifs;
 };
 
+/*
+ * mmap_reader maps a whole cpio file and adds its records to buffer_in as
+ * views into the mapping rather than copies.  The mapping outlives the
+ * reader for as long as any buffer_in still holds one of its records, so
+ * the page cache is the only copy of a cached block.
+ */
+
+class nervana::cpio::mmap_reader {
+public:
+    mmap_reader();
+    ~mmap_reader();
+
+    bool open(const std::string& fileName);
+    void close();
+
+    void read(nervana::buffer_in& dest);
+    int itemCount();
+
+private:
+    const char* take(size_t size);
+    const char* readRecord(uint32_t* fileSize);
+
+    std::shared_ptr<const char> _map;
+    size_t                      _size   = 0;
+    size_t                      _offset = 0;
+    std::string                 _fileName;
+    header                      _header;
+};
+
 class nervana::cpio::file_writer {
 public:
     ~file_writer();
@@ -0,0 +1,444 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#include "io_engine.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace {
+
+// Fallback engine: `queue_depth` threads doing blocking reads, one whole
+// file at a time.
+class io_engine_threads : public io_engine {
+public:
+    io_engine_threads(int queue_depth) : io_engine(queue_depth) {}
+
+    void read(vector<request>& requests) override;
+    const char* name() const override { return "threads"; }
+
+private:
+    void read_file(request& r);
+};
+
+void io_engine_threads::read(vector<request>& requests)
+{
+    atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i = next++; i < requests.size(); i = next++) {
+            read_file(requests[i]);
+        }
+    };
+
+    size_t nthreads = min((size_t)_queue_depth, requests.size());
+    vector<thread> threads;
+    for (size_t i = 1; i < nthreads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+void io_engine_threads::read_file(request& r)
+{
+    int fd = open(r);
+    if (fd < 0) {
+        return;
+    }
+
+    size_t offset = 0;
+    while (offset < length(r)) {
+        ssize_t count = pread(fd, target(r) + offset, length(r) - offset, offset);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            string reason = count < 0 ? strerror(errno) : "unexpected end of file";
+            r.exception = make_exception_ptr(runtime_error("error reading file: \"" + r.filename + "\" " + reason));
+            break;
+        }
+        offset += count;
+    }
+    close(fd);
+}
+
+#ifdef HAVE_IO_URING
+
+// io_uring engine.  Files are opened as slots free up, and reads are
+// submitted and reaped in batches with a single system call.  The rings
+// are set up by hand since liburing is not a dependency.
+//
+// A ring serves one batch at a time, so threads reading at once each take
+// a ring of their own from a pool, and a ring is added when none is idle.
+class io_engine_uring : public io_engine {
+public:
+    io_engine_uring(int queue_depth);
+
+    void read(vector<request>& requests) override;
+    const char* name() const override { return "io_uring"; }
+
+private:
+    class slot {
+    public:
+        size_t  index;
+        int     fd;
+        size_t  offset;
+        iovec   iov;
+    };
+
+    class ring {
+    public:
+        ring(int queue_depth);
+        ~ring();
+
+        void read(vector<request>& requests);
+
+    private:
+        void queue_read(unsigned id, slot& s, request& r);
+        unsigned enter(unsigned to_submit, unsigned submitted);
+        void drain(vector<slot>& slots, const vector<unsigned>& free_slots, unsigned submitted);
+        void release();
+
+        const int       _queue_depth;
+        int             _fd = -1;
+        unsigned        _entries;
+        void*           _sq_ptr = MAP_FAILED;
+        size_t          _sq_len;
+        void*           _cq_ptr = MAP_FAILED;
+        size_t          _cq_len;
+        io_uring_sqe*   _sqes = (io_uring_sqe*)MAP_FAILED;
+        size_t          _sqes_len;
+
+        unsigned*       _sq_tail;
+        unsigned*       _sq_mask;
+        unsigned*       _sq_array;
+        unsigned*       _cq_head;
+        unsigned*       _cq_tail;
+        unsigned*       _cq_mask;
+        io_uring_cqe*   _cqes;
+    };
+
+    // rings not serving a batch
+    mutex                       _mutex;
+    vector<unique_ptr<ring>>    _idle;
+};
+
+io_engine_uring::io_engine_uring(int queue_depth)
+: io_engine(queue_depth)
+{
+    // throws here if the kernel has no io_uring, so create() falls back
+    _idle.emplace_back(new ring(queue_depth));
+}
+
+void io_engine_uring::read(vector<request>& requests)
+{
+    unique_ptr<ring> r;
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (!_idle.empty()) {
+            r = move(_idle.back());
+            _idle.pop_back();
+        }
+    }
+    if (!r) {
+        try {
+            r.reset(new ring(_queue_depth));
+        } catch (std::exception&) {
+            // e.g. out of locked memory for another ring
+            io_engine_threads(_queue_depth).read(requests);
+            return;
+        }
+    }
+
+    // a ring whose batch failed is dropped
+    r->read(requests);
+
+    lock_guard<mutex> lock(_mutex);
+    _idle.push_back(move(r));
+}
+
+io_engine_uring::ring::ring(int queue_depth)
+: _queue_depth(queue_depth)
+{
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    _fd = syscall(__NR_io_uring_setup, queue_depth, &p);
+    if (_fd < 0) {
+        throw runtime_error(string("io_uring_setup failed: ") + strerror(errno));
+    }
+    _entries = p.sq_entries;
+
+    _sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    _cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        _sq_len = _cq_len = max(_sq_len, _cq_len);
+    }
+    _sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+
+    _sq_ptr = mmap(0, _sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        _cq_ptr = _sq_ptr;
+    } else if (_sq_ptr != MAP_FAILED) {
+        _cq_ptr = mmap(0, _cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+    }
+    _sqes = (io_uring_sqe*)mmap(0, _sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (_sq_ptr == MAP_FAILED || _cq_ptr == MAP_FAILED || _sqes == MAP_FAILED) {
+        release();
+        throw runtime_error("io_uring mmap failed");
+    }
+
+    char* sq = (char*)_sq_ptr;
+    char* cq = (char*)_cq_ptr;
+    _sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+    _sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+    _sq_array = (unsigned*)(sq + p.sq_off.array);
+    _cq_head  = (unsigned*)(cq + p.cq_off.head);
+    _cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+    _cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+    _cqes     = (io_uring_cqe*)(cq + p.cq_off.cqes);
+}
+
+io_engine_uring::ring::~ring()
+{
+    release();
+}
+
+void io_engine_uring::ring::release()
+{
+    // unmap whatever got mapped
+    if (_sqes != MAP_FAILED) {
+        munmap(_sqes, _sqes_len);
+        _sqes = (io_uring_sqe*)MAP_FAILED;
+    }
+    if (_cq_ptr != MAP_FAILED && _cq_ptr != _sq_ptr) {
+        munmap(_cq_ptr, _cq_len);
+    }
+    _cq_ptr = MAP_FAILED;
+    if (_sq_ptr != MAP_FAILED) {
+        munmap(_sq_ptr, _sq_len);
+        _sq_ptr = MAP_FAILED;
+    }
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+void io_engine_uring::ring::queue_read(unsigned id, slot& s, request& r)
+{
+    s.iov.iov_base = target(r) + s.offset;
+    s.iov.iov_len  = length(r) - s.offset;
+
+    unsigned tail  = *_sq_tail;
+    unsigned index = tail & *_sq_mask;
+    io_uring_sqe* sqe = &_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = IORING_OP_READV;
+    sqe->fd        = s.fd;
+    sqe->off       = s.offset;
+    sqe->addr      = (unsigned long)&s.iov;
+    sqe->len       = 1;
+    sqe->user_data = id;
+    _sq_array[index] = index;
+    __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+unsigned io_engine_uring::ring::enter(unsigned to_submit, unsigned submitted)
+{
+    // Submits up to `to_submit` queued reads and waits for a completion.
+    // Returns how many reads the kernel took, the rest stay queued.  An
+    // error means it took none.
+    while (true) {
+        int count = syscall(__NR_io_uring_enter, _fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (count >= 0) {
+            return count;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EBUSY) {
+            throw runtime_error(string("io_uring_enter failed: ") + strerror(errno));
+        }
+        // out of resources, or the completion queue is full: wait for the
+        // reads already submitted and reap them before submitting more
+        if (submitted == 0) {
+            this_thread::yield();
+        } else {
+            to_submit = 0;
+        }
+    }
+}
+
+void io_engine_uring::ring::drain(vector<slot>& slots, const vector<unsigned>& free_slots, unsigned submitted)
+{
+    // after a failure, wait for the reads the kernel still holds so none
+    // lands in freed memory, then close every file
+    unsigned head = *_cq_head;
+    while (submitted > 0) {
+        if (head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+            if (syscall(__NR_io_uring_enter, _fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+                errno != EINTR) {
+                // nothing more can be reaped, closing the ring cancels the rest
+                break;
+            }
+            continue;
+        }
+        head++;
+        submitted--;
+    }
+    __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+
+    vector<bool> idle(slots.size(), false);
+    for (unsigned id : free_slots) {
+        idle[id] = true;
+    }
+    for (unsigned id = 0; id < slots.size(); id++) {
+        if (!idle[id]) {
+            close(slots[id].fd);
+        }
+    }
+}
+
+void io_engine_uring::ring::read(vector<request>& requests)
+{
+    unsigned depth = min((unsigned)_queue_depth, _entries);
+    vector<slot> slots(depth);
+    vector<unsigned> free_slots(depth);
+    iota(free_slots.begin(), free_slots.end(), 0);
+
+    size_t   next      = 0;
+    unsigned in_flight = 0;
+    // reads queued but not taken by the kernel yet
+    unsigned to_submit = 0;
+    try {
+        while (next < requests.size() || in_flight > 0) {
+            while (!free_slots.empty() && next < requests.size()) {
+                request& r = requests[next];
+                int fd = open(r);
+                if (fd >= 0 && length(r) == 0) {
+                    close(fd);
+                } else if (fd >= 0) {
+                    unsigned id = free_slots.back();
+                    free_slots.pop_back();
+                    slots[id].index  = next;
+                    slots[id].fd     = fd;
+                    slots[id].offset = 0;
+                    queue_read(id, slots[id], r);
+                    to_submit++;
+                    in_flight++;
+                }
+                next++;
+            }
+            if (in_flight == 0) {
+                continue;
+            }
+
+            to_submit -= enter(to_submit, in_flight - to_submit);
+
+            unsigned head = *_cq_head;
+            while (head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) {
+                io_uring_cqe* cqe = &_cqes[head & *_cq_mask];
+                unsigned id = cqe->user_data;
+                int result  = cqe->res;
+                head++;
+
+                slot& s    = slots[id];
+                request& r = requests[s.index];
+                if (result > 0) {
+                    s.offset += result;
+                    if (s.offset < length(r)) {
+                        // short read, ask for the rest
+                        queue_read(id, s, r);
+                        to_submit++;
+                        continue;
+                    }
+                } else {
+                    string reason = result < 0 ? strerror(-result) : "unexpected end of file";
+                    r.exception = make_exception_ptr(runtime_error("error reading file: \"" + r.filename + "\" " + reason));
+                }
+                close(s.fd);
+                free_slots.push_back(id);
+                in_flight--;
+            }
+            __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+        }
+    } catch (std::exception&) {
+        drain(slots, free_slots, in_flight - to_submit);
+        throw;
+    }
+}
+
+#endif // HAVE_IO_URING
+
+}
+
+shared_ptr<io_engine> io_engine::create(int queue_depth)
+{
+    if (queue_depth < 1) {
+        throw invalid_argument("io_engine queue_depth must be at least 1");
+    }
+#ifdef HAVE_IO_URING
+    try {
+        return make_shared<io_engine_uring>(queue_depth);
+    } catch (std::exception& e) {
+        // e.g. an old kernel or io_uring disabled by seccomp
+    }
+#endif
+    return make_shared<io_engine_threads>(queue_depth);
+}
+
+int io_engine::open(request& r)
+{
+    int fd = ::open(r.filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0 && r.buffer != nullptr) {
+        return fd;
+    }
+    struct stat stats;
+    if (fd < 0 || fstat(fd, &stats) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        r.exception = make_exception_ptr(runtime_error("Could not find file: \"" + r.filename + "\""));
+        return -1;
+    }
+    r.data->resize(stats.st_size);
+    return fd;
+}
@@ -0,0 +1,70 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <exception>
+
+namespace nervana {
+    class io_engine;
+}
+
+/* io_engine
+ *
+ * Reads a batch of whole files, keeping up to `queue_depth` of them in
+ * flight at once.  io_uring is used when the kernel supports it, otherwise
+ * a pool of threads issuing blocking reads.
+ *
+ * Each file is read straight into the vector its request points at, which
+ * is resized to the file size.  A request whose size is known already can
+ * point at a `buffer` of `size` bytes instead; the file is then not even
+ * stat'd.  A file that cannot be read leaves its exception in the request;
+ * the batch carries on regardless.
+ *
+ * Several threads may call read at once, each with its own batch.
+ */
+class nervana::io_engine {
+public:
+    class request {
+    public:
+        std::string         filename;
+        std::vector<char>*  data = nullptr;
+        // read `size` bytes here instead of into `data`
+        char*               buffer = nullptr;
+        size_t              size = 0;
+        std::exception_ptr  exception;
+    };
+
+    static std::shared_ptr<io_engine> create(int queue_depth);
+    virtual ~io_engine() {}
+
+    virtual void read(std::vector<request>& requests) = 0;
+    virtual const char* name() const = 0;
+
+protected:
+    io_engine(int queue_depth) : _queue_depth(queue_depth) {}
+
+    // open `r.filename` and size `r.data` to fit it.  Returns the file
+    // descriptor or -1 after storing the error in `r`.
+    static int open(request& r);
+    // where the bytes of `r` go, and how many
+    static char* target(request& r) { return r.buffer ? r.buffer : r.data->data(); }
+    static size_t length(const request& r) { return r.buffer ? r.size : r.data->size(); }
+
+    const int _queue_depth;
+};
@@ -24,35 +24,31 @@
 
 #include "loader.hpp"
 #include "block_loader_cpio_cache.hpp"
+#include "block_loader_prefetch.hpp"
 #include "block_iterator_sequential.hpp"
 #include "block_iterator_shuffled.hpp"
+#include "block_iterator_mixed.hpp"
 #include "batch_iterator.hpp"
 #include "manifest_nds.hpp"
 #include "block_loader_nds.hpp"
+#include "manifest_bin.hpp"
+#include "block_loader_bin.hpp"
 
 using namespace std;
 using namespace nervana;
 
-decode_thread_pool::decode_thread_pool(int count,
+decode_thread_pool::decode_thread_pool(int count, int batchSize,
                                        const shared_ptr<buffer_pool_in>& in,
                                        const shared_ptr<buffer_pool_out>& out,
-                                       const shared_ptr<python_backend>& pbe)
-: thread_pool(count), _in(in), _out(out),
-  _python_backend(pbe), _batchSize(_python_backend->_batchSize)
+                                       const shared_ptr<stage_stats>& stats)
+: thread_pool(count), _in(in), _out(out), _stats(stats), _batchSize(batchSize)
 {
-    _itemsPerThread = (_batchSize - 1) / _count + 1;
-    assert(_itemsPerThread * count >= _batchSize);
-    assert(_itemsPerThread * (count - 1) < _batchSize);
 }
 
 
 void decode_thread_pool::add_provider(std::shared_ptr<nervana::provider_interface> prov)
 {
     _providers.push_back(prov);
-    _startSignaled.push_back(0);
-
-    _startInds.push_back(0);
-    _endInds.push_back(0);
 }
 
 decode_thread_pool::~decode_thread_pool()
@@ -61,6 +57,8 @@ decode_thread_pool::~decode_thread_pool()
         _manager->join();
         delete _manager;
     }
+    // workers may still be publishing their last minibatch
+    join();
     // Other thread objects are freed in the destructor of the parent class.
 }
 
@@ -74,37 +72,22 @@ void decode_thread_pool::start()
 
 void decode_thread_pool::stop()
 {
-    thread_pool::stop();
-    while (stopped() == false) {
-        std::this_thread::yield();
-        _in->advance_write_pos();
-        _in->signal_not_empty();
-    }
-
-    _stopManager = true;
-    while (_managerStopped == false) {
-        std::this_thread::yield();
-        _in->advance_write_pos();
-        _in->signal_not_empty();
-        _endSignaled++;
-        _ended.notify_one();
+    {
+        lock_guard<mutex> lock(_mutex);
+        thread_pool::stop();
+        _stopManager = true;
     }
+    // wake the manager if it is blocked on either pool and the workers if
+    // they are waiting for a minibatch.  Threads are joined on destruction.
+    _in->shutdown();
+    _out->shutdown();
+    _started.notify_all();
 }
 
 void decode_thread_pool::run(int id)
 {
-    // Initialize worker threads by computing memory offsets for the
-    // data this thread should work on
     try {
         assert(id < _count);
-        _startInds[id] = id * _itemsPerThread;
-        int itemCount = _itemsPerThread;
-        if (id == _count - 1) {
-            itemCount = _batchSize - id * _itemsPerThread;
-        }
-
-        _endInds[id] = _startInds[id] + itemCount;
-
         while (_done == false) {
             work(id);
         }
@@ -116,91 +99,129 @@ void decode_thread_pool::run(int id)
     }
 }
 
+shared_ptr<decode_thread_pool::batch> decode_thread_pool::next_batch()
+{
+    // caller holds _mutex
+    for (auto& b : _inflight) {
+        if (b->next_item < _batchSize) {
+            return b;
+        }
+    }
+    return nullptr;
+}
+
 void decode_thread_pool::work(int id)
 {
     // Thread function.
+    shared_ptr<batch> b;
     {
         unique_lock<mutex> lock(_mutex);
-        while (_startSignaled[id] == 0) {
-            _started.wait(lock);
-            if (_done == true) {
-                return;
-            }
+        _started.wait(lock, [&]{ return (b = next_batch()) != nullptr || _done; });
+        if (b == nullptr) {
+            return;
         }
-        _startSignaled[id]--;
-        assert(_startSignaled[id] == 0);
     }
 
-    // No locking required because threads write into non-overlapping regions.
-    try {
-        for (int i = _startInds[id]; i < _endInds[id]; i++) {
-            _providers[id]->provide(i, *_inputBuf, _out->get_for_write());
+    // Claim items until the minibatch is exhausted.  No locking required
+    // because every item index is handed to exactly one thread.
+    for (int i = b->next_item++; i < _batchSize; i = b->next_item++) {
+        try {
+            stage_timer timer(_stats->busy_ns);
+            // compressed cache blocks are expanded here, spread over the
+            // workers rather than on the read thread
+            for (auto in : *b->in) {
+                in->decompress(i);
+            }
+            _providers[id]->provide(i, *b->in, *b->out);
+        } catch (std::exception& e) {
+            _stats->exceptions++;
+            lock_guard<mutex> lock(_mutex);
+            b->exception = std::current_exception();
+        }
+        _stats->items++;
+        if (++b->done == _batchSize) {
+            publish(id);
         }
-    } catch (std::exception& e) {
-        _out->write_exception(std::current_exception());
-    }
-
-    {
-        lock_guard<mutex> lock(_mutex);
-        _endSignaled++;
-        assert(_endSignaled <= _count);
     }
-    _ended.notify_one();
 }
 
-void decode_thread_pool::produce()
+void decode_thread_pool::publish(int id)
 {
-    // lock on output buffers and copy to device
-    {
-        unique_lock<mutex> lock(_out->get_mutex());
-        while (_out->full() == true) {
-            _out->wait_for_non_full(lock);
-        }
+    // Hand every finished minibatch at the head of the queue to the consumer.
+    // A minibatch that finishes early waits here for the ones before it.
+    // id is -1 when called by the manager, which has no provider and so
+    // leaves successful minibatches to the worker that finished them.
+    lock_guard<mutex> order(_publishMutex);
+    while (true) {
+        shared_ptr<batch> b;
         {
             lock_guard<mutex> lock(_mutex);
-            for (unsigned int i = 0; i < _startSignaled.size(); i++) {
-                _startSignaled[i] = 1;
+            if (_inflight.empty() || _inflight.front()->done < _batchSize) {
+                break;
             }
-        }
-        _started.notify_all();
-        {
-            unique_lock<mutex> lock(_mutex);
-            while (_endSignaled < _count) {
-                _ended.wait(lock);
+            b = _inflight.front();
+            if (b->exception == nullptr && id < 0) {
+                break;
             }
-            _endSignaled = 0;
+            _inflight.pop_front();
         }
-        // At this point, we have decoded data for the whole minibatch.
-        buffer_out_array& outBuf = _out->get_for_write();
-
-        // Do any messy cross datum stuff you may need to do that requires minibatch consistency
-        _providers[0]->post_process(outBuf);
 
-        // Copy to device.
-        _python_backend->call_backend_transfer(outBuf, _bufferIndex);
+        if (b->exception == nullptr) {
+            // Do any messy cross datum stuff you may need to do that requires minibatch consistency
+            try {
+                _providers[id]->post_process(*b->out);
+            } catch (std::exception& e) {
+                b->exception = std::current_exception();
+            }
+        }
+        if (b->exception != nullptr) {
+            // pass errors on to whoever consumes this minibatch
+            _out->write_exception(b->exception);
+        }
 
-        _bufferIndex = (_bufferIndex == 0) ? 1 : 0;
         _out->advance_write_pos();
+        _in->advance_read_pos();
     }
-    _out->signal_not_empty();
 }
 
 void decode_thread_pool::consume()
 {
-    // lock on input buffers and call produce
+    // Wait for a filled input slot and an empty output slot.  Both stay owned
+    // by this minibatch until it is published, so neither pool is locked
+    // while it is being decoded.
     {
-        unique_lock<mutex> lock(_in->get_mutex());
-        while (_in->empty() == true) {
-            _in->wait_for_not_empty(lock);
-            if (_stopManager == true) {
-                return;
-            }
+        stage_timer timer(_stats->wait_input_ns);
+        if (_in->wait_for_not_empty() == false) {
+            return;
         }
-        _inputBuf = &_in->get_for_read();
-        produce();
-        _in->advance_read_pos();
     }
-    _in->signal_not_full();
+    {
+        stage_timer timer(_stats->wait_output_ns);
+        if (_out->wait_for_not_full() == false) {
+            return;
+        }
+    }
+
+    auto b = make_shared<batch>();
+    b->out = &_out->get_for_write();
+    try {
+        b->in = &_in->get_for_read();
+    } catch (std::exception& e) {
+        // nothing to decode, publish the read error in order
+        b->exception = std::current_exception();
+        b->next_item = _batchSize;
+        b->done = _batchSize;
+    }
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        _inflight.push_back(b);
+    }
+    if (b->exception != nullptr) {
+        publish(-1);
+    } else {
+        _started.notify_all();
+    }
 }
 
 void decode_thread_pool::manage()
@@ -215,39 +236,143 @@ void decode_thread_pool::manage()
         while (_stopManager == false) {
             consume();
         }
-        _managerStopped = true;
     } catch (std::exception& e) {
         cerr << "exception in decode_thread_pool::manage: " << e.what() << endl;
         // TODO: fail gracefully, not seg fault
     }
+    _managerStopped = true;
 }
 
 
 read_thread_pool::read_thread_pool(const shared_ptr<buffer_pool_in>& out,
-                       const shared_ptr<batch_iterator>& b_it)
-: thread_pool(1), _out(out), _batch_iterator(b_it)
+                       const shared_ptr<batch_iterator>& b_it,
+                       int epoch_items,
+                       const shared_ptr<stage_stats>& stats)
+: thread_pool(1), _out(out), _batch_iterator(b_it), _stats(stats), _epoch_items(epoch_items)
 {
     assert(_count == 1);
 }
 
+read_thread_pool::~read_thread_pool()
+{
+    join();
+}
+
+void read_thread_pool::stop()
+{
+    thread_pool::stop();
+    _out->shutdown();
+}
+
 void read_thread_pool::work(int id)
 {
-    // Fill input buffers.
+    // Fill input buffers.  The slot is ours until advance_write_pos hands it
+    // to the decode stage.
     {
-        unique_lock<mutex> lock(_out->get_mutex());
-        while (_out->full() == true) {
-            _out->wait_for_non_full(lock);
+        stage_timer timer(_stats->wait_output_ns);
+        if (_out->wait_for_not_full() == false) {
+            return;
         }
+    }
+    buffer_in_array& slot = _out->get_for_write();
 
+    {
+        lock_guard<mutex> lock(_mutex);
         try {
-            _batch_iterator->read(_out->get_for_write());
+            stage_timer timer(_stats->busy_ns);
+            _batch_iterator->read(slot);
         } catch(std::exception& e) {
+            _stats->exceptions++;
             _out->write_exception(std::current_exception());
         }
+        _stats->items++;
+        _written++;
+
+        if (_epoch_items > 0) {
+            _items += slot[0]->get_item_count();
+            if (_items >= _epoch_items) {
+                _batch_iterator->reset();
+                _items = 0;
+                _epoch_ends.push_back(_written);
+            }
+        }
+    }
 
-        _out->advance_write_pos();
+    _out->advance_write_pos();
+}
+
+uint64_t read_thread_pool::reset(uint64_t consumed)
+{
+    lock_guard<mutex> lock(_mutex);
+
+    // Minibatches after an epoch end already start from the first record.
+    // Keep them and only skip the rest of the epoch being consumed.
+    while (!_epoch_ends.empty() && _epoch_ends.front() < consumed) {
+        _epoch_ends.pop_front();
+    }
+    if (!_epoch_ends.empty()) {
+        uint64_t end = _epoch_ends.front();
+        _epoch_ends.pop_front();
+        return end;
+    }
+
+    // nothing usable read yet, everything handed out so far is stale
+    _batch_iterator->reset();
+    _items = 0;
+    return _written;
+}
+
+
+transfer_thread_pool::transfer_thread_pool(const shared_ptr<buffer_pool_out>& in,
+                                           const shared_ptr<buffer_pool_device>& out,
+                                           const shared_ptr<python_backend>& backend,
+                                           const shared_ptr<stage_stats>& stats)
+: thread_pool(1), _in(in), _out(out), _backend(backend), _stats(stats)
+{
+    assert(_count == 1);
+}
+
+transfer_thread_pool::~transfer_thread_pool()
+{
+    join();
+}
+
+void transfer_thread_pool::stop()
+{
+    thread_pool::stop();
+    _in->shutdown();
+    _out->shutdown();
+}
+
+void transfer_thread_pool::work(int id)
+{
+    // Take a free device buffer first, then wait for something to put in
+    // it.  Decoding carries on meanwhile.
+    {
+        stage_timer timer(_stats->wait_output_ns);
+        if (_out->wait_for_not_full() == false) {
+            return;
+        }
+    }
+    int bufIdx = _out->get_for_write();
+
+    {
+        stage_timer timer(_stats->wait_input_ns);
+        if (_in->wait_for_not_empty() == false) {
+            return;
+        }
     }
-    _out->signal_not_empty();
+    try {
+        stage_timer timer(_stats->busy_ns);
+        _backend->call_backend_transfer(_in->get_for_read(), bufIdx);
+    } catch(std::exception& e) {
+        // decode errors are raised to the consumer of this device buffer
+        _stats->exceptions++;
+        _out->write_exception(std::current_exception());
+    }
+    _stats->items++;
+
+    _out->advance_write_pos();
 }
 
 
@@ -258,19 +383,81 @@ loader::loader(const char* cfg_string, PyObject *py_obj_backend)
     loader_config lcfg(_lcfg_json);
 
     _batchSize = lcfg.minibatch_size;
+    _prefetch_depth = lcfg.prefetch_depth;
+    _prefetch_next_epoch = lcfg.prefetch_next_epoch;
     _single_thread_mode = lcfg.single_thread;
+    // workers are not tied to items of a single minibatch, so use every
+    // core even when the minibatch is small
+    _decode_threads = _single_thread_mode ? 1 : thread::hardware_concurrency();
+    _stats = make_shared<pipeline_stats>(_decode_threads, lcfg.read_threads);
+    _block_loader = make_block_loader(lcfg);
+
+    // later epochs are served from memory when the dataset fits the budget
+    if(lcfg.cache_memory_mb > 0) {
+        _memory_cache = make_shared<block_loader_memory_cache>(_block_loader,
+                                                               (size_t)lcfg.cache_memory_mb << 20);
+        _block_loader = _memory_cache;
+    }
+
+    // extra readers are only useful with blocks to read ahead
+    int read_ahead = lcfg.read_ahead;
+    if (lcfg.read_threads > 1 && read_ahead == 0) {
+        read_ahead = lcfg.read_threads;
+    }
+    if (read_ahead > 0) {
+        _block_loader = make_shared<block_loader_prefetch>(_block_loader, lcfg.read_threads, _stats->io);
+    }
+
+    shared_ptr<block_iterator> block_iter;
+    if (lcfg.shuffle_every_epoch) {
+        block_iter = make_shared<block_iterator_shuffled>(_block_loader, lcfg.random_seed, read_ahead);
+    } else {
+        block_iter = make_shared<block_iterator_sequential>(_block_loader, read_ahead);
+    }
+    if (lcfg.shuffle_buffer_blocks > 1) {
+        block_iter = make_shared<block_iterator_mixed>(block_iter,
+                                                       _block_loader->blockSize(),
+                                                       _block_loader->objectCount(),
+                                                       lcfg.shuffle_buffer_blocks,
+                                                       (size_t)lcfg.shuffle_buffer_mb << 20,
+                                                       lcfg.random_seed);
+    }
+
+    _batch_iterator = make_shared<batch_iterator>(block_iter, lcfg.minibatch_size, _stats->load);
+}
+
+shared_ptr<block_loader> loader::make_block_loader(const loader_config& lcfg)
+{
+    shared_ptr<block_loader> blocks;
     shared_ptr<nervana::manifest> base_manifest = nullptr;
+    string version;
+    string legacy_version;
 
     if(nervana::manifest_nds::is_likely_json(lcfg.manifest_filename)) {
         auto manifest = make_shared<nervana::manifest_nds>(lcfg.manifest_filename);
 
         // TODO: add shard_count/shard_index to cfg
-        _block_loader = make_shared<block_loader_nds>(manifest->baseurl,
-                                                      manifest->token,
-                                                      manifest->collection_id,
-                                                      lcfg.macrobatch_size);
+        blocks = make_shared<block_loader_nds>(manifest->baseurl,
+                                               manifest->token,
+                                               manifest->collection_id,
+                                               lcfg.macrobatch_size);
+
+        base_manifest = manifest;
+        version = manifest->version();
+    } else if(nervana::manifest_bin::is_likely_binary(lcfg.manifest_filename)) {
+        // compiled by tools/compile_manifest, see manifest_bin.hpp
+        auto manifest = make_shared<nervana::manifest_bin>(lcfg.manifest_filename,
+                                                           lcfg.shuffle_manifest);
+        if(manifest->objectCount() == 0) {
+            throw std::runtime_error("manifest file is empty");
+        }
 
+        blocks = make_shared<block_loader_bin>(manifest,
+                                               lcfg.subset_fraction,
+                                               lcfg.macrobatch_size,
+                                               lcfg.io_queue_depth);
         base_manifest = manifest;
+        version = "records";
     } else {
         // the manifest defines which data should be included in the dataset
         auto manifest = make_shared<nervana::manifest_csv>(lcfg.manifest_filename,
@@ -281,37 +468,44 @@ loader::loader(const char* cfg_string, PyObject *py_obj_backend)
             throw std::runtime_error("manifest file is empty");
         }
 
-        _block_loader = make_shared<block_loader_file>(manifest,
-                                                       lcfg.subset_fraction,
-                                                       lcfg.macrobatch_size);
+        blocks = make_shared<block_loader_file>(manifest,
+                                                lcfg.subset_fraction,
+                                                lcfg.macrobatch_size,
+                                                lcfg.io_queue_depth,
+                                                lcfg.cache_fingerprint_files);
         base_manifest = manifest;
-    }
 
-    if(lcfg.cache_directory.length() > 0) {
-        _block_loader = make_shared<block_loader_cpio_cache>(lcfg.cache_directory,
-                                                             base_manifest->hash(),
-                                                             base_manifest->version(),
-                                                             _block_loader);
+        // cached records carry fingerprints of their rows, so an edited
+        // manifest invalidates only the records that changed rather than
+        // the whole cache through its mtime.  Older versions named the
+        // cache after the mtime, their blocks are used while it holds and
+        // the rows are in the order they cached them in.
+        version = "records";
+        legacy_version = manifest->legacy_version();
     }
 
-    shared_ptr<block_iterator> block_iter;
-    if (lcfg.shuffle_every_epoch) {
-        block_iter = make_shared<block_iterator_shuffled>(_block_loader, lcfg.random_seed);
-    } else {
-        block_iter = make_shared<block_iterator_sequential>(_block_loader);
+    if(lcfg.cache_directory.length() > 0) {
+        blocks = make_shared<block_loader_cpio_cache>(lcfg.cache_directory,
+                                                      base_manifest->hash(),
+                                                      version,
+                                                      blocks,
+                                                      lcfg.cache_mmap,
+                                                      lcfg.cache_compression,
+                                                      (size_t)lcfg.cache_disk_mb << 20,
+                                                      (size_t)lcfg.cache_write_behind_mb << 20,
+                                                      legacy_version);
     }
 
-    _batch_iterator = make_shared<batch_iterator>(block_iter, lcfg.minibatch_size);
+    return blocks;
 }
 
 int loader::start()
 {
     _first = true;
+    _consumed = 0;
+    _discard_until = 0;
     try {
-        int ncores         = thread::hardware_concurrency();
-        int itemsPerThread = (_batchSize - 1) /  ncores + 1;
-        int nthreads       = (_batchSize - 1) / itemsPerThread + 1;
-        nthreads           = _single_thread_mode ? 1 : std::min(nthreads, _batchSize);
+        int nthreads = _decode_threads;
 
         if (nthreads <= 0)
         {
@@ -324,9 +518,11 @@ int loader::start()
         }
 
         // variable size buffers for reading encoded data (start off zero and grow as needed)
-        _read_buffers = make_shared<buffer_pool_in>(providers[0]->num_inputs);
+        _read_buffers = make_shared<buffer_pool_in>(providers[0]->num_inputs, _prefetch_depth);
         _read_thread_pool = unique_ptr<read_thread_pool>(
-                        new read_thread_pool(_read_buffers, _batch_iterator));
+                        new read_thread_pool(_read_buffers, _batch_iterator,
+                                             _prefetch_next_epoch ? itemCount() : 0,
+                                             _stats->read));
 
         // fixed size buffers for writing out decoded data
         const vector<nervana::shape_type>& oshapes = providers[0]->get_oshapes();
@@ -341,10 +537,17 @@ int loader::start()
         // These are fixed size output buffers (need batchSize for stride)
         _decode_buffers = make_shared<buffer_pool_out>(write_sizes,
                                                        (size_t)_batchSize,
-                                                       _python_backend->use_pinned_memory());
+                                                       _python_backend->use_pinned_memory(),
+                                                       _prefetch_depth);
 
         _decode_thread_pool = unique_ptr<decode_thread_pool>(
-                new decode_thread_pool(nthreads, _read_buffers, _decode_buffers, _python_backend));
+                new decode_thread_pool(nthreads, _batchSize, _read_buffers, _decode_buffers,
+                                       _stats->decode));
+
+        _device_buffers = make_shared<buffer_pool_device>();
+        _transfer_thread_pool = unique_ptr<transfer_thread_pool>(
+                new transfer_thread_pool(_decode_buffers, _device_buffers, _python_backend,
+                                         _stats->transfer));
 
         for (auto& p: providers)
         {
@@ -354,6 +557,7 @@ int loader::start()
     } catch(std::bad_alloc&) {
         return -1;
     }
+    _transfer_thread_pool->start();
     _decode_thread_pool->start();
     _read_thread_pool->start();
     return 0;
@@ -361,63 +565,86 @@ int loader::start()
 
 void loader::stop()
 {
+    // unblock both stages; their threads are joined when the pools are destroyed
     _read_thread_pool->stop();
-    while (_read_thread_pool->stopped() == false)
-    {
-        std::this_thread::yield();
-        drain();
-    }
-    while ((_decode_buffers->empty() == false) ||
-           (_read_buffers->empty() == false))
-    {
-        drain();
-    }
     _decode_thread_pool->stop();
-
-    _read_thread_pool   = nullptr;
-    _decode_buffers     = nullptr;
-    _decode_thread_pool = nullptr;
-    _python_backend         = nullptr;
+    _transfer_thread_pool->stop();
+
+    _read_thread_pool     = nullptr;
+    _decode_thread_pool   = nullptr;
+    _transfer_thread_pool = nullptr;
+    _read_buffers         = nullptr;
+    _decode_buffers       = nullptr;
+    _device_buffers       = nullptr;
+    _python_backend       = nullptr;
 }
 
 int loader::reset()
 {
-    stop();
-    _batch_iterator->reset();
-    return start();
+    // Threads, providers and buffers stay up.  The read stage restarts the
+    // iterator and next() skips whatever was already in the pipeline.
+    _discard_until = _read_thread_pool->reset(_consumed);
+    return 0;
 }
 
 PyObject* loader::next(int bufIdx)
 {
-    unique_lock<mutex> lock(_decode_buffers->get_mutex());
-    if (_first == true) {
+    while (true) {
+        if (_first == false) {
+            // Release the device buffer returned last time and the decoded
+            // minibatch that was copied into it.
+            _device_buffers->advance_read_pos();
+            _decode_buffers->advance_read_pos();
+            _first = true;
+        }
+        {
+            stage_timer timer(_stats->consumer->wait_input_ns);
+            if (_device_buffers->wait_for_not_empty() == false) {
+                throw std::runtime_error("loader has been stopped");
+            }
+        }
+        // The slot is claimed even if it carries a decode error, so it is
+        // released on the next call like any other.
         _first = false;
-    } else {
-        // Unlock the buffer used for the previous minibatch.
-        _decode_buffers->advance_read_pos();
-        _decode_buffers->signal_not_full();
-    }
-    while (_decode_buffers->empty()) {
-        _decode_buffers->wait_for_not_empty(lock);
+        _consumed++;
+
+        if (_consumed > _discard_until) {
+            break;
+        }
+        // read before the last reset, drop it along with any error
+        try {
+            _device_buffers->get_for_read();
+        } catch (std::exception& e) {
+        }
     }
-    // TODO: should this actually be somewhere above the various locks/signals?
-    _decode_buffers->reraise_exception();
-    return _python_backend->get_host_tuple(bufIdx);
+
+    // The transfer stage decides which device buffer each minibatch lands
+    // in, alternating between the two.  bufIdx is kept for the C API only.
+    int devIdx = _device_buffers->get_for_read();
+    _stats->consumer->items++;
+    return _python_backend->get_host_tuple(devIdx);
 }
 
-PyObject* loader::shapes()
+const char* loader::stats()
 {
-    return _python_backend->get_shapes();
+    nlohmann::json js = _stats->to_json();
+    if (_read_buffers != nullptr) {
+        // filled slots out of the depth of each pool
+        js["queues"]["read"]   = {_read_buffers->used(), _read_buffers->count()};
+        js["queues"]["decode"] = {_decode_buffers->used(), _decode_buffers->count()};
+        js["queues"]["device"] = {_device_buffers->used(), _device_buffers->count()};
+    }
+    if (_memory_cache != nullptr) {
+        js["memory_cache"]["hits"]      = _memory_cache->hits();
+        js["memory_cache"]["misses"]    = _memory_cache->misses();
+        js["memory_cache"]["evictions"] = _memory_cache->evictions();
+        js["memory_cache"]["bytes"]     = _memory_cache->bytes();
+    }
+    _stats_json = js.dump();
+    return _stats_json.c_str();
 }
 
-void loader::drain()
+PyObject* loader::shapes()
 {
-    {
-        unique_lock<mutex> lock(_decode_buffers->get_mutex());
-        if (_decode_buffers->empty() == true) {
-            return;
-        }
-        _decode_buffers->advance_read_pos();
-    }
-    _decode_buffers->signal_not_full();
+    return _python_backend->get_shapes();
 }
@@ -23,21 +23,27 @@
 #include <chrono>
 #include <utility>
 #include <algorithm>
+#include <atomic>
+#include <deque>
 
 #include "python_backend.hpp"
 #include "thread_pool.hpp"
 #include "block_loader.hpp"
+#include "block_loader_memory_cache.hpp"
 #include "block_iterator.hpp"
 #include "batch_iterator.hpp"
 #include "manifest.hpp"
 #include "provider_factory.hpp"
 #include "buffer_pool_in.hpp"
 #include "buffer_pool_out.hpp"
+#include "buffer_pool_device.hpp"
+#include "pipeline_stats.hpp"
 
 namespace nervana {
     class decode_thread_pool;
     class loader_config;
     class read_thread_pool;
+    class transfer_thread_pool;
     class loader;
 }
 
@@ -45,16 +51,27 @@ namespace nervana {
  *
  * decode_thread_pool takes data from the BufferPool `in`, transforms it
  * using `count` threads with a Media::transform built from
- * `mediaParams`.  Each minibatch is transposed by a manager thread and
- * then copied to the `device`.
+ * `mediaParams`.  A manager thread hands input minibatches to the
+ * workers and publishes the decoded results to the BufferPool `out`.
+ * Copying to the device is left to the transfer_thread_pool.
+ *
+ * Items are not partitioned up front.  Every worker claims the next
+ * undecoded item of a minibatch from a shared atomic cursor, so a few
+ * expensive items cannot leave the other workers idle.
+ *
+ * Several minibatches may be in flight at once, bounded by the depth of the
+ * pools.  Workers that find the oldest minibatch fully claimed move on to
+ * the next one, and finished minibatches are published in input order.
+ *
+ * `stats` counts decoded records.  Its busy time is summed over all workers.
  *
  */
 class nervana::decode_thread_pool : public nervana::thread_pool {
 public:
-    decode_thread_pool(int count,
+    decode_thread_pool(int count, int batchSize,
                        const std::shared_ptr<nervana::buffer_pool_in>& in,
                        const std::shared_ptr<nervana::buffer_pool_out>& out,
-                       const std::shared_ptr<python_backend>& pbe);
+                       const std::shared_ptr<nervana::stage_stats>& stats = std::make_shared<nervana::stage_stats>());
 
     virtual ~decode_thread_pool();
     virtual void start() override;
@@ -64,7 +81,6 @@ public:
 protected:
     virtual void run(int id) override;
     virtual void work(int id) override;
-    void produce();
     void consume();
     void manage();
 
@@ -72,26 +88,35 @@ private:
     decode_thread_pool();
     decode_thread_pool(const decode_thread_pool&);
 
-    int                         _itemsPerThread;
+    // a minibatch being decoded from one claimed input slot into one
+    // claimed output slot
+    class batch {
+    public:
+        nervana::buffer_in_array*   in        = 0;
+        nervana::buffer_out_array*  out       = 0;
+        std::atomic<int>            next_item{0};
+        std::atomic<int>            done{0};
+        std::exception_ptr          exception;
+    };
+
+    std::shared_ptr<batch> next_batch();
+    void publish(int id);
+
     std::shared_ptr<nervana::buffer_pool_in> _in;
     std::shared_ptr<nervana::buffer_pool_out> _out;
-    std::shared_ptr<python_backend> _python_backend;
+    std::shared_ptr<nervana::stage_stats> _stats;
     std::mutex                  _mutex;
+    std::mutex                  _publishMutex;
     std::condition_variable     _started;
-    std::condition_variable     _ended;
     int                         _batchSize;
-    int                         _endSignaled    = 0;
     std::thread*                _manager        = 0;
     bool                        _stopManager    = false;
     bool                        _managerStopped = false;
-    nervana::buffer_in_array*   _inputBuf       = 0;
-    int                         _bufferIndex    = 0;
 
     std::vector<std::shared_ptr<nervana::provider_interface>> _providers;
 
-    std::vector<int>            _startSignaled;
-    std::vector<int>            _startInds;
-    std::vector<int>            _endInds;
+    // admitted and not yet published, oldest first
+    std::deque<std::shared_ptr<batch>> _inflight;
 };
 
 class nervana::loader_config : public nervana::interface::config {
@@ -101,12 +126,31 @@ public:
 
     std::string type;
     std::string cache_directory     = "";
+    bool        cache_mmap          = true;
+    std::string cache_compression   = "none";
+    // size limit of cache_directory, 0 for no limit
+    int         cache_disk_mb       = 0;
+    // blocks written to the cache in the background, 0 writes on the reader
+    int         cache_write_behind_mb = 256;
+    // also check the size and mtime of source files for changes
+    bool        cache_fingerprint_files = false;
+    // budget of the in-memory block cache, 0 turns it off
+    int         cache_memory_mb     = 0;
     int         macrobatch_size     = 0;
     float       subset_fraction     = 1.0;
     bool        shuffle_every_epoch = false;
     bool        shuffle_manifest    = false;
+    // mix the records of this many resident blocks, 0 or 1 turns it off
+    int         shuffle_buffer_blocks = 0;
+    // memory bound of those blocks, 0 for no limit
+    int         shuffle_buffer_mb   = 0;
     bool        single_thread       = false;
     int         random_seed         = 0;
+    int         prefetch_depth      = 4;
+    int         read_threads        = 1;
+    int         read_ahead          = 0;
+    int         io_queue_depth      = 32;
+    bool        prefetch_next_epoch = false;
 
     loader_config(nlohmann::json js)
     {
@@ -132,28 +176,87 @@ private:
         ADD_SCALAR(manifest_filename, mode::REQUIRED),
         ADD_SCALAR(minibatch_size, mode::REQUIRED),
         ADD_SCALAR(cache_directory, mode::OPTIONAL),
+        ADD_SCALAR(cache_mmap, mode::OPTIONAL),
+        ADD_SCALAR(cache_compression, mode::OPTIONAL),
+        ADD_SCALAR(cache_disk_mb, mode::OPTIONAL),
+        ADD_SCALAR(cache_write_behind_mb, mode::OPTIONAL),
+        ADD_SCALAR(cache_fingerprint_files, mode::OPTIONAL),
+        ADD_SCALAR(cache_memory_mb, mode::OPTIONAL),
         ADD_SCALAR(macrobatch_size, mode::OPTIONAL),
         ADD_SCALAR(subset_fraction, mode::OPTIONAL),
         ADD_SCALAR(shuffle_every_epoch, mode::OPTIONAL),
         ADD_SCALAR(shuffle_manifest, mode::OPTIONAL),
+        ADD_SCALAR(shuffle_buffer_blocks, mode::OPTIONAL),
+        ADD_SCALAR(shuffle_buffer_mb, mode::OPTIONAL),
         ADD_SCALAR(single_thread, mode::OPTIONAL),
         ADD_SCALAR(random_seed, mode::OPTIONAL),
+        ADD_SCALAR(prefetch_depth, mode::OPTIONAL),
+        ADD_SCALAR(read_threads, mode::OPTIONAL),
+        ADD_SCALAR(read_ahead, mode::OPTIONAL),
+        ADD_SCALAR(io_queue_depth, mode::OPTIONAL),
+        ADD_SCALAR(prefetch_next_epoch, mode::OPTIONAL),
     };
 
     loader_config() {}
-    bool validate() { return true; }
+    bool validate()
+    {
+        if(prefetch_depth < 1) {
+            throw std::invalid_argument("prefetch_depth must be at least 1");
+        }
+        if(read_threads < 1) {
+            throw std::invalid_argument("read_threads must be at least 1");
+        }
+        if(read_ahead < 0) {
+            throw std::invalid_argument("read_ahead must not be negative");
+        }
+        if(cache_disk_mb < 0) {
+            throw std::invalid_argument("cache_disk_mb must not be negative");
+        }
+        if(cache_write_behind_mb < 0) {
+            throw std::invalid_argument("cache_write_behind_mb must not be negative");
+        }
+        if(cache_memory_mb < 0) {
+            throw std::invalid_argument("cache_memory_mb must not be negative");
+        }
+        if(shuffle_buffer_blocks < 0) {
+            throw std::invalid_argument("shuffle_buffer_blocks must not be negative");
+        }
+        if(shuffle_buffer_mb < 0) {
+            throw std::invalid_argument("shuffle_buffer_mb must not be negative");
+        }
+        if(io_queue_depth < 1) {
+            throw std::invalid_argument("io_queue_depth must be at least 1");
+        }
+        return true;
+    }
 };
 
 /*
  * The read_thread_pool wraps BatchIterator in a thread an coordinates work
- * with other threads via locks on the output BufferPool `out`
+ * with other threads by handing filled slots of the output BufferPool `out`
+ * to the decode stage.  Blocks are read ahead of it by block_loader_prefetch
+ * when read_ahead or read_threads is configured.
+ *
+ * With a non zero `epoch_items` the iterator is rewound on its own after
+ * each epoch of that many records, so a later reset() can keep what was
+ * already read of the next epoch instead of throwing it away.
  *
  */
 
 class nervana::read_thread_pool: public thread_pool {
 public:
     read_thread_pool(const std::shared_ptr<nervana::buffer_pool_in>& out,
-                     const std::shared_ptr<nervana::batch_iterator>& batch_iterator);
+                     const std::shared_ptr<nervana::batch_iterator>& batch_iterator,
+                     int epoch_items = 0,
+                     const std::shared_ptr<nervana::stage_stats>& stats = std::make_shared<nervana::stage_stats>());
+    virtual ~read_thread_pool();
+    virtual void stop() override;
+
+    // Restart from the first record while the thread keeps running.  The
+    // consumer has taken `consumed` minibatches so far.  Returns how many
+    // minibatches from the start it has to skip, as they were read before
+    // the restart.
+    uint64_t reset(uint64_t consumed);
 
 protected:
     virtual void work(int id) override;
@@ -163,6 +266,47 @@ private:
     read_thread_pool(const read_thread_pool&);
     std::shared_ptr<nervana::buffer_pool_in> _out;
     std::shared_ptr<nervana::batch_iterator> _batch_iterator;
+    std::shared_ptr<nervana::stage_stats>    _stats;
+
+    // guards the iterator and the counters below
+    std::mutex                  _mutex;
+    const int                   _epoch_items;
+    int                         _items   = 0;
+    uint64_t                    _written = 0;
+    // _written at every epoch end the iterator was rewound at
+    std::deque<uint64_t>        _epoch_ends;
+};
+
+/*
+ * The transfer_thread_pool copies decoded minibatches from the BufferPool
+ * `in` to the device through the python backend, on a thread of its own so
+ * that waiting for the GIL never stalls decoding.  Each transfer fills the
+ * next slot of the device ring `out`.
+ *
+ * A host slot stays claimed until the consumer releases the device slot it
+ * was copied to, since a backend may still be reading it asynchronously.
+ *
+ */
+
+class nervana::transfer_thread_pool: public thread_pool {
+public:
+    transfer_thread_pool(const std::shared_ptr<nervana::buffer_pool_out>& in,
+                         const std::shared_ptr<nervana::buffer_pool_device>& out,
+                         const std::shared_ptr<nervana::python_backend>& backend,
+                         const std::shared_ptr<nervana::stage_stats>& stats = std::make_shared<nervana::stage_stats>());
+    virtual ~transfer_thread_pool();
+    virtual void stop() override;
+
+protected:
+    virtual void work(int id) override;
+
+private:
+    transfer_thread_pool();
+    transfer_thread_pool(const transfer_thread_pool&);
+    std::shared_ptr<nervana::buffer_pool_out>       _in;
+    std::shared_ptr<nervana::buffer_pool_device>    _out;
+    std::shared_ptr<nervana::python_backend>        _backend;
+    std::shared_ptr<nervana::stage_stats>           _stats;
 };
 
 
@@ -183,28 +327,43 @@ public:
     int reset();
     PyObject* shapes();
     PyObject* next(int bufIdx);
+    // JSON snapshot of the pipeline_stats and pool occupancy.  Valid until
+    // the next call.
+    const char* stats();
 
     int itemCount() { return _block_loader->objectCount(); }
 
-private:
-    void drain();
+    // the block_loader reading the manifest of `lcfg`, behind the disk
+    // cache when cache_directory is set
+    static std::shared_ptr<nervana::block_loader> make_block_loader(const loader_config& lcfg);
 
 private:
     loader();
     loader(const loader&);
 
     bool                                        _first = true;
+    // minibatches taken by next() and how many of those are stale
+    uint64_t                                    _consumed = 0;
+    uint64_t                                    _discard_until = 0;
     bool                                        _single_thread_mode = false;
+    int                                         _decode_threads;
 
     std::shared_ptr<nervana::buffer_pool_in>    _read_buffers = nullptr;
     std::shared_ptr<nervana::buffer_pool_out>   _decode_buffers = nullptr;
     std::unique_ptr<nervana::read_thread_pool>  _read_thread_pool = nullptr;
     std::unique_ptr<decode_thread_pool>         _decode_thread_pool = nullptr;
+    std::shared_ptr<nervana::buffer_pool_device> _device_buffers = nullptr;
+    std::unique_ptr<transfer_thread_pool>       _transfer_thread_pool = nullptr;
     std::shared_ptr<nervana::block_loader>      _block_loader = nullptr;
+    std::shared_ptr<nervana::block_loader_memory_cache> _memory_cache = nullptr;
     std::shared_ptr<nervana::batch_iterator>    _batch_iterator = nullptr;
 
     int                                         _batchSize;
+    int                                         _prefetch_depth;
+    bool                                        _prefetch_next_epoch;
     nlohmann::json                              _lcfg_json;
     PyObject*                                   _py_obj_backend;
     std::shared_ptr<python_backend>             _python_backend;
+    std::shared_ptr<nervana::pipeline_stats>    _stats;
+    std::string                                 _stats_json;
 };
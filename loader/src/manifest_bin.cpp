@@ -0,0 +1,322 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "manifest_bin.hpp"
+#include "manifest_csv.hpp"
+#include "util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+#define MANIFEST_BIN_MAGIC      "AEONMFST"
+#define MANIFEST_BIN_VERSION    1
+
+const uint64_t manifest_bin::inline_flag;
+
+class manifest_bin::header {
+public:
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    fields;
+    uint64_t    rows;
+    uint64_t    block_size;
+    uint64_t    blocks;
+    // offsets of the sections from the start of the file
+    uint64_t    entries;
+    uint64_t    block_table;
+    uint64_t    paths;
+    uint64_t    data;
+    uint64_t    size;
+};
+
+static size_t align8(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+manifest_bin::manifest_bin(const string& filename, bool shuffle)
+: _filename(filename)
+{
+    int fd = open(_filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::runtime_error("Manifest file " + _filename + " doesn't exist.");
+    }
+
+    struct stat stats;
+    if(fstat(fd, &stats) != 0 || (size_t)stats.st_size < sizeof(header)) {
+        close(fd);
+        throw std::runtime_error("Manifest file " + _filename + " is not a binary manifest");
+    }
+    size_t size = stats.st_size;
+    void* data = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        throw std::runtime_error("Could not map manifest file " + _filename);
+    }
+    _mapping = shared_ptr<const void>(data, [size](const void* p) { munmap((void*)p, size); });
+
+    const char* base = (const char*)data;
+    const header* h  = (const header*)base;
+    if(memcmp(h->magic, MANIFEST_BIN_MAGIC, sizeof(h->magic)) != 0 ||
+       h->version != MANIFEST_BIN_VERSION) {
+        throw std::runtime_error("Manifest file " + _filename +
+                                 " is not a binary manifest of version " +
+                                 to_string(MANIFEST_BIN_VERSION));
+    }
+    // offsets and counts are bounded by the file size before they are
+    // added or multiplied, so a corrupt header cannot overflow the checks
+    if(h->size != size || h->data > size || h->paths > h->data ||
+       h->block_table > h->paths || h->entries > h->block_table ||
+       h->block_size == 0 || h->fields == 0 ||
+       h->rows > size / sizeof(entry) / h->fields ||
+       h->blocks != h->rows / h->block_size + (h->rows % h->block_size != 0) ||
+       h->entries + h->rows * h->fields * sizeof(entry) > h->block_table ||
+       h->block_table + (h->blocks + 1) * sizeof(uint64_t) > h->paths) {
+        throw std::runtime_error("Manifest file " + _filename + " is corrupt");
+    }
+
+    _rows       = h->rows;
+    _fields     = h->fields;
+    _blockSize  = h->block_size;
+    _blocks     = h->blocks;
+    _entries    = (const entry*)(base + h->entries);
+    _blockTable = (const uint64_t*)(base + h->block_table);
+    _paths      = base + h->paths;
+    _data       = base + h->data;
+
+    // everything read through the manifest later must lie inside it: the
+    // blocks cover the rows in order, paths end inside the path section
+    // and inline values inside the data section
+    uint64_t path_bytes = h->data - h->paths;
+    uint64_t data_bytes = h->size - h->data;
+    bool valid = (path_bytes == 0 || _paths[path_bytes - 1] == '\0') &&
+                 _blockTable[_blocks] == _rows;
+    for (size_t b = 0; valid && b < _blocks; b++) {
+        valid = _blockTable[b] <= _blockTable[b + 1];
+    }
+    for (size_t i = 0; valid && i < _rows * _fields; i++) {
+        const entry& e = _entries[i];
+        if (isInline(e)) {
+            uint64_t offset = e.offset & ~inline_flag;
+            valid = offset <= data_bytes && e.size <= data_bytes - offset;
+        } else {
+            valid = e.offset < path_bytes;
+        }
+    }
+    if(!valid) {
+        throw std::runtime_error("Manifest file " + _filename + " is corrupt");
+    }
+
+    if(shuffle) {
+        // the same seeded inside-out shuffle as manifest_csv, applied to an
+        // index since the rows themselves are read only
+        _order.resize(_rows);
+        for (size_t i = 0; i < _rows; i++) {
+            _order[i] = i;
+        }
+        std::mt19937 rng(0);
+        for (size_t i = 1; i < _rows; i++) {
+            size_t j = std::uniform_int_distribution<size_t>(0, i)(rng);
+            std::swap(_order[i], _order[j]);
+        }
+    }
+}
+
+string manifest_bin::hash()
+{
+    // returns a hash of the _filename
+    std::size_t h = std::hash<std::string>()(_filename);
+    stringstream ss;
+    ss << std::hex << h;
+    return ss.str();
+}
+
+string manifest_bin::version()
+{
+    struct stat stats;
+    if (stat(_filename.c_str(), &stats) == -1) {
+        throw std::runtime_error("Could not find manifest file " + _filename);
+    }
+    return to_string(stats.st_mtime);
+}
+
+pair<size_t, size_t> manifest_bin::blockRange(uint block_num) const
+{
+    if (block_num >= _blocks) {
+        return make_pair(_rows, _rows);
+    }
+    return make_pair(_blockTable[block_num], _blockTable[block_num + 1]);
+}
+
+const manifest_bin::entry& manifest_bin::at(size_t row, size_t field) const
+{
+    size_t r = _order.empty() ? row : _order[row];
+    return _entries[r * _fields + field];
+}
+
+bool manifest_bin::is_likely_binary(const string& filename)
+{
+    ifstream f(filename, ios::binary);
+    char magic[8];
+    f.read(magic, sizeof(magic));
+    return f.gcount() == sizeof(magic) && memcmp(magic, MANIFEST_BIN_MAGIC, sizeof(magic)) == 0;
+}
+
+void manifest_bin::compile(const string& csv_filename, const string& bin_filename,
+                           uint block_size, size_t inline_limit, int threads)
+{
+    if (block_size == 0) {
+        throw invalid_argument("block_size must be at least 1");
+    }
+    manifest_csv csv(csv_filename, false);
+    size_t rows   = csv.objectCount();
+    size_t fields = csv.fieldCount();
+    size_t count  = rows * fields;
+
+    // resolve and stat every file, and read the small ones
+    vector<entry>           entries(count);
+    vector<string>          paths(count);
+    vector<vector<char>>    contents(count);
+    vector<char>            inlined(count, 0);
+    exception_ptr           error;
+    mutex                   error_mutex;
+    auto resolve = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            string name = csv.filename(i / fields, i % fields);
+            char resolved[PATH_MAX];
+            struct stat stats;
+            entry& e = entries[i];
+            if (manifest_csv::is_inline(name)) {
+                // inline in the csv manifest, so inline here whatever its size
+                try {
+                    contents[i] = manifest_csv::inline_value(name);
+                } catch (std::exception&) {
+                    lock_guard<mutex> lock(error_mutex);
+                    error = current_exception();
+                }
+                e.size     = contents[i].size();
+                e.mtime    = 0;
+                inlined[i] = 1;
+                continue;
+            }
+            if (realpath(name.c_str(), resolved) == nullptr || stat(resolved, &stats) != 0) {
+                paths[i] = name;
+                e.size   = 0;
+                e.mtime  = -1;
+                continue;
+            }
+            paths[i] = resolved;
+            e.size   = stats.st_size;
+            e.mtime  = mtime_ns(stats);
+            if (e.size <= inline_limit) {
+                ifstream f(resolved, ios::binary);
+                contents[i].resize(e.size);
+                f.read(contents[i].data(), e.size);
+                inlined[i] = f.gcount() == (streamsize)e.size;
+            }
+        }
+    };
+    size_t nthreads = threads > 0 ? threads : max(1u, thread::hardware_concurrency());
+    nthreads = max<size_t>(1, min(nthreads, count));
+    vector<thread> workers;
+    for (size_t t = 1; t < nthreads; t++) {
+        workers.emplace_back(resolve, count * t / nthreads, count * (t + 1) / nthreads);
+    }
+    resolve(0, count / nthreads);
+    for (auto& w : workers) {
+        w.join();
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+
+    header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MANIFEST_BIN_MAGIC, sizeof(h.magic));
+    h.version     = MANIFEST_BIN_VERSION;
+    h.fields      = fields;
+    h.rows        = rows;
+    h.block_size  = block_size;
+    h.blocks      = (rows + block_size - 1) / block_size;
+    h.entries     = align8(sizeof(header));
+    h.block_table = h.entries + count * sizeof(entry);
+
+    size_t path_bytes = 0, data_bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (inlined[i]) {
+            entries[i].offset = data_bytes | inline_flag;
+            data_bytes += contents[i].size();
+        } else {
+            entries[i].offset = path_bytes;
+            path_bytes += paths[i].size() + 1;
+        }
+    }
+    h.paths = h.block_table + (h.blocks + 1) * sizeof(uint64_t);
+    h.data  = align8(h.paths + path_bytes);
+    h.size  = h.data + data_bytes;
+
+    // written aside and renamed so a loader never sees half a manifest
+    string tmp = bin_filename + ".tmp";
+    {
+        ofstream f(tmp, ios::binary | ios::trunc);
+        if (!f) {
+            throw std::runtime_error("Could not create " + tmp);
+        }
+        vector<char> pad(8, 0);
+        f.write((const char*)&h, sizeof(h));
+        f.write(pad.data(), h.entries - sizeof(h));
+        f.write((const char*)entries.data(), count * sizeof(entry));
+        for (uint64_t b = 0; b <= h.blocks; b++) {
+            uint64_t first = min(b * block_size, (uint64_t)rows);
+            f.write((const char*)&first, sizeof(first));
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (!inlined[i]) {
+                f.write(paths[i].c_str(), paths[i].size() + 1);
+            }
+        }
+        f.write(pad.data(), h.data - (h.paths + path_bytes));
+        for (size_t i = 0; i < count; i++) {
+            if (inlined[i]) {
+                f.write(contents[i].data(), contents[i].size());
+            }
+        }
+        if (!f) {
+            f.close();
+            unlink(tmp.c_str());
+            throw std::runtime_error("Could not write " + tmp);
+        }
+    }
+    if (rename(tmp.c_str(), bin_filename.c_str()) != 0) {
+        unlink(tmp.c_str());
+        throw std::runtime_error("Could not create " + bin_filename);
+    }
+}
@@ -0,0 +1,110 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+#include "manifest.hpp"
+
+/* manifest_bin
+ *
+ * A manifest compiled ahead of time from a csv manifest, see
+ * tools/compile_manifest.  A loader opens it without parsing any text or
+ * touching the files it names: the file is mapped and used in place.
+ *
+ * After a fixed header it holds, each section 8 byte aligned:
+ *   - an entry per field, row by row: where the bytes of the field are,
+ *     their size and the modification time of the file in nanoseconds
+ *   - the first row of every block for the block size it was compiled
+ *     with, plus the row count
+ *   - the absolute paths of the files, each followed by a NUL
+ *   - the contents of files no larger than the inline limit, which are
+ *     never opened at all, and the values held inline by the csv manifest
+ *
+ * A file that was missing when the manifest was compiled keeps its path
+ * as written and an mtime of -1; loading its record fails as it would
+ * from the csv manifest.  Sizes and times are those seen at compile time,
+ * so the manifest must be compiled again after files change.  Numbers are
+ * in the byte order of the machine that compiled it.
+ *
+ * With `shuffle` the rows are put in the same order manifest_csv gives
+ * the csv manifest they were compiled from.
+ */
+namespace nervana {
+
+    class manifest_bin : public manifest {
+    public:
+        manifest_bin(const std::string& filename, bool shuffle);
+
+        class entry {
+        public:
+            // offset into the paths, or into the inline data with
+            // inline_flag set
+            uint64_t    offset;
+            uint64_t    size;
+            int64_t     mtime;
+        };
+        static const uint64_t inline_flag = 1ULL << 63;
+
+        std::string hash();
+        std::string version();
+        size_t objectCount() const { return _rows; }
+        size_t fieldCount() const { return _fields; }
+
+        // the block size it was compiled with, and the rows of a block of
+        // that size
+        uint blockSize() const { return _blockSize; }
+        std::pair<size_t, size_t> blockRange(uint block_num) const;
+
+        const entry& at(size_t row, size_t field) const;
+        bool isInline(const entry& e) const { return (e.offset & inline_flag) != 0; }
+        bool isMissing(const entry& e) const { return e.mtime < 0; }
+        const char* path(const entry& e) const { return _paths + e.offset; }
+        const char* data(const entry& e) const { return _data + (e.offset & ~inline_flag); }
+
+        // keeps the mapping alive for items pointing at inline data
+        const std::shared_ptr<const void>& mapping() const { return _mapping; }
+
+        // true if `filename` starts with the magic of a binary manifest
+        static bool is_likely_binary(const std::string& filename);
+
+        // compile the csv manifest `csv_filename` into `bin_filename`,
+        // stat'ing its files with `threads` threads.  Files of at most
+        // `inline_limit` bytes are copied into the manifest.
+        static void compile(const std::string& csv_filename, const std::string& bin_filename,
+                            uint block_size, size_t inline_limit, int threads = 0);
+
+    private:
+        class header;
+
+        const std::string               _filename;
+        std::shared_ptr<const void>     _mapping;
+        size_t                          _rows = 0;
+        size_t                          _fields = 0;
+        uint                            _blockSize = 0;
+        size_t                          _blocks = 0;
+        const entry*                    _entries = nullptr;
+        const uint64_t*                 _blockTable = nullptr;
+        const char*                     _paths = nullptr;
+        const char*                     _data = nullptr;
+        // rows in shuffled order, empty without a shuffle
+        std::vector<uint64_t>           _order;
+    };
+}
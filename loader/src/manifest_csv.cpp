@@ -14,31 +14,104 @@
 */
 
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <iterator>
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
 #include "manifest_csv.hpp"
 #include "util.hpp"
 
 using namespace std;
 using namespace nervana;
 
+// lines each parse thread takes at the least, in bytes
+#define MIN_CHUNK_BYTES (4 << 20)
+
+// the rows of one range of lines, with their own directory ids
+class manifest_csv::chunk {
+public:
+    vector<char>                    pool;
+    vector<uint64_t>                offsets;
+    vector<uint32_t>                directories;
+    vector<string>                  dictionary;
+    unordered_map<string, uint32_t> ids;
+    size_t                          rows = 0;
+    size_t                          fields = 0;
+    string                          first_line;
+
+    // the first line whose field count differs from the line before it
+    bool                            ragged = false;
+    size_t                          ragged_fields = 0;
+    size_t                          ragged_previous = 0;
+    string                          ragged_line;
+};
+
+static string ragged_error(size_t lineno, size_t fields, size_t previous, const string& line)
+{
+    ostringstream ss;
+    ss << "at line: " << lineno;
+    ss << ", manifest file has a line with differing number of files (";
+    ss << fields << ") vs (" << previous << "): ";
+
+    auto field_list = split(line, ',');
+    std::copy(field_list.begin(), field_list.end(),
+              ostream_iterator<std::string>(ss, " "));
+    return ss.str();
+}
+
 manifest_csv::manifest_csv(string filename, bool shuffle)
 : _filename(filename), _shuffle(shuffle)
 {
     // for now parse the entire manifest on creation
-    ifstream infile(_filename);
-
-    if(!infile.is_open())
+    int fd = open(_filename.c_str(), O_RDONLY);
+    if(fd < 0)
     {
         throw std::runtime_error("Manifest file " + _filename + " doesn't exist.");
     }
 
-    parse_stream(infile);
+    struct stat stats;
+    if(fstat(fd, &stats) != 0) {
+        close(fd);
+        throw std::runtime_error("Could not find manifest file " + _filename);
+    }
+    if(stats.st_size == 0) {
+        close(fd);
+        return;
+    }
+
+    void* data = mmap(0, stats.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        throw std::runtime_error("Could not map manifest file " + _filename);
+    }
+    madvise(data, stats.st_size, MADV_SEQUENTIAL);
+
+    try {
+        parse((const char*)data, stats.st_size);
+    } catch (std::exception&) {
+        munmap(data, stats.st_size);
+        throw;
+    }
+    munmap(data, stats.st_size);
+
+    // If we don't need to shuffle, there may be small performance
+    // benefits in some situations to stream the filename_lists instead
+    // of loading them all at once.  That said, in the event that there
+    // is no cache and we are resuming training at a specific epoch, we
+    // may need to be able to jump around and read random blocks of the
+    // file, so a purely stream based interface is not sufficient.
+    if(_shuffle) {
+        shuffle_filename_lists();
+    }
 }
 
 string manifest_csv::hash()
@@ -63,61 +136,257 @@ string manifest_csv::version()
     return to_string(stats.st_mtime);
 }
 
-void manifest_csv::parse_stream(istream& is)
+string manifest_csv::legacy_version()
 {
-    // parse istream is and load the entire thing into _filename_lists
-    uint prev_num_fields = 0, lineno = 0;
-    string line;
+    // older releases shuffled with std::shuffle, which orders the rows
+    // differently, so only their unshuffled blocks hold the same rows
+    return _shuffle ? "" : version();
+}
+
+manifest_csv::FilenameList manifest_csv::row(size_t index) const
+{
+    FilenameList list;
+    list.reserve(_fields);
+    for (size_t f = 0; f < _fields; f++) {
+        list.push_back(filename(index, f));
+    }
+    return list;
+}
 
-    // read in each line, then from that istringstream, break into
-    // comma-separated fields.
-    while(std::getline(is, line)) {
+string manifest_csv::filename(size_t row, size_t field) const
+{
+    size_t i = row * _fields + field;
+    return _dictionary[_directories[i]] + &_pool[_offsets[i]];
+}
 
-        if (line.empty() || line[0] == '#')  //Skip comments and empty lines
-        {
-            continue;
+bool manifest_csv::is_inline(const string& field)
+{
+    static const char* prefixes[] = {"@int:", "@text:", "@base64:"};
+    for (const char* prefix : prefixes) {
+        if (field.compare(0, strlen(prefix), prefix) == 0) {
+            return true;
         }
+    }
+    return false;
+}
 
-        auto field_list = split(line, ',');
+vector<char> manifest_csv::inline_value(const string& field)
+{
+    size_t colon = field.find(':');
+    string kind  = field.substr(0, colon);
+    string value = colon == string::npos ? "" : field.substr(colon + 1);
+    if (kind == "@text") {
+        return vector<char>(value.begin(), value.end());
+    } else if (kind == "@int") {
+        size_t end = 0;
+        int n = 0;
+        try {
+            n = stoi(value, &end);
+        } catch (std::exception&) {
+            end = 0;
+        }
+        if (end == 0 || end != value.size()) {
+            throw std::runtime_error("invalid inline integer in manifest: \"" + field + "\"");
+        }
+        vector<char> bytes(sizeof(int32_t));
+        pack<int32_t>(bytes.data(), n);
+        return bytes;
+    } else if (kind == "@base64") {
+        static const string digits =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        vector<char> bytes;
+        uint32_t bits = 0;
+        int count = 0;
+        for (char c : value) {
+            if (c == '=') {
+                break;
+            }
+            size_t d = digits.find(c);
+            if (d == string::npos) {
+                throw std::runtime_error("invalid base64 in manifest: \"" + field + "\"");
+            }
+            bits = (bits << 6) | d;
+            count += 6;
+            if (count >= 8) {
+                count -= 8;
+                bytes.push_back((char)((bits >> count) & 0xff));
+            }
+        }
+        return bytes;
+    }
+    throw std::runtime_error("unknown inline value in manifest: \"" + field + "\"");
+}
 
-        if (lineno == 0) {
-            prev_num_fields = field_list.size();
+void manifest_csv::parse(const char* data, size_t size)
+{
+    // split the file into ranges of whole lines, one per thread
+    size_t threads = max<size_t>(1, min<size_t>(thread::hardware_concurrency(), size / MIN_CHUNK_BYTES));
+    vector<const char*> bounds{data};
+    for (size_t t = 1; t < threads; t++) {
+        const char* p = max(bounds.back(), data + size * t / threads);
+        const char* nl = (const char*)memchr(p, '\n', data + size - p);
+        if (nl == nullptr) {
+            break;
         }
+        bounds.push_back(nl + 1);
+    }
+    bounds.push_back(data + size);
 
-        if(field_list.size() != prev_num_fields) {
-            ostringstream ss;
-            ss << "at line: " << lineno;
-            ss << ", manifest file has a line with differing number of files (";
-            ss << field_list.size() << ") vs (" << prev_num_fields << "): ";
+    vector<chunk> chunks(bounds.size() - 1);
+    vector<thread> workers;
+    for (size_t c = 1; c < chunks.size(); c++) {
+        workers.emplace_back(&manifest_csv::parse_chunk, this, bounds[c], bounds[c + 1], ref(chunks[c]));
+    }
+    parse_chunk(bounds[0], bounds[1], chunks[0]);
+    for (auto& w : workers) {
+        w.join();
+    }
 
-            std::copy(field_list.begin(), field_list.end(),
-                      ostream_iterator<std::string>(ss, " "));
-            throw std::runtime_error(ss.str());
+    // every line must have as many files as the one before it
+    size_t lineno = 0;
+    size_t previous = 0;
+    for (auto& c : chunks) {
+        if (c.rows > 0 && previous > 0 && c.fields != previous) {
+            throw std::runtime_error(ragged_error(lineno, c.fields, previous, c.first_line));
+        }
+        if (c.ragged) {
+            throw std::runtime_error(ragged_error(lineno + c.rows, c.ragged_fields,
+                                                  c.ragged_previous, c.ragged_line));
         }
-        prev_num_fields = field_list.size();
-        _filename_lists.push_back(field_list);
-        lineno++;
+        if (c.rows > 0) {
+            previous = c.fields;
+        }
+        lineno += c.rows;
     }
+    _rows = lineno;
+    _fields = previous;
 
-    // If we don't need to shuffle, there may be small performance
-    // benefits in some situations to stream the filename_lists instead
-    // of loading them all at once.  That said, in the event that there
-    // is no cache and we are resuming training at a specific epoch, we
-    // may need to be able to jump around and read random blocks of the
-    // file, so a purely stream based interface is not sufficient.
-    if(_shuffle) {
-        shuffle_filename_lists();
+    // one dictionary for all chunks, then every chunk is copied into place
+    // by its own thread with its directory ids translated
+    unordered_map<string, uint32_t> ids;
+    vector<vector<uint32_t>> translate(chunks.size());
+    vector<size_t> pool_base(chunks.size()), field_base(chunks.size());
+    size_t pool_size = 0, field_count = 0;
+    for (size_t c = 0; c < chunks.size(); c++) {
+        for (auto& dir : chunks[c].dictionary) {
+            auto it = ids.find(dir);
+            if (it == ids.end()) {
+                it = ids.emplace(dir, _dictionary.size()).first;
+                _dictionary.push_back(dir);
+            }
+            translate[c].push_back(it->second);
+        }
+        pool_base[c]  = pool_size;
+        field_base[c] = field_count;
+        pool_size   += chunks[c].pool.size();
+        field_count += chunks[c].offsets.size();
+    }
+
+    _pool.resize(pool_size);
+    _offsets.resize(field_count);
+    _directories.resize(field_count);
+    auto place = [&](size_t c) {
+        chunk& ch = chunks[c];
+        std::copy(ch.pool.begin(), ch.pool.end(), _pool.begin() + pool_base[c]);
+        for (size_t i = 0; i < ch.offsets.size(); i++) {
+            _offsets[field_base[c] + i]     = pool_base[c] + ch.offsets[i];
+            _directories[field_base[c] + i] = translate[c][ch.directories[i]];
+        }
+        vector<char>().swap(ch.pool);
+        vector<uint64_t>().swap(ch.offsets);
+        vector<uint32_t>().swap(ch.directories);
+    };
+    workers.clear();
+    for (size_t c = 1; c < chunks.size(); c++) {
+        workers.emplace_back(place, c);
+    }
+    place(0);
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+void manifest_csv::parse_chunk(const char* begin, const char* end, chunk& c)
+{
+    // parse the lines in [begin, end) into c
+    const char* line = begin;
+    while (line < end) {
+        const char* eol = (const char*)memchr(line, '\n', end - line);
+        if (eol == nullptr) {
+            eol = end;
+        }
+        const char* next = eol + 1;
+
+        if (eol == line || line[0] == '#') {  //Skip comments and empty lines
+            line = next;
+            continue;
+        }
+
+        size_t fields = 1 + std::count(line, eol, ',');
+        if (c.rows == 0) {
+            c.fields = fields;
+            c.first_line.assign(line, eol);
+        } else if (fields != c.fields) {
+            c.ragged = true;
+            c.ragged_fields = fields;
+            c.ragged_previous = c.fields;
+            c.ragged_line.assign(line, eol);
+            return;
+        }
+
+        const char* field = line;
+        while (field <= eol) {
+            const char* stop = std::find(field, eol, ',');
+            const char* name = field;
+            // inline values are kept whole, they are not paths
+            for (const char* p = field; p < stop && *field != '@'; p++) {
+                if (*p == '/') {
+                    name = p + 1;
+                }
+            }
+
+            string dir(field, name);
+            auto it = c.ids.find(dir);
+            if (it == c.ids.end()) {
+                it = c.ids.emplace(dir, c.dictionary.size()).first;
+                c.dictionary.push_back(dir);
+            }
+            c.directories.push_back(it->second);
+            c.offsets.push_back(c.pool.size());
+            c.pool.insert(c.pool.end(), name, stop);
+            c.pool.push_back(0);
+
+            field = stop + 1;
+        }
+        c.rows++;
+        line = next;
     }
 }
 
 void manifest_csv::shuffle_filename_lists()
 {
-    // shuffles _filename_lists.  It is possible that the order of the
+    // shuffles the rows.  It is possible that the order of the
     // filenames in the manifest file were in some sorted order and we
     // don't want our blocks to be biased by that order.
 
     // hardcode random seed to 0 since this step can be cached into a
     // CPIO file.  We don't want to cache anything that is based on a
     // changing random seed, so don't use a changing random seed.
-    std::shuffle(_filename_lists.begin(), _filename_lists.end(), std::mt19937(0));
+    //
+    // The "inside-out" form of the Fisher-Yates shuffle places row i
+    // using only the first i+1 random numbers.  Rows appended to the
+    // manifest therefore leave the order of the existing rows alone,
+    // except that each new row takes the place of one earlier row, which
+    // moves to the end.  Cached blocks away from those places stay valid.
+    std::mt19937 rng(0);
+    for (size_t i = 1; i < _rows; i++) {
+        size_t j = std::uniform_int_distribution<size_t>(0, i)(rng);
+        if (i == j) {
+            continue;
+        }
+        for (size_t f = 0; f < _fields; f++) {
+            std::swap(_offsets[i * _fields + f], _offsets[j * _fields + f]);
+            std::swap(_directories[i * _fields + f], _directories[j * _fields + f]);
+        }
+    }
 }
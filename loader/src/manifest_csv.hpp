@@ -18,6 +18,7 @@
 #include <vector>
 #include <string>
 #include <random>
+#include <cstdint>
 
 #include "manifest.hpp"
 
@@ -31,10 +32,30 @@
  * object_filename2,target_filename2
  * ...
  *
+ * A field may carry its value itself instead of naming a file, which
+ * saves opening a tiny file per record for labels and transcripts:
+ *
+ * object_filename1,@int:3
+ * object_filename2,@text:HELLO WORLD
+ * object_filename3,@base64:AAECAw==
+ *
+ * @int: is read as a 4 byte little endian integer, as label::extractor
+ * expects by default, @text: is the text itself and @base64: the decoded
+ * bytes.  Text with commas in it has to be base64 encoded.  Any other
+ * field, including one starting with some other '@', names a file.
+ *
  * string hash() is to be used as a key for the cache.  It is possible
  * that it will be better to use the filename and last modified time as
  * a key instead.
  *
+ * The file is mapped and parsed by several threads, each taking a range
+ * of lines.  Rows are not kept as strings.  Every filename is split
+ * after its last '/': the directory goes into a dictionary shared by all
+ * rows, and the rest goes into one string pool.  A field is then an
+ * offset into the pool plus a directory id, so a row of two filenames
+ * costs about 24 bytes plus the file names themselves.  Rows are put
+ * back together as a FilenameList when they are read.
+ *
  */
 namespace nervana {
 
@@ -43,23 +64,72 @@ namespace nervana {
         manifest_csv(std::string filename, bool shuffle);
 
         typedef std::vector<std::string> FilenameList;
-        typedef std::vector<FilenameList>::const_iterator iter;
+
+        // random access to the rows, each read as a FilenameList
+        class iter {
+        public:
+            iter(const manifest_csv* manifest, size_t row) : _manifest(manifest), _row(row) {}
+
+            FilenameList operator*() const { return _manifest->row(_row); }
+            // holds the row for the duration of it->...
+            class proxy {
+            public:
+                FilenameList row;
+                const FilenameList* operator->() const { return &row; }
+            };
+            proxy operator->() const { return proxy{**this}; }
+
+            iter& operator++() { ++_row; return *this; }
+            iter operator+(size_t n) const { return iter(_manifest, _row + n); }
+            ptrdiff_t operator-(const iter& other) const { return (ptrdiff_t)_row - (ptrdiff_t)other._row; }
+            bool operator==(const iter& other) const { return _row == other._row; }
+            bool operator!=(const iter& other) const { return _row != other._row; }
+
+        private:
+            const manifest_csv* _manifest;
+            size_t              _row;
+        };
 
         std::string hash();
         std::string version();
-        size_t objectCount() const { return _filename_lists.size(); }
+        // the version older releases cached this manifest under, empty if
+        // they put its rows in a different order
+        std::string legacy_version();
+        size_t objectCount() const { return _rows; }
+        // filenames per row
+        size_t fieldCount() const { return _fields; }
+
+        FilenameList row(size_t index) const;
+        std::string filename(size_t row, size_t field) const;
+
+        // true if `field` holds its value inline rather than naming a file
+        static bool is_inline(const std::string& field);
+        // the bytes of an inline field.  Throws if it is malformed.
+        static std::vector<char> inline_value(const std::string& field);
 
         // begin and end provide iterators over the FilenameLists
-        iter begin() const { return _filename_lists.begin(); }
-        iter end() const { return _filename_lists.end(); }
+        iter begin() const { return iter(this, 0); }
+        iter end() const { return iter(this, _rows); }
 
     protected:
-        void parse_stream(std::istream& is);
+        void parse(const char* data, size_t size);
         void shuffle_filename_lists();
 
     private:
+        class chunk;
+        void parse_chunk(const char* begin, const char* end, chunk& c);
+
         const std::string _filename;
         const bool _shuffle;
-        std::vector<FilenameList> _filename_lists;
+
+        size_t _rows = 0;
+        size_t _fields = 0;
+        // names without their directory, each followed by a NUL
+        std::vector<char> _pool;
+        // per field, row by row: offset of the name in _pool and its directory
+        std::vector<uint64_t> _offsets;
+        std::vector<uint32_t> _directories;
+        // directory names including the trailing '/', by id
+        std::vector<std::string> _dictionary;
     };
 }
@@ -0,0 +1,118 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+#include "pipeline_stats.hpp"
+
+using namespace std;
+using namespace nervana;
+
+nlohmann::json stage_stats::to_json() const
+{
+    nlohmann::json js;
+    js["items"]          = items.load(memory_order_relaxed);
+    js["bytes"]          = bytes.load(memory_order_relaxed);
+    js["exceptions"]     = exceptions.load(memory_order_relaxed);
+    js["busy_sec"]       = busy_ns.load(memory_order_relaxed) * 1e-9;
+    js["wait_input_sec"] = wait_input_ns.load(memory_order_relaxed) * 1e-9;
+    js["wait_output_sec"]= wait_output_ns.load(memory_order_relaxed) * 1e-9;
+    return js;
+}
+
+pipeline_stats::pipeline_stats(int decode_threads, int read_threads)
+: io(make_shared<stage_stats>()),
+  load(make_shared<stage_stats>()),
+  read(make_shared<stage_stats>()),
+  decode(make_shared<stage_stats>()),
+  transfer(make_shared<stage_stats>()),
+  consumer(make_shared<stage_stats>()),
+  _decode_threads(max(decode_threads, 1)),
+  _read_threads(max(read_threads, 1)),
+  _start(chrono::steady_clock::now())
+{
+}
+
+double pipeline_stats::elapsed_sec() const
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - _start).count();
+}
+
+string pipeline_stats::verdict() const
+{
+    double elapsed = elapsed_sec();
+    if (elapsed <= 0 || consumer->items == 0) {
+        return "no minibatches consumed yet";
+    }
+
+    // Block loads happen inside the read stage, so reading only counts as
+    // the limit for the time not spent loading.  With prefetching that
+    // time is spent waiting for the readers, whose own load time is what
+    // shows how busy the source is.
+    bool prefetched    = io->items > 0;
+    double load_busy   = load->busy_ns * 1e-9;
+    double io_busy     = prefetched ? io->busy_ns * 1e-9 / _read_threads : load_busy;
+    double read_busy   = read->busy_ns * 1e-9 - load_busy;
+    double decode_busy = decode->busy_ns * 1e-9 / _decode_threads;
+    double xfer_busy   = transfer->busy_ns * 1e-9;
+    double waited      = consumer->wait_input_ns * 1e-9;
+
+    vector<pair<string, double>> stages = {
+        {"io", io_busy / elapsed},
+        {"read", read_busy / elapsed},
+        {"decode", decode_busy / elapsed},
+        {"transfer", xfer_busy / elapsed},
+    };
+    auto limit = max_element(stages.begin(), stages.end(),
+                             [](const pair<string, double>& a, const pair<string, double>& b) {
+                                 return a.second < b.second;
+                             });
+
+    stringstream ss;
+    ss << fixed << setprecision(0);
+    if (waited / elapsed < 0.05) {
+        ss << "consumer-bound: next() waited " << 100 * waited / elapsed
+           << "% of the time, the loader keeps up";
+    } else {
+        ss << limit->first << "-bound:";
+        for (auto& s : stages) {
+            ss << " " << s.first << " " << 100 * s.second << "%";
+        }
+        ss << " busy, next() waited " << 100 * waited / elapsed << "%";
+        if (prefetched) {
+            ss << ", read waited " << 100 * load_busy / elapsed << "% for blocks";
+        }
+    }
+    return ss.str();
+}
+
+nlohmann::json pipeline_stats::to_json() const
+{
+    nlohmann::json js;
+    js["elapsed_sec"]    = elapsed_sec();
+    js["decode_threads"] = _decode_threads;
+    js["read_threads"]   = _read_threads;
+    js["io"]             = io->to_json();
+    js["load"]           = load->to_json();
+    js["read"]           = read->to_json();
+    js["decode"]         = decode->to_json();
+    js["transfer"]       = transfer->to_json();
+    js["consumer"]       = consumer->to_json();
+    js["verdict"]        = verdict();
+    return js;
+}
@@ -0,0 +1,104 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include "json.hpp"
+
+namespace nervana {
+    class stage_stats;
+    class stage_timer;
+    class pipeline_stats;
+}
+
+/* stage_stats
+ *
+ * Counters for one stage of the loader pipeline.  Stage threads bump them
+ * atomically and stats() reads them while the threads keep going, so a
+ * snapshot is only roughly consistent across counters.
+ *
+ * `items` counts whatever the stage works on: minibatches for read and
+ * transfer, blocks for load and records for decode.
+ */
+class nervana::stage_stats {
+public:
+    std::atomic<uint64_t>   items{0};
+    std::atomic<uint64_t>   bytes{0};
+    std::atomic<uint64_t>   exceptions{0};
+    // time spent working, and blocked on an empty input or full output pool
+    std::atomic<uint64_t>   busy_ns{0};
+    std::atomic<uint64_t>   wait_input_ns{0};
+    std::atomic<uint64_t>   wait_output_ns{0};
+
+    nlohmann::json to_json() const;
+};
+
+// adds the lifetime of the timer to `counter`
+class nervana::stage_timer {
+public:
+    stage_timer(std::atomic<uint64_t>& counter)
+    : _counter(counter), _start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~stage_timer()
+    {
+        auto elapsed = std::chrono::steady_clock::now() - _start;
+        _counter.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                           std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t>&                  _counter;
+    std::chrono::steady_clock::time_point   _start;
+};
+
+/* pipeline_stats
+ *
+ * One stage_stats per pipeline stage plus the consumer calling next().
+ * verdict() names the stage that limits throughput: the one busy for the
+ * largest share of the time its threads had.
+ *
+ * `load` times the read stage getting each block, which with prefetching
+ * is mostly waiting.  `io` times the loads themselves, on the
+ * block_loader_prefetch readers, so the verdict can tell a slow source
+ * from a short read ahead.
+ */
+class nervana::pipeline_stats {
+public:
+    pipeline_stats(int decode_threads = 1, int read_threads = 1);
+
+    std::shared_ptr<stage_stats> io;
+    std::shared_ptr<stage_stats> load;
+    std::shared_ptr<stage_stats> read;
+    std::shared_ptr<stage_stats> decode;
+    std::shared_ptr<stage_stats> transfer;
+    std::shared_ptr<stage_stats> consumer;
+
+    double elapsed_sec() const;
+    std::string verdict() const;
+    nlohmann::json to_json() const;
+
+private:
+    const int                               _decode_threads;
+    const int                               _read_threads;
+    std::chrono::steady_clock::time_point   _start;
+};
@@ -35,8 +35,8 @@ audio_classifier::audio_classifier(nlohmann::json js) :
 
 void audio_classifier::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf)
 {
-    vector<char>& datum_in  = in_buf[0]->get_item(idx);
-    vector<char>& target_in = in_buf[1]->get_item(idx);
+    const buffer_item& datum_in  = in_buf[0]->get_item(idx);
+    const buffer_item& target_in = in_buf[1]->get_item(idx);
 
     char* datum_out  = out_buf[0]->get_item(idx);
     char* target_out = out_buf[1]->get_item(idx);
@@ -31,7 +31,7 @@ audio_only::audio_only(nlohmann::json js) :
 
 void audio_only::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf)
 {
-    vector<char>& datum_in  = in_buf[0]->get_item(idx);
+    const buffer_item& datum_in  = in_buf[0]->get_item(idx);
     char* datum_out  = out_buf[0]->get_item(idx);
 
     if (datum_in.size() == 0) {
@@ -36,8 +36,8 @@ image_localization::image_localization(nlohmann::json js) :
 }
 
 void image_localization::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf) {
-    vector<char>& datum_in  = in_buf[0]->get_item(idx);
-    vector<char>& target_in = in_buf[1]->get_item(idx);
+    const buffer_item& datum_in  = in_buf[0]->get_item(idx);
+    const buffer_item& target_in = in_buf[1]->get_item(idx);
 
     char* datum_out             = out_buf[0]->get_item(idx);
     char* y_bbtargets_out       = out_buf[1]->get_item(idx);
@@ -29,15 +29,18 @@ python_backend::python_backend(PyObject* py_obj_backend,
         throw std::runtime_error("Python Backend object does not exist");
     }
 
+    // the loader calls in here from threads that do not hold the GIL
+    PyGILState_STATE gstate;
+    gstate = PyGILState_Ensure();
+
     Py_INCREF(_py_obj_backend);
     _f_consume = PyObject_GetAttrString(_py_obj_backend, "consume");
 
     if (!PyCallable_Check(_f_consume)) {
+        PyGILState_Release(gstate);
         throw std::runtime_error("Backend 'consume' function does not exist or is not callable");
     }
 
-    PyGILState_STATE gstate;
-    gstate = PyGILState_Ensure();
     PyOS_sighandler_t sighandler = PyOS_getsig(SIGINT);
     import_array();
     PyOS_setsig(SIGINT, sighandler);
@@ -182,9 +185,8 @@ void python_backend::wrap_buffer_pool(PyObject *list, buffer_out *buf, int bufId
     if (hdItem == NULL) {
         throw std::runtime_error("Bad Index");
     }
-    if (hdItem != Py_None) {
-        return;
-    }
+    // rewrap every time: the pool has more host buffers than the backend
+    // has device buffers, so bufIdx does not always map to the same one
 
     // For now, we will collapse everything into two dimensions
     int all_dims = std::accumulate(st.get_shape().begin(),
@@ -49,8 +49,8 @@ public:
     }
 
     virtual ~thread_pool() {
+        join();
         for (auto t : _threads) {
-            t->join();
             delete t;
         }
         delete[] _stopped;
@@ -75,9 +75,13 @@ public:
         return true;
     }
 
+    // Derived pools whose threads use their own members must join in
+    // their destructor, before those members are destroyed.
     void join() {
         for (auto t : _threads) {
-            t->join();
+            if (t->joinable()) {
+                t->join();
+            }
         }
     }
 
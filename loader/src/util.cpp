@@ -68,6 +68,24 @@ vector<string> nervana::split(const string& src, char delimiter)
     return rc;
 }
 
+void nervana::fnv1a(uint64_t& h, const void* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+}
+
+int64_t nervana::mtime_ns(const struct stat& stats)
+{
+#ifdef __APPLE__
+    const struct timespec& t = stats.st_mtimespec;
+#else
+    const struct timespec& t = stats.st_mtim;
+#endif
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
 int nervana::LevenshteinDistance(const string& s, const string& t)
 {
     // degenerate cases
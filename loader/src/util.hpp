@@ -15,10 +15,13 @@
 
 #pragma once
 
+#include <sys/stat.h>
+
 #include <iostream>
 #include <sstream>
 #include <cassert>
 #include <vector>
+#include <cstdint>
 
 
 namespace nervana {
@@ -65,6 +68,13 @@ namespace nervana {
 
     int LevenshteinDistance(const std::string& s1, const std::string& s2);
 
+    // adds `size` bytes to the 64 bit FNV-1a hash `h`, which starts at
+    // 0xcbf29ce484222325.  Stable across runs and builds, unlike std::hash.
+    void fnv1a(uint64_t& h, const void* data, size_t size);
+
+    // the modification time in `stats` in nanoseconds since the epoch
+    int64_t mtime_ns(const struct stat& stats);
+
     template<typename CharT, typename TraitsT = std::char_traits<CharT> >
     class memstream : public std::basic_streambuf<CharT, TraitsT> {
     public:
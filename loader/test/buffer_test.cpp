@@ -87,3 +87,79 @@ TEST(buffer, read_exception) {
         ASSERT_STREQ("expect me", e.what());
     }
 }
+
+vector<string> sorted_copy(vector<string> words) {
+    std::sort(words.begin(), words.end());
+    return words;
+}
+
+TEST(buffer, shuffle_exception) {
+    // an exception stays with its record when the buffer is shuffled
+    buffer_in b;
+    setup_buffer_exception(b);
+    b.shuffle(3);
+
+    int thrown = 0;
+    vector<string> words;
+    for (int i = 0; i < b.get_item_count(); i++) {
+        try {
+            words.push_back(string(b.get_item(i).data(), b.get_item(i).size()));
+        } catch (std::exception& e) {
+            thrown++;
+        }
+    }
+    ASSERT_EQ(1, thrown);
+    ASSERT_EQ(vector<string>({"a", "c", "d"}), sorted_copy(words));
+}
+
+TEST(buffer, arena) {
+    // records read into a buffer are views of one shared allocation
+    buffer_in b;
+    read(b, "abc");
+    read(b, "defg");
+    ASSERT_TRUE(b.get_item(0).is_view());
+    ASSERT_TRUE(b.get_item(1).is_view());
+
+    // moving an item out keeps its bytes alive past a reset
+    buffer_item taken = std::move(b.get_item(1));
+    b.reset();
+    ASSERT_EQ(0, b.get_item_count());
+    read(b, "hij");
+    ASSERT_EQ("defg", string(taken.data(), taken.size()));
+    ASSERT_EQ("hij", string(b.get_item(0).data(), b.get_item(0).size()));
+}
+
+TEST(buffer, append_shuffled) {
+    // append takes the items of a shuffled buffer in their shuffled order
+    buffer_in b;
+    buffer_in c;
+    read(b, "first");
+    read(c, "abc");
+    read(c, "asd");
+    read(c, "hello");
+    read(c, "qwe");
+    c.shuffle(0);
+    vector<string> shuffled = buffer_to_vector_of_strings(c);
+
+    b.append(c);
+    ASSERT_EQ(0, c.get_item_count());
+    vector<string> expected = {"first"};
+    expected.insert(expected.end(), shuffled.begin(), shuffled.end());
+    ASSERT_EQ(expected, buffer_to_vector_of_strings(b));
+}
+
+TEST(buffer, move_item) {
+    // the last item fills the place of the one moved out
+    buffer_in b;
+    buffer_in dest;
+    setup_buffer_exception(b);
+    b.move_item(0, dest);
+    b.move_item(2, dest);
+    ASSERT_EQ(vector<string>({"a", "c"}), buffer_to_vector_of_strings(dest));
+    ASSERT_EQ(2, b.get_item_count());
+    ASSERT_EQ("d", string(b.get_item(0).data(), b.get_item(0).size()));
+    ASSERT_THROW(b.get_item(1), std::runtime_error);
+
+    b.move_item(1, dest);
+    ASSERT_THROW(dest.get_item(2), std::runtime_error);
+}
@@ -65,6 +65,10 @@ string tmp_file_repeating(uint size, uint x) {
     return tmpname;
 }
 
+string tmp_zero_file(uint size) {
+    return tmp_file_repeating(size, 0);
+}
+
 string tmp_manifest_file(uint num_records, vector<uint> sizes) {
     string tmpname = tmp_filename();
     ofstream f(tmpname);
@@ -150,3 +150,93 @@ TEST(manifest, uneven_records) {
         );
     }
 }
+
+TEST(manifest, shuffle_append) {
+    // appending a row to a shuffled manifest moves at most one other row
+    string filename = tmp_manifest_file(20, {4, 4});
+    nervana::manifest_csv before(filename, true);
+    {
+        ofstream f(filename, ios::app);
+        f << tmp_filename() << "," << tmp_filename() << endl;
+    }
+    nervana::manifest_csv after(filename, true);
+    ASSERT_EQ(21, after.objectCount());
+
+    int moved = 0;
+    for(size_t i = 0; i < before.objectCount(); i++) {
+        if((*(before.begin() + i))[0] != (*(after.begin() + i))[0]) {
+            moved++;
+        }
+    }
+    ASSERT_LE(moved, 1);
+}
+
+static string large_manifest(size_t rows, size_t ragged_row)
+{
+    // large enough to be parsed by several threads, with comments, empty
+    // lines and names with and without a directory
+    string filename = tmp_filename();
+    ofstream f(filename);
+    for(size_t i = 0; i < rows; i++) {
+        if(i % 1000 == 0) {
+            f << "# rows from " << i << "\n\n";
+        }
+        f << "/data/class" << i % 7 << "/image" << i << ".jpg,label" << i;
+        if(i == ragged_row) {
+            f << ",extra";
+        }
+        f << "\n";
+    }
+    return filename;
+}
+
+TEST(manifest, large) {
+    size_t rows = 300000;
+    nervana::manifest_csv manifest(large_manifest(rows, rows), false);
+    ASSERT_EQ(rows, manifest.objectCount());
+    ASSERT_EQ(2, manifest.fieldCount());
+
+    size_t i = 0;
+    for(auto it = manifest.begin(); it != manifest.end(); ++it, ++i) {
+        ASSERT_EQ("/data/class" + to_string(i % 7) + "/image" + to_string(i) + ".jpg", (*it)[0]);
+        ASSERT_EQ("label" + to_string(i), manifest.filename(i, 1));
+    }
+    ASSERT_EQ(rows, i);
+}
+
+TEST(manifest, large_uneven_records) {
+    // the line is counted across the ranges parsed by different threads
+    try {
+        nervana::manifest_csv manifest(large_manifest(300000, 250000), false);
+        FAIL();
+    } catch (std::exception& e) {
+        string expected = "at line: 250000, manifest file has a line with differing number of files (3) vs (2)";
+        ASSERT_EQ(expected, string(e.what()).substr(0, expected.size()));
+    }
+}
+
+TEST(manifest, inline_values) {
+    ASSERT_TRUE(nervana::manifest_csv::is_inline("@int:3"));
+    ASSERT_FALSE(nervana::manifest_csv::is_inline("/data/3.jpg"));
+    ASSERT_FALSE(nervana::manifest_csv::is_inline("@foo.jpg"));
+    ASSERT_FALSE(nervana::manifest_csv::is_inline("@int"));
+    ASSERT_TRUE(nervana::manifest_csv::is_inline("@base64:"));
+
+    ASSERT_EQ(vector<char>({7, 1, 0, 0}), nervana::manifest_csv::inline_value("@int:263"));
+    ASSERT_EQ(vector<char>({-1, -1, -1, -1}), nervana::manifest_csv::inline_value("@int:-1"));
+    ASSERT_EQ(vector<char>({'A', '/', 'B'}), nervana::manifest_csv::inline_value("@text:A/B"));
+    ASSERT_EQ(vector<char>({0, 1, 2, 3}), nervana::manifest_csv::inline_value("@base64:AAECAw=="));
+    ASSERT_EQ(vector<char>({'h', 'i', ',', '!'}), nervana::manifest_csv::inline_value("@base64:aGksIQ"));
+
+    ASSERT_THROW(nervana::manifest_csv::inline_value("@int:3x"), std::runtime_error);
+    ASSERT_THROW(nervana::manifest_csv::inline_value("@int:"), std::runtime_error);
+    ASSERT_THROW(nervana::manifest_csv::inline_value("@base64:a*b"), std::runtime_error);
+    ASSERT_THROW(nervana::manifest_csv::inline_value("@float:1.5"), std::runtime_error);
+
+    // inline fields are kept whole, slashes and all
+    string filename = tmp_filename();
+    ofstream(filename) << "/data/a.jpg,@text:AC/DC\n/data/b.jpg,@int:2\n";
+    nervana::manifest_csv manifest(filename, false);
+    ASSERT_EQ("@text:AC/DC", manifest.filename(0, 1));
+    ASSERT_EQ("@int:2", manifest.filename(1, 1));
+}
@@ -10,7 +10,7 @@ using namespace nervana;
 vector<string> buffer_to_vector_of_strings(buffer_in& b) {
     vector<string> words;
     for(auto i = 0; i != b.get_item_count(); ++i) {
-        vector<char>& s = b.get_item(i);
+        const buffer_item& s = b.get_item(i);
         words.push_back(string(s.data(), s.size()));
     }
 
@@ -0,0 +1,147 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <fstream>
+
+#include "gtest/gtest.h"
+#include "block_file.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static string temp_block_name()
+{
+    return "/tmp/test_block_file_" + to_string(getpid()) + ".block";
+}
+
+// two elements per record with sizes around the alignment, some empty
+static void fill_block(buffer_in_array& block, int records)
+{
+    for (int r = 0; r < records; r++) {
+        block[0]->add_item(vector<char>(r * 37 % 130, 'a' + r % 26));
+        block[1]->add_item(vector<char>(r % 3, 'A' + r % 26));
+    }
+}
+
+static void write_block(buffer_in_array& block, const string& name, uint32_t alignment)
+{
+    block_file::file_writer writer;
+    writer.open(name, alignment);
+    writer.write_all_records(block);
+    writer.close();
+}
+
+TEST(block_file, round_trip) {
+    string name = temp_block_name();
+    buffer_in_array expected(2);
+    fill_block(expected, 50);
+    write_block(expected, name, 64);
+
+    for (bool mapped : {true, false}) {
+        block_file::reader reader;
+        ASSERT_TRUE(reader.open(name, mapped));
+        ASSERT_EQ(50, reader.recordCount());
+        ASSERT_EQ(2, reader.elementCount());
+
+        buffer_in_array actual(2);
+        reader.read_all(actual);
+        ASSERT_EQ(50, actual[0]->get_item_count());
+        for (int i = 0; i < 50; i++) {
+            ASSERT_EQ(expected[0]->get_item(i), actual[0]->get_item(i));
+            ASSERT_EQ(expected[1]->get_item(i), actual[1]->get_item(i));
+            // views of the mapping, or of the one buffer the block was read into
+            ASSERT_TRUE(actual[0]->get_item(i).is_view());
+        }
+    }
+    remove(name.c_str());
+}
+
+TEST(block_file, random_access) {
+    string name = temp_block_name();
+    buffer_in_array expected(2);
+    fill_block(expected, 20);
+
+    for (uint32_t alignment : {64, 4096}) {
+        write_block(expected, name, alignment);
+        block_file::reader reader;
+        ASSERT_TRUE(reader.open(name));
+
+        buffer_in_array actual(2);
+        for (int r : {17, 3, 19, 0}) {
+            reader.read_record(r, actual);
+        }
+        int index = 0;
+        for (int r : {17, 3, 19, 0}) {
+            const buffer_item& item = actual[0]->get_item(index++);
+            ASSERT_EQ(expected[0]->get_item(r), item);
+            ASSERT_EQ(0, (uintptr_t)item.data() % alignment);
+        }
+        ASSERT_THROW(reader.read_record(20, actual), std::out_of_range);
+    }
+    remove(name.c_str());
+}
+
+TEST(block_file, missing_and_corrupt) {
+    string name = temp_block_name();
+    block_file::reader missing;
+    ASSERT_FALSE(missing.open(name));
+
+    buffer_in_array block(2);
+    fill_block(block, 10);
+    write_block(block, name, 64);
+    ASSERT_EQ(0, truncate(name.c_str(), 200));
+
+    block_file::reader truncated;
+    ASSERT_THROW(truncated.open(name), std::runtime_error);
+
+    // the last element placed far past the end of the file
+    write_block(block, name, 64);
+    block_file::header h;
+    block_file::entry e;
+    {
+        fstream f(name, ios::in | ios::out | ios::binary);
+        f.read((char*)&h, sizeof(h));
+        uint64_t last = h.index_offset + (h.record_count * h.element_count - 1) * sizeof(e);
+        f.seekg(last);
+        f.read((char*)&e, sizeof(e));
+        e.offset = ~0ULL - 1024;
+        f.seekp(last);
+        f.write((const char*)&e, sizeof(e));
+    }
+    for (bool mapped : {true, false}) {
+        block_file::reader corrupt;
+        ASSERT_THROW(corrupt.open(name, mapped), std::runtime_error);
+    }
+    remove(name.c_str());
+}
+
+TEST(block_file, unclosed_writer) {
+    // a writer that fails part way leaves no file behind
+    string name = temp_block_name();
+    {
+        buffer_in_array block(2);
+        fill_block(block, 3);
+        block[1]->set_exception(2, make_exception_ptr(runtime_error("bad record")));
+
+        block_file::file_writer writer;
+        writer.open(name);
+        ASSERT_THROW(writer.write_all_records(block), std::runtime_error);
+    }
+    ASSERT_FALSE(ifstream(name).good());
+    ASSERT_FALSE(ifstream(name + ".tmp").good());
+}
@@ -0,0 +1,87 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <set>
+
+#include "gtest/gtest.h"
+
+#include "helpers.hpp"
+#include "block_iterator_mixed.hpp"
+#include "block_iterator_sequential.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static shared_ptr<block_iterator_mixed> make_mixed(shared_ptr<block_loader> loader,
+                                                   uint blocks, size_t max_bytes = 0)
+{
+    auto source = make_shared<block_iterator_sequential>(loader);
+    return make_shared<block_iterator_mixed>(source, loader->blockSize(), loader->objectCount(),
+                                             blocks, max_bytes, 0);
+}
+
+TEST(block_iterator_mixed, epoch) {
+    // every epoch returns each record once, with both elements together
+    auto loader = make_shared<block_loader_alphabet>(5);
+    auto mixed = make_mixed(loader, 4);
+
+    for (int epoch = 0; epoch < 3; epoch++) {
+        buffer_in_array bp(2);
+        while (bp[0]->get_item_count() < (int)loader->objectCount()) {
+            int before = bp[0]->get_item_count();
+            mixed->read(bp);
+            ASSERT_LT(before, bp[0]->get_item_count());
+        }
+        vector<string> words_a = buffer_to_vector_of_strings(*bp[0]);
+        vector<string> words_b = buffer_to_vector_of_strings(*bp[1]);
+        ASSERT_EQ(loader->objectCount(), words_a.size());
+        ASSERT_EQ(words_a, words_b);
+        ASSERT_FALSE(sorted(words_a));
+        assert_vector_unique(words_a);
+        ASSERT_EQ(0, mixed->poolRecords());
+    }
+}
+
+TEST(block_iterator_mixed, mixes_blocks) {
+    // a read draws on every resident block, not only one
+    auto loader = make_shared<block_loader_alphabet>(5);
+    auto mixed = make_mixed(loader, 8);
+
+    set<char> blocks;
+    for (int i = 0; i < 4; i++) {
+        buffer_in_array bp(2);
+        mixed->read(bp);
+        ASSERT_EQ(5, bp[0]->get_item_count());
+        for (auto& word : buffer_to_vector_of_strings(*bp[0])) {
+            blocks.insert(word[0]);
+        }
+    }
+    // 8 resident blocks and one more per 5 records drawn
+    ASSERT_GT(blocks.size(), 4);
+    ASSERT_LE(blocks.size(), 12);
+}
+
+TEST(block_iterator_mixed, memory_bound) {
+    // blocks of 5 records of two 2 byte elements take 20 bytes
+    auto loader = make_shared<block_loader_alphabet>(5);
+    auto mixed = make_mixed(loader, 8, 20);
+
+    for (int i = 0; i < 10; i++) {
+        buffer_in_array bp(2);
+        mixed->read(bp);
+        ASSERT_EQ(5, bp[0]->get_item_count());
+        ASSERT_LT(mixed->poolBytes(), 40);
+    }
+}
@@ -14,31 +14,39 @@
 */
 
 #include <random>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <fstream>
 
 #include "gtest/gtest.h"
 #include "block_loader_cpio_cache.hpp"
+#include "cpio.hpp"
+#include "block_file.hpp"
+#include "helpers.hpp"
 
 using namespace std;
 using namespace nervana;
 
-string load_string(block_loader_cpio_cache cache) {
+string load_string(shared_ptr<block_loader_cpio_cache> cache) {
     // call loadBlock from cache and cast the resulting item to a uint
     buffer_in_array bp(2);  // 2 buffer_in:  1 for datum, 1 for target
 
-    cache.loadBlock(bp, 1);
+    cache->loadBlock(bp, 1);
 
-    vector<char>& x = bp[0]->get_item(0);
+    const buffer_item& x = bp[0]->get_item(0);
     string str(x.data(), x.size());
     return str;
 }
 
-block_loader_cpio_cache make_cache(const string& rootCacheDir,
-                                   const string& hash,
-                                   const string& version) {
-    block_loader_cpio_cache cache(
+shared_ptr<block_loader_cpio_cache> make_cache(const string& rootCacheDir,
+                                               const string& hash,
+                                               const string& version) {
+    return make_shared<block_loader_cpio_cache>(
         rootCacheDir, hash, version, make_shared<block_loader_random>(1)
     );
-    return cache;
 }
 
 TEST(block_loader_cpio_cache, integration) {
@@ -74,3 +82,355 @@ TEST(block_loader_cpio_cache, differnt_hash) {
         load_string(make_cache("/tmp", block_loader_random::randomString(), "version123"))
     );
 }
+
+TEST(block_loader_cpio_cache, mapped_items) {
+    // a block read back from the cache points into the mapped file and
+    // stays valid after the cache itself is gone
+    string hash = block_loader_random::randomString();
+    buffer_in_array first(2);
+    buffer_in_array second(2);
+    {
+        auto cache = make_cache("/tmp", hash, "version123");
+        cache->loadBlock(first, 1);
+        cache->loadBlock(second, 1);
+    }
+
+    ASSERT_FALSE(first[0]->get_item(0).is_view());
+    ASSERT_TRUE(second[0]->get_item(0).is_view());
+    ASSERT_TRUE(second[1]->get_item(0).is_view());
+    ASSERT_EQ(first[0]->get_item(0), second[0]->get_item(0));
+    ASSERT_EQ(first[1]->get_item(0), second[1]->get_item(0));
+}
+
+// record `r` of the dataset is "r<r>", loads are counted
+class block_loader_records : public block_loader {
+public:
+    block_loader_records(uint block_size, uint count) : block_loader(block_size), _count(count) {}
+
+    void loadBlock(buffer_in_array& dest, uint block_num)
+    {
+        loads++;
+        auto range = recordRange(block_num);
+        for (size_t r = range.first; r < range.second; r++) {
+            string s = "r" + to_string(r) + (edits.count(r) ? "v" + to_string(edits[r]) : "");
+            dest[0]->add_item(vector<char>(s.begin(), s.end()));
+            dest[1]->add_item(vector<char>(s.begin(), s.end()));
+        }
+    }
+    uint objectCount() { return _count; }
+
+    string fingerprint(size_t begin, size_t end)
+    {
+        if (!fingerprints) {
+            return "";
+        }
+        size_t h = begin * 31 + end;
+        for (auto& e : edits) {
+            if (e.first >= begin && e.first < end) {
+                h = h * 31 + e.first * 7 + e.second;
+            }
+        }
+        char fp[17];
+        snprintf(fp, sizeof(fp), "%016zx", h);
+        return fp;
+    }
+
+    int loads = 0;
+    bool fingerprints = false;
+    // records changed since the cache was written, by edit count
+    map<size_t, int> edits;
+
+private:
+    uint _count;
+};
+
+TEST(block_loader_cpio_cache, block_size_change) {
+    // a cache filled with one block size serves any other
+    string hash = block_loader_random::randomString();
+    {
+        auto source = make_shared<block_loader_records>(4, 22);
+        block_loader_cpio_cache cache("/tmp", hash, "version123", source);
+        for (uint i = 0; i < 4; i++) {
+            buffer_in_array bp(2);
+            cache.loadBlock(bp, i);
+        }
+        ASSERT_EQ(4, source->loads);
+    }
+
+    auto source = make_shared<block_loader_records>(6, 22);
+    block_loader_cpio_cache cache("/tmp", hash, "version123", source);
+    ASSERT_TRUE(cache.isCached(1));
+    ASSERT_FALSE(cache.isCached(2));
+    ASSERT_FALSE(cache.isCached(3));
+
+    buffer_in_array bp(2);
+    cache.loadBlock(bp, 1);
+    ASSERT_EQ(vector<string>({"r6", "r7", "r8", "r9", "r10", "r11"}), buffer_to_vector_of_strings(*bp[0]));
+    ASSERT_EQ(0, source->loads);
+
+    // records 12 to 15 of block 2 are cached, only 16 and 17 are written
+    buffer_in_array second(2);
+    cache.loadBlock(second, 2);
+    ASSERT_EQ(1, source->loads);
+    ASSERT_EQ(0, access(("/tmp/" + hash + "_version123/r16-2.block").c_str(), F_OK));
+
+    buffer_in_array again(2);
+    cache.loadBlock(again, 2);
+    ASSERT_EQ(1, source->loads);
+    ASSERT_EQ(vector<string>({"r12", "r13", "r14", "r15", "r16", "r17"}),
+              buffer_to_vector_of_strings(*again[1]));
+}
+
+TEST(block_loader_cpio_cache, fingerprint_change) {
+    // only the records whose fingerprint changed are built again
+    string hash = block_loader_random::randomString();
+    auto source = make_shared<block_loader_records>(4, 16);
+    source->fingerprints = true;
+    {
+        block_loader_cpio_cache cache("/tmp", hash, "version123", source);
+        for (uint i = 0; i < 4; i++) {
+            buffer_in_array bp(2);
+            cache.loadBlock(bp, i);
+        }
+    }
+    string stale = "/tmp/" + hash + "_version123/r4-4-" + source->fingerprint(4, 8) + ".block";
+    ASSERT_EQ(0, access(stale.c_str(), F_OK));
+
+    source->edits[5] = 1;
+    source->loads = 0;
+    block_loader_cpio_cache cache("/tmp", hash, "version123", source);
+    ASSERT_NE(0, access(stale.c_str(), F_OK));
+    ASSERT_TRUE(cache.isCached(0));
+    ASSERT_FALSE(cache.isCached(1));
+    ASSERT_TRUE(cache.isCached(2));
+
+    buffer_in_array bp(2);
+    cache.loadBlock(bp, 1);
+    ASSERT_EQ(1, source->loads);
+    ASSERT_EQ(vector<string>({"r4", "r5v1", "r6", "r7"}), buffer_to_vector_of_strings(*bp[0]));
+
+    for (uint i = 0; i < 4; i++) {
+        buffer_in_array again(2);
+        cache.loadBlock(again, i);
+    }
+    ASSERT_EQ(1, source->loads);
+}
+
+TEST(block_loader_cpio_cache, legacy_cpio) {
+    // a block cached as cpio by an older version is still used
+    string hash = block_loader_random::randomString();
+    auto cache = make_cache("/tmp", hash, "version123");
+
+    buffer_in_array legacy(2);
+    legacy[0]->add_item(vector<char>{'o', 'l', 'd'});
+    legacy[1]->add_item(vector<char>{'1'});
+    cpio::file_writer writer;
+    writer.open("/tmp/" + hash + "_version123/1-1.cpio");
+    writer.write_all_records(legacy);
+    writer.close();
+
+    ASSERT_EQ(load_string(cache), "old");
+}
+
+TEST(block_loader_cpio_cache, legacy_version) {
+    // the directory an older version named after the manifest mtime is
+    // taken over, and its blocks are read until the mtime changes or
+    // there is no legacy version any more
+    for (string changed : {"mtime2", ""}) {
+        string hash = block_loader_random::randomString();
+        string old_dir = "/tmp/" + hash + "_mtime1";
+        string dir = "/tmp/" + hash + "_records";
+        ASSERT_EQ(0, mkdir(old_dir.c_str(), S_IRWXU));
+
+        buffer_in_array legacy(2);
+        legacy[0]->add_item(vector<char>{'o', 'l', 'd'});
+        legacy[1]->add_item(vector<char>{'1'});
+        cpio::file_writer writer;
+        writer.open(old_dir + "/1-1.cpio");
+        writer.write_all_records(legacy);
+        writer.close();
+
+        auto make = [&](const string& legacy_version) {
+            return make_shared<block_loader_cpio_cache>(
+                "/tmp", hash, "records", make_shared<block_loader_random>(1),
+                true, "none", 0, 0, legacy_version);
+        };
+        {
+            auto cache = make("mtime1");
+            ASSERT_NE(0, access(old_dir.c_str(), F_OK));
+            ASSERT_TRUE(cache->isCached(1));
+            ASSERT_EQ(load_string(cache), "old");
+        }
+        ASSERT_EQ(load_string(make("mtime1")), "old");
+
+        // the block is built again
+        auto cache = make(changed);
+        ASSERT_NE(0, access((dir + "/1-1.cpio").c_str(), F_OK));
+        ASSERT_FALSE(cache->isCached(1));
+        ASSERT_NE(load_string(cache), "old");
+        ASSERT_EQ(0, access((dir + "/r1-1.block").c_str(), F_OK));
+    }
+}
+
+TEST(block_loader_cpio_cache, disk_budget) {
+    // an alphabet block of 4 records takes 656 bytes on disk, room for two
+    string hash = block_loader_random::randomString();
+    string dir = "/tmp/" + hash + "_version123/";
+    auto mbl = make_shared<block_loader_alphabet>(4);
+    block_loader_cpio_cache cache("/tmp", hash, "version123", mbl, true, "none", 1500);
+
+    for (uint block_num : {0, 1, 0, 2}) {
+        // reading block 0 again leaves block 1 as the least recently used
+        buffer_in_array bp(2);
+        cache.loadBlock(bp, block_num);
+    }
+
+    ASSERT_EQ(0, access((dir + "r0-4.block").c_str(), F_OK));
+    ASSERT_NE(0, access((dir + "r4-4.block").c_str(), F_OK));
+    ASSERT_EQ(0, access((dir + "r8-4.block").c_str(), F_OK));
+    ASSERT_LE(cache.cacheBytes(), 1500u);
+    // an evicted block is no longer looked for in the cache
+    ASSERT_FALSE(cache.isCached(1));
+
+    // blocks left by an earlier run count against the budget
+    block_loader_cpio_cache again("/tmp", hash, "version123", mbl, true, "none", 1500);
+    ASSERT_EQ(cache.cacheBytes(), again.cacheBytes());
+}
+
+static size_t directory_bytes(const string& dir)
+{
+    size_t bytes = 0;
+    DIR* d = opendir(dir.c_str());
+    while (struct dirent* ent = readdir(d)) {
+        struct stat st;
+        string name = ent->d_name;
+        if (name.size() > 6 && name.substr(name.size() - 6) == ".block" &&
+            stat((dir + name).c_str(), &st) == 0) {
+            bytes += st.st_size;
+        }
+    }
+    closedir(d);
+    return bytes;
+}
+
+TEST(block_loader_cpio_cache, shared_disk_budget) {
+    // blocks written by another process sharing the directory count
+    // against the budget once they are seen
+    string hash = block_loader_random::randomString();
+    string dir = "/tmp/" + hash + "_version123/";
+    auto mbl = make_shared<block_loader_alphabet>(4);
+    block_loader_cpio_cache first("/tmp", hash, "version123", mbl, true, "none", 1500);
+    block_loader_cpio_cache second("/tmp", hash, "version123", mbl, true, "none", 1500);
+
+    for (uint block_num : {0, 1}) {
+        buffer_in_array bp(2);
+        first.loadBlock(bp, block_num);
+    }
+    // the directory is scanned again at most once a second
+    this_thread::sleep_for(chrono::milliseconds(1100));
+    buffer_in_array bp(2);
+    second.loadBlock(bp, 2);
+
+    ASSERT_EQ(0, access((dir + "r8-4.block").c_str(), F_OK));
+    ASSERT_LE(second.cacheBytes(), 1500u);
+    ASSERT_LE(directory_bytes(dir), 1500u);
+}
+
+TEST(block_loader_cpio_cache, shared_probe) {
+    // a block another process wrote after the scan is found without
+    // scanning the directory again
+    string hash = block_loader_random::randomString();
+    for (bool fingerprints : {false, true}) {
+        auto source = make_shared<block_loader_records>(4, 16);
+        source->fingerprints = fingerprints;
+        string version = fingerprints ? "fp" : "plain";
+        block_loader_cpio_cache first("/tmp", hash, version, source);
+        block_loader_cpio_cache second("/tmp", hash, version, source);
+
+        for (uint block_num : {0, 1, 2}) {
+            buffer_in_array bp(2);
+            first.loadBlock(bp, block_num);
+        }
+        ASSERT_EQ(3, source->loads);
+        for (uint block_num : {0, 1, 2}) {
+            buffer_in_array bp(2);
+            second.loadBlock(bp, block_num);
+            ASSERT_EQ("r" + to_string(block_num * 4), buffer_to_vector_of_strings(*bp[0])[0]);
+        }
+        ASSERT_EQ(3, source->loads);
+        ASSERT_TRUE(second.isCached(2));
+    }
+}
+
+TEST(block_loader_cpio_cache, write_behind) {
+    // a missed block is written by the background thread, and served from
+    // the write queue until it is on disk
+    string hash = block_loader_random::randomString();
+    string dir = "/tmp/" + hash + "_version123/";
+    string first;
+    {
+        auto cache = make_shared<block_loader_cpio_cache>(
+            "/tmp", hash, "version123", make_shared<block_loader_random>(1),
+            true, "none", 0, 1 << 20);
+        first = load_string(cache);
+        ASSERT_EQ(first, load_string(cache));
+        cache->flush();
+        ASSERT_EQ(0, access((dir + "r1-1.block").c_str(), F_OK));
+        ASSERT_EQ(first, load_string(cache));
+
+        // destroying the cache writes what is still queued
+        buffer_in_array bp(2);
+        cache->loadBlock(bp, 2);
+    }
+    ASSERT_EQ(0, access((dir + "r2-1.block").c_str(), F_OK));
+    ASSERT_EQ(first, load_string(make_cache("/tmp", hash, "version123")));
+}
+
+static void write_claim(const string& filename, pid_t pid)
+{
+    char host[256] = {0};
+    gethostname(host, sizeof(host) - 1);
+    ofstream f(filename);
+    f << host << " " << pid << "\n";
+}
+
+TEST(block_loader_cpio_cache, claimed_block) {
+    // another process holds the claim on block 1, so it is not loaded
+    // again but taken from the file that process publishes
+    string hash = block_loader_random::randomString();
+    string dir = "/tmp/" + hash + "_version123/";
+    auto cache = make_cache("/tmp", hash, "version123");
+    write_claim(dir + "r1-1.block.claim", getpid());
+
+    thread publisher([&] {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        buffer_in_array block(2);
+        block[0]->add_item(vector<char>{'o', 't', 'h', 'e', 'r'});
+        block[1]->add_item(vector<char>{'1'});
+        block_file::file_writer writer;
+        writer.open(dir + "r1-1.block");
+        writer.write_all_records(block);
+        writer.close();
+        unlink((dir + "r1-1.block.claim").c_str());
+    });
+    ASSERT_EQ("other", load_string(cache));
+    publisher.join();
+}
+
+TEST(block_loader_cpio_cache, stale_claim) {
+    // a claim left by a process that died is taken over
+    string hash = block_loader_random::randomString();
+    string dir = "/tmp/" + hash + "_version123/";
+    auto cache = make_cache("/tmp", hash, "version123");
+
+    pid_t child = fork();
+    if (child == 0) {
+        _exit(0);
+    }
+    waitpid(child, nullptr, 0);
+    write_claim(dir + "r1-1.block.claim", child);
+
+    string first = load_string(cache);
+    ASSERT_EQ(first, load_string(cache));
+    ASSERT_NE(0, access((dir + "r1-1.block.claim").c_str(), F_OK));
+}
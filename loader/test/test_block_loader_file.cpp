@@ -15,8 +15,16 @@
 
 #include "gtest/gtest.h"
 #include "block_loader_file.hpp"
+#include "block_loader_cpio_cache.hpp"
+#include "cpio.hpp"
 #include "csv_manifest_maker.hpp"
 
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <sys/stat.h>
+
 using namespace std;
 using namespace nervana;
 
@@ -118,3 +126,225 @@ TEST(blocked_file_loader, subset_object_count) {
 
     ASSERT_EQ(blf.objectCount(), 2 + 2 + 1);
 }
+
+TEST(blocked_file_loader, io_queue_depth) {
+    // reading a block through the io_engine gives the same records, in
+    // the same order, as reading it one file at a time
+    auto manifest = make_shared<nervana::manifest_csv>(tmp_manifest_file(12, {1000, 20}), false);
+    block_loader_file serial(manifest, 1.0, 5);
+    block_loader_file async(manifest, 1.0, 5, 4);
+
+    for(uint block = 0; block < serial.blockCount(); block++) {
+        buffer_in_array expected(2);
+        buffer_in_array actual(2);
+        serial.loadBlock(expected, block);
+        async.loadBlock(actual, block);
+
+        ASSERT_EQ(expected[0]->get_item_count(), actual[0]->get_item_count());
+        for(int i = 0; i < expected[0]->get_item_count(); i++) {
+            ASSERT_EQ(expected[0]->get_item(i), actual[0]->get_item(i));
+            ASSERT_EQ(expected[1]->get_item(i), actual[1]->get_item(i));
+        }
+    }
+}
+
+TEST(blocked_file_loader, io_queue_depth_threads) {
+    // several reader threads share one loader, each reading its own blocks
+    auto manifest = make_shared<nervana::manifest_csv>(tmp_manifest_file(40, {1000, 20}), false);
+    block_loader_file serial(manifest, 1.0, 5);
+    block_loader_file async(manifest, 1.0, 5, 4);
+
+    vector<int> mismatches(4, 0);
+    vector<thread> readers;
+    for(int t = 0; t < 4; t++) {
+        readers.emplace_back([&, t] {
+            for(int pass = 0; pass < 10; pass++) {
+                for(uint block = t; block < async.blockCount(); block += 4) {
+                    buffer_in_array expected(2);
+                    buffer_in_array actual(2);
+                    serial.loadBlock(expected, block);
+                    async.loadBlock(actual, block);
+                    for(int i = 0; i < expected[0]->get_item_count(); i++) {
+                        mismatches[t] += !(expected[0]->get_item(i) == actual[0]->get_item(i));
+                    }
+                }
+            }
+        });
+    }
+    for(auto& r : readers) {
+        r.join();
+    }
+    ASSERT_EQ(vector<int>(4, 0), mismatches);
+}
+
+TEST(blocked_file_loader, io_queue_depth_exception) {
+    block_loader_file blf(
+        make_shared<nervana::manifest_csv>(tmp_manifest_file_with_invalid_filename(), false),
+        1.0,
+        1,
+        8
+    );
+
+    buffer_in_array bp(2);
+    blf.loadBlock(bp, 0);
+
+    try {
+        bp[0]->get_item(0);
+        FAIL();
+    } catch (std::exception& e) {
+        ASSERT_EQ(string("Could not find "), string(e.what()).substr(0, 15));
+    }
+}
+
+TEST(blocked_file_loader, fingerprint) {
+    // the fingerprint of a range of records follows their manifest rows
+    string filename = tmp_manifest_file(8, {16, 16});
+    block_loader_file blf(make_shared<nervana::manifest_csv>(filename, false), 1.0, 4);
+    string first = blf.fingerprint(0, 4);
+    string second = blf.fingerprint(4, 8);
+    ASSERT_EQ(16, first.size());
+    ASSERT_NE(first, second);
+
+    // rows appended to the manifest leave the existing fingerprints alone
+    {
+        ofstream f(filename, ios::app);
+        f << tmp_filename() << "," << tmp_filename() << endl;
+    }
+    block_loader_file appended(make_shared<nervana::manifest_csv>(filename, false), 1.0, 4);
+    ASSERT_EQ(first, appended.fingerprint(0, 4));
+    ASSERT_EQ(second, appended.fingerprint(4, 8));
+    ASSERT_NE(appended.fingerprint(4, 8), appended.fingerprint(4, 9));
+}
+
+TEST(blocked_file_loader, fingerprint_files) {
+    // with fingerprint_files a source file changed in place is noticed
+    auto manifest = make_shared<nervana::manifest_csv>(tmp_manifest_file(8, {16, 16}), false);
+    block_loader_file names(manifest, 1.0, 4);
+    block_loader_file files(manifest, 1.0, 4, 1, true);
+    string names_before = names.fingerprint(0, 4);
+    string first = files.fingerprint(0, 4);
+    string second = files.fingerprint(4, 8);
+
+    ofstream((*(manifest->begin() + 1))[0], ios::app) << "longer";
+
+    ASSERT_EQ(names_before, names.fingerprint(0, 4));
+    ASSERT_NE(first, files.fingerprint(0, 4));
+    ASSERT_EQ(second, files.fingerprint(4, 8));
+}
+
+static string inline_manifest(uint records, int label_offset)
+{
+    // files of 16 bytes with their labels and transcripts inline
+    string filename = tmp_filename();
+    ofstream f(filename);
+    for(uint i = 0; i < records; i++) {
+        f << tmp_zero_file(16) << ",@int:" << i + label_offset << ",@text:RECORD " << i << "\n";
+    }
+    return filename;
+}
+
+TEST(blocked_file_loader, inline_values) {
+    // inline fields are loaded as they are, with or without the io_engine
+    auto manifest = make_shared<nervana::manifest_csv>(inline_manifest(6, 0), false);
+    for(int depth : {1, 4}) {
+        block_loader_file blf(manifest, 1.0, 4, depth);
+        buffer_in_array bp(3);
+        blf.loadBlock(bp, 1);
+        ASSERT_EQ(2, bp[0]->get_item_count());
+        for(int i = 0; i < 2; i++) {
+            ASSERT_EQ(16, bp[0]->get_item(i).size());
+            ASSERT_EQ(4 + i, *(int*)bp[1]->get_item(i).data());
+            const buffer_item& text = bp[2]->get_item(i);
+            ASSERT_EQ("RECORD " + to_string(4 + i), string(text.data(), text.size()));
+        }
+    }
+
+    // a malformed value fails its record only
+    string filename = tmp_filename();
+    ofstream(filename) << tmp_zero_file(16) << ",@int:x\n" << tmp_zero_file(16) << ",@int:1\n";
+    for(int depth : {1, 4}) {
+        block_loader_file blf(make_shared<nervana::manifest_csv>(filename, false), 1.0, 2, depth);
+        buffer_in_array bp(2);
+        blf.loadBlock(bp, 0);
+        ASSERT_THROW(bp[1]->get_item(0), std::runtime_error);
+        ASSERT_EQ(1, *(int*)bp[1]->get_item(1).data());
+    }
+}
+
+TEST(blocked_file_loader, inline_values_cached) {
+    // inline values go through the cache, and editing one in the
+    // manifest builds only its records again
+    string filename = inline_manifest(8, 0);
+    string hash = block_loader_random::randomString();
+    auto load = [&](uint block) {
+        auto blf = make_shared<block_loader_file>(make_shared<nervana::manifest_csv>(filename, false), 1.0, 4);
+        block_loader_cpio_cache cache("/tmp", hash, "records", blf);
+        buffer_in_array bp(3);
+        cache.loadBlock(bp, block);
+        return *(int*)bp[1]->get_item(1).data();
+    };
+    ASSERT_EQ(1, load(0));
+    ASSERT_EQ(5, load(1));
+    ASSERT_EQ(1, load(0));
+
+    ifstream in(filename);
+    stringstream rows;
+    rows << in.rdbuf();
+    string text = rows.str();
+    text.replace(text.find(",@int:5,"), 8, ",@int:50,");
+    ofstream(filename) << text;
+
+    ASSERT_EQ(1, load(0));
+    ASSERT_EQ(50, load(1));
+}
+
+TEST(blocked_file_loader, legacy_cache_shuffled) {
+    // blocks cached by older versions from a manifest shuffled with
+    // std::shuffle hold other rows than the blocks of the same number now,
+    // so they are not adopted and every record is read once per epoch
+    string filename = tmp_manifest_file(16, {16, 16});
+    auto unshuffled = make_shared<nervana::manifest_csv>(filename, false);
+    ASSERT_EQ(unshuffled->version(), unshuffled->legacy_version());
+
+    auto manifest = make_shared<nervana::manifest_csv>(filename, true);
+    ASSERT_EQ("", manifest->legacy_version());
+    string hash = block_loader_random::randomString();
+    string old_dir = "/tmp/" + hash + "_" + manifest->version();
+    ASSERT_EQ(0, mkdir(old_dir.c_str(), S_IRWXU));
+
+    // the old order of the rows, and every other block of it cached
+    vector<uint> rows(16);
+    for (uint i = 0; i < rows.size(); i++) {
+        rows[i] = i;
+    }
+    std::shuffle(rows.begin(), rows.end(), std::mt19937(0));
+    for (uint block : {0, 2}) {
+        buffer_in_array legacy(2);
+        for (uint i = block * 4; i < block * 4 + 4; i++) {
+            for (uint j = 0; j < 2; j++) {
+                vector<uint> data(4, rows[i] * 2 + j);
+                legacy[j]->add_item(vector<char>((char*)data.data(), (char*)(data.data() + 4)));
+            }
+        }
+        cpio::file_writer writer;
+        writer.open(old_dir + "/" + to_string(block) + "-4.cpio");
+        writer.write_all_records(legacy);
+        writer.close();
+    }
+
+    auto blf = make_shared<block_loader_file>(manifest, 1.0, 4);
+    block_loader_cpio_cache cache("/tmp", hash, "records", blf, true, "none", 0, 0,
+                                  manifest->legacy_version());
+    vector<uint> seen;
+    for (uint block = 0; block < 4; block++) {
+        buffer_in_array bp(2);
+        cache.loadBlock(bp, block);
+        for (int i = 0; i < bp[0]->get_item_count(); i++) {
+            seen.push_back(*(uint*)bp[0]->get_item(i).data() / 2);
+        }
+    }
+    sort(seen.begin(), seen.end());
+    for (uint i = 0; i < rows.size(); i++) {
+        ASSERT_EQ(i, seen[i]);
+    }
+}
@@ -0,0 +1,157 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "gtest/gtest.h"
+
+#include "helpers.hpp"
+#include "block_loader_memory_cache.hpp"
+#include "block_loader_prefetch.hpp"
+#include "block_loader_file.hpp"
+#include "csv_manifest_maker.hpp"
+#include "block_iterator_shuffled.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static vector<string> load_strings(block_loader& loader, uint block_num)
+{
+    buffer_in_array bp(2);
+    loader.loadBlock(bp, block_num);
+    return buffer_to_vector_of_strings(*bp[0]);
+}
+
+TEST(block_loader_memory_cache, hit) {
+    // block_loader_random returns new data on every call, the same data
+    // twice means it came from memory
+    block_loader_memory_cache cache(make_shared<block_loader_random>(4), 1 << 20);
+
+    auto first = load_strings(cache, 1);
+    ASSERT_EQ(first, load_strings(cache, 1));
+    ASSERT_NE(first, load_strings(cache, 2));
+    ASSERT_EQ(1, cache.hits());
+    ASSERT_EQ(2, cache.misses());
+    ASSERT_GT(cache.bytes(), 0u);
+}
+
+TEST(block_loader_memory_cache, evicts_least_recently_used) {
+    // an alphabet block of 4 records is 4 * 2 * 2 bytes, room for two
+    block_loader_memory_cache cache(make_shared<block_loader_alphabet>(4), 40);
+
+    load_strings(cache, 0);
+    load_strings(cache, 1);
+    // touch block 0 so block 1 is the one to go
+    load_strings(cache, 0);
+    load_strings(cache, 2);
+    ASSERT_EQ(1, cache.evictions());
+    ASSERT_EQ(32u, cache.bytes());
+
+    load_strings(cache, 0);
+    ASSERT_EQ(2, cache.hits());
+    ASSERT_EQ(vector<string>({"Ba", "Bb", "Bc", "Bd"}), load_strings(cache, 1));
+    ASSERT_EQ(4, cache.misses());
+}
+
+TEST(block_loader_memory_cache, over_budget) {
+    block_loader_memory_cache cache(make_shared<block_loader_random>(4), 10);
+
+    ASSERT_NE(load_strings(cache, 0), load_strings(cache, 0));
+    ASSERT_EQ(0, cache.hits());
+    ASSERT_EQ(0u, cache.bytes());
+}
+
+TEST(block_loader_memory_cache, shuffled) {
+    // the second epoch comes from memory in its own shuffled order
+    auto mbl = make_shared<block_loader_alphabet>(5);
+    auto cache = make_shared<block_loader_memory_cache>(mbl, 1 << 20);
+    auto pbl = make_shared<block_loader_prefetch>(cache, 2);
+    block_iterator_shuffled expected(mbl, 7);
+    block_iterator_shuffled actual(pbl, 7, 3);
+
+    for(uint i = 0; i < mbl->blockCount() * 2; ++i) {
+        buffer_in_array a(2);
+        buffer_in_array b(2);
+        expected.read(a);
+        actual.read(b);
+        ASSERT_EQ(buffer_to_vector_of_strings(*a[0]), buffer_to_vector_of_strings(*b[0]));
+        ASSERT_EQ(buffer_to_vector_of_strings(*a[1]), buffer_to_vector_of_strings(*b[1]));
+    }
+    ASSERT_EQ(mbl->blockCount(), cache->misses());
+    ASSERT_EQ(mbl->blockCount(), cache->hits());
+}
+
+TEST(block_loader_memory_cache, file_blocks) {
+    // blocks read into arena chunks count their item bytes only, and
+    // come back the same from memory
+    auto manifest = make_shared<nervana::manifest_csv>(tmp_manifest_file(20, {1000, 20}), false);
+    block_loader_file serial(manifest, 1.0, 5);
+    // room for two blocks of 5 records of 1020 bytes
+    block_loader_memory_cache cache(make_shared<block_loader_file>(manifest, 1.0, 5, 4), 10200);
+
+    for(uint block = 0; block < 4; block++) {
+        buffer_in_array bp(2);
+        cache.loadBlock(bp, block);
+    }
+    ASSERT_EQ(2, cache.evictions());
+    ASSERT_EQ(10200u, cache.bytes());
+
+    for(uint block : {2, 3}) {
+        buffer_in_array expected(2);
+        buffer_in_array actual(2);
+        serial.loadBlock(expected, block);
+        cache.loadBlock(actual, block);
+        for(int i = 0; i < expected[0]->get_item_count(); i++) {
+            ASSERT_EQ(expected[0]->get_item(i), actual[0]->get_item(i));
+            ASSERT_EQ(expected[1]->get_item(i), actual[1]->get_item(i));
+        }
+    }
+    ASSERT_EQ(2, cache.hits());
+}
+
+// every item is a view into one large allocation per block
+class block_loader_views : public block_loader {
+public:
+    block_loader_views() : block_loader(2) {}
+
+    void loadBlock(buffer_in_array& dest, uint block_num)
+    {
+        auto chunk = shared_ptr<char>(new char[1 << 20](), default_delete<char[]>());
+        chunks.push_back(chunk);
+        for (auto d : dest) {
+            for (int i = 0; i < 2; i++) {
+                d->add_item(buffer_item(chunk.get() + i * 8, 8, chunk));
+            }
+        }
+    }
+    uint objectCount() { return 8; }
+
+    vector<weak_ptr<char>> chunks;
+};
+
+TEST(block_loader_memory_cache, views_not_pinned) {
+    // a cached block keeps its own bytes, not the memory it was read into
+    auto source = make_shared<block_loader_views>();
+    block_loader_memory_cache cache(source, 1 << 10);
+    {
+        buffer_in_array bp(2);
+        cache.loadBlock(bp, 0);
+    }
+    ASSERT_TRUE(source->chunks[0].expired());
+    ASSERT_EQ(32u, cache.bytes());
+
+    buffer_in_array bp(2);
+    cache.loadBlock(bp, 0);
+    ASSERT_EQ(1, cache.hits());
+    ASSERT_EQ(string(8, '\0'), string(bp[1]->get_item(1).data(), 8));
+}
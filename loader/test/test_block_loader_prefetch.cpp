@@ -0,0 +1,87 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "gtest/gtest.h"
+
+#include "helpers.hpp"
+#include "block_loader_prefetch.hpp"
+#include "block_iterator_sequential.hpp"
+#include "block_iterator_shuffled.hpp"
+
+using namespace std;
+using namespace nervana;
+
+TEST(block_loader_prefetch, sequential) {
+    // reading ahead must not change the order blocks come out in, even
+    // across an epoch boundary
+    auto mbl = make_shared<block_loader_alphabet>(5);
+    auto stats = make_shared<stage_stats>();
+    auto pbl = make_shared<block_loader_prefetch>(mbl, 4, stats);
+    block_iterator_sequential expected(mbl);
+    block_iterator_sequential actual(pbl, 6);
+
+    for(uint i = 0; i < mbl->blockCount() + 10; ++i) {
+        buffer_in_array a(2);
+        buffer_in_array b(2);
+        expected.read(a);
+        actual.read(b);
+        ASSERT_EQ(buffer_to_vector_of_strings(*a[0]), buffer_to_vector_of_strings(*b[0]));
+        ASSERT_EQ(buffer_to_vector_of_strings(*a[1]), buffer_to_vector_of_strings(*b[1]));
+    }
+    // every block handed out is counted, on whichever thread it was loaded
+    ASSERT_LE(mbl->blockCount() + 10, stats->items);
+    ASSERT_EQ(0, stats->exceptions);
+}
+
+TEST(block_loader_prefetch, shuffled) {
+    // same seed, same blocks in the same order with or without read ahead
+    auto mbl = make_shared<block_loader_alphabet>(5);
+    auto pbl = make_shared<block_loader_prefetch>(mbl, 3);
+    block_iterator_shuffled expected(mbl, 7);
+    block_iterator_shuffled actual(pbl, 7, 4);
+
+    for(uint i = 0; i < mbl->blockCount() * 2 + 3; ++i) {
+        buffer_in_array a(2);
+        buffer_in_array b(2);
+        expected.read(a);
+        actual.read(b);
+        ASSERT_EQ(buffer_to_vector_of_strings(*a[0]), buffer_to_vector_of_strings(*b[0]));
+    }
+
+    // a reset mid epoch throws away the blocks read ahead for the old order
+    expected.reset();
+    actual.reset();
+    buffer_in_array a(2);
+    buffer_in_array b(2);
+    expected.read(a);
+    actual.read(b);
+    ASSERT_EQ(buffer_to_vector_of_strings(*a[0]), buffer_to_vector_of_strings(*b[0]));
+}
+
+TEST(block_loader_prefetch, appends) {
+    // like any block_loader, loaded records are appended to dest
+    auto mbl = make_shared<block_loader_alphabet>(5);
+    block_loader_prefetch pbl(mbl, 2);
+    buffer_in_array bp(2);
+
+    pbl.loadBlock(bp, 0);
+    pbl.prefetch({1, 2});
+    pbl.loadBlock(bp, 1);
+    pbl.loadBlock(bp, 2);
+
+    vector<string> words = buffer_to_vector_of_strings(*bp[0]);
+    ASSERT_EQ(words.size(), 15);
+    ASSERT_EQ(sorted(words), true);
+}
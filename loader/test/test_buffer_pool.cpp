@@ -0,0 +1,138 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <thread>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "buffer_pool_in.hpp"
+
+using namespace std;
+using namespace nervana;
+
+TEST(buffer_pool, depth) {
+    buffer_pool_in pool(1, 3);
+    ASSERT_EQ(pool.count(), 3);
+    ASSERT_TRUE(pool.empty());
+
+    // a producer can fill every slot before the consumer takes any
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(pool.wait_for_not_full());
+        pool.get_for_write();
+        pool.advance_write_pos();
+    }
+    ASSERT_TRUE(pool.full());
+
+    ASSERT_TRUE(pool.wait_for_not_empty());
+    pool.get_for_read();
+    pool.advance_read_pos();
+    ASSERT_FALSE(pool.full());
+
+    ASSERT_THROW(buffer_pool_in(1, 0), invalid_argument);
+}
+
+TEST(buffer_pool, ordering) {
+    // a single producer and a single consumer must see slots in order
+    const int count = 100;
+    buffer_pool_in pool(1, 4);
+
+    thread producer([&]{
+        for (int i = 0; i < count; ++i) {
+            ASSERT_TRUE(pool.wait_for_not_full());
+            string s = to_string(i);
+            pool.get_for_write()[0]->add_item(vector<char>(s.begin(), s.end()));
+            pool.advance_write_pos();
+        }
+    });
+
+    for (int i = 0; i < count; ++i) {
+        ASSERT_TRUE(pool.wait_for_not_empty());
+        const buffer_item& item = pool.get_for_read()[0]->get_item(0);
+        ASSERT_EQ(string(item.begin(), item.end()), to_string(i));
+        pool.advance_read_pos();
+    }
+
+    producer.join();
+    ASSERT_TRUE(pool.empty());
+}
+
+TEST(buffer_pool, exception) {
+    // an exception written by the producer is raised for that slot only
+    buffer_pool_in pool(1, 2);
+
+    pool.wait_for_not_full();
+    pool.get_for_write();
+    pool.write_exception(make_exception_ptr(runtime_error("expect me")));
+    pool.advance_write_pos();
+
+    pool.wait_for_not_full();
+    pool.get_for_write();
+    pool.advance_write_pos();
+
+    pool.wait_for_not_empty();
+    ASSERT_THROW(pool.get_for_read(), runtime_error);
+    pool.advance_read_pos();
+
+    pool.wait_for_not_empty();
+    ASSERT_NO_THROW(pool.get_for_read());
+    pool.advance_read_pos();
+}
+
+TEST(buffer_pool, shutdown) {
+    // shutdown must release a consumer blocked on an empty pool
+    buffer_pool_in pool(1, 2);
+    bool result = true;
+
+    thread consumer([&]{
+        result = pool.wait_for_not_empty();
+    });
+
+    pool.shutdown();
+    consumer.join();
+
+    ASSERT_FALSE(result);
+    ASSERT_FALSE(pool.wait_for_not_full());
+}
+
+TEST(buffer_pool, multiple_claims) {
+    // slots claimed together are handed out, published and released in
+    // claim order
+    buffer_pool_in pool(1, 3);
+
+    for (int i = 0; i < 3; ++i) {
+        string s = to_string(i);
+        pool.get_for_write()[0]->add_item(vector<char>(s.begin(), s.end()));
+    }
+    // claimed but unpublished slots are not visible to the consumer
+    ASSERT_TRUE(pool.empty());
+
+    pool.advance_write_pos();
+    pool.advance_write_pos();
+
+    const buffer_item& first  = pool.get_for_read()[0]->get_item(0);
+    const buffer_item& second = pool.get_for_read()[0]->get_item(0);
+    ASSERT_EQ(string(first.begin(), first.end()), "0");
+    ASSERT_EQ(string(second.begin(), second.end()), "1");
+
+    pool.advance_read_pos();
+    pool.advance_write_pos();
+    pool.advance_read_pos();
+
+    const buffer_item& third = pool.get_for_read()[0]->get_item(0);
+    ASSERT_EQ(string(third.begin(), third.end()), "2");
+    pool.advance_read_pos();
+    ASSERT_TRUE(pool.empty());
+}
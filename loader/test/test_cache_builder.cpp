@@ -0,0 +1,79 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "cache_builder.hpp"
+
+using namespace std;
+using namespace nervana;
+
+TEST(cache_builder, build) {
+    string hash = block_loader_random::randomString();
+    string dir = "/tmp/" + hash + "_version123/";
+    auto mbl = make_shared<block_loader_alphabet>(4);
+    auto cache = make_shared<block_loader_cpio_cache>("/tmp", hash, "version123", mbl);
+
+    int reports = 0;
+    cache_builder builder(cache, 2, 4);
+    builder.build([&](const nlohmann::json& p) { reports++; });
+
+    auto progress = builder.progress();
+    ASSERT_LE(1, reports);
+    ASSERT_EQ(mbl->blockCount(), progress["blocks"].get<uint>());
+    ASSERT_EQ(mbl->blockCount(), progress["blocks_done"].get<uint>());
+    ASSERT_EQ(0, progress["blocks_failed"].get<uint>());
+    ASSERT_EQ(mbl->blockCount() * 4 * 2 * 2, progress["bytes"].get<uint>());
+    for (uint i = 0; i < mbl->blockCount(); i++) {
+        ASSERT_EQ(0, access((dir + "r" + to_string(i * 4) + "-4.block").c_str(), F_OK));
+    }
+
+    // a second build finds everything cached
+    cache_builder again(cache, 2, 4);
+    again.build();
+    ASSERT_EQ(0, again.progress()["blocks_done"].get<uint>());
+    ASSERT_EQ(mbl->blockCount(), again.progress()["blocks_skipped"].get<uint>());
+}
+
+// loads one record too many into block 1, which the cache refuses to write
+class block_loader_bad_block : public block_loader_alphabet {
+public:
+    block_loader_bad_block(uint block_size) : block_loader_alphabet(block_size) {}
+    void loadBlock(buffer_in_array& dest, uint block_num)
+    {
+        block_loader_alphabet::loadBlock(dest, block_num);
+        if (block_num == 1) {
+            for (auto d : dest) {
+                d->add_item(vector<char>(1));
+            }
+        }
+    }
+};
+
+TEST(cache_builder, failed_block) {
+    for (size_t write_behind : {0, 1 << 20}) {
+        string hash = block_loader_random::randomString();
+        auto mbl = make_shared<block_loader_bad_block>(4);
+        auto cache = make_shared<block_loader_cpio_cache>("/tmp", hash, "version123", mbl,
+                                                          true, "none", 0, write_behind);
+        cache_builder builder(cache, 2, 4);
+        builder.build();
+
+        auto progress = builder.progress();
+        ASSERT_EQ(mbl->blockCount() - 1, progress["blocks_done"].get<uint>());
+        ASSERT_EQ(1, progress["blocks_failed"].get<uint>());
+    }
+}
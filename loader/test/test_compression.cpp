@@ -0,0 +1,96 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "compression.hpp"
+#include "block_file.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static vector<char> with_magic(const string& magic, size_t size)
+{
+    vector<char> data(size, 'x');
+    copy(magic.begin(), magic.end(), data.begin());
+    return data;
+}
+
+TEST(compression, worth_compressing) {
+    auto jpeg = with_magic("\xFF\xD8\xFF\xE0", 1000);
+    auto mp4  = with_magic(string("\0\0\0\x18", 4) + "ftypmp42", 1000);
+    auto avi  = with_magic(string("RIFF\x10\0\0\0AVI ", 12), 1000);
+    auto wav  = with_magic(string("RIFF\x10\0\0\0WAVE", 12), 1000);
+    auto text = with_magic("the quick brown fox", 1000);
+    auto tiny = with_magic("the quick brown fox", 20);
+
+    EXPECT_FALSE(compression::worth_compressing(jpeg.data(), jpeg.size()));
+    EXPECT_FALSE(compression::worth_compressing(mp4.data(), mp4.size()));
+    EXPECT_FALSE(compression::worth_compressing(avi.data(), avi.size()));
+    EXPECT_TRUE(compression::worth_compressing(wav.data(), wav.size()));
+    EXPECT_TRUE(compression::worth_compressing(text.data(), text.size()));
+    EXPECT_FALSE(compression::worth_compressing(tiny.data(), tiny.size()));
+}
+
+TEST(compression, parse) {
+    EXPECT_EQ(compression::none, compression::parse("none"));
+    EXPECT_THROW(compression::parse("bzip2"), std::invalid_argument);
+#ifndef HAS_ZSTD
+    EXPECT_THROW(compression::parse("zstd"), std::invalid_argument);
+#endif
+}
+
+#if defined(HAS_LZ4) || defined(HAS_ZSTD)
+TEST(compression, block_file) {
+#ifdef HAS_LZ4
+    auto codec = compression::lz4;
+#else
+    auto codec = compression::zstd;
+#endif
+    string name = "/tmp/test_compression_" + to_string(getpid()) + ".block";
+
+    buffer_in_array expected(2);
+    for (int i = 0; i < 10; i++) {
+        expected[0]->add_item(with_magic(string(i, 'a'), 4000));
+        expected[1]->add_item(with_magic("\xFF\xD8\xFF\xE0", 300));
+    }
+    block_file::file_writer writer;
+    writer.open(name, 64, codec);
+    writer.write_all_records(expected);
+    writer.close();
+
+    for (bool mapped : {true, false}) {
+        block_file::reader reader;
+        ASSERT_TRUE(reader.open(name, mapped));
+        buffer_in_array actual(2);
+        reader.read_all(actual);
+        for (int i = 0; i < 10; i++) {
+            ASSERT_TRUE(actual[0]->get_item(i).is_compressed());
+            ASSERT_LT(actual[0]->get_item(i).size(), 4000u);
+            // already compressed media is stored as is
+            ASSERT_FALSE(actual[1]->get_item(i).is_compressed());
+
+            actual[0]->decompress(i);
+            actual[1]->decompress(i);
+            ASSERT_FALSE(actual[0]->get_item(i).is_compressed());
+            ASSERT_EQ(expected[0]->get_item(i), actual[0]->get_item(i));
+            ASSERT_EQ(expected[1]->get_item(i), actual[1]->get_item(i));
+        }
+    }
+    remove(name.c_str());
+}
+#endif
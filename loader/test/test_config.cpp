@@ -32,3 +32,34 @@ TEST(config,throws) {
                          };
     EXPECT_THROW(loader_config cfg{js}, invalid_argument);
 }
+
+TEST(config,prefetch_depth) {
+    nlohmann::json js = {{"type","image,label"},
+                         {"manifest_filename", "blah"},
+                         {"minibatch_size", 128},
+                         {"prefetch_depth", 0},
+                         };
+    EXPECT_THROW(loader_config cfg{js}, invalid_argument);
+
+    js["prefetch_depth"] = 4;
+    loader_config cfg{js};
+    EXPECT_EQ(4, cfg.prefetch_depth);
+}
+
+TEST(config,read_threads) {
+    nlohmann::json js = {{"type","image,label"},
+                         {"manifest_filename", "blah"},
+                         {"minibatch_size", 128},
+                         {"read_threads", 0},
+                         };
+    EXPECT_THROW(loader_config cfg{js}, invalid_argument);
+
+    js["read_threads"] = 4;
+    js["read_ahead"] = -1;
+    EXPECT_THROW(loader_config cfg{js}, invalid_argument);
+
+    js["read_ahead"] = 8;
+    loader_config cfg{js};
+    EXPECT_EQ(4, cfg.read_threads);
+    EXPECT_EQ(8, cfg.read_ahead);
+}
@@ -0,0 +1,200 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "gtest/gtest.h"
+#include "manifest_bin.hpp"
+#include "manifest_csv.hpp"
+#include "block_loader_bin.hpp"
+#include "block_loader_file.hpp"
+#include "csv_manifest_maker.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace nervana;
+
+static string compiled(const string& csv, uint block_size, size_t inline_limit)
+{
+    string bin = tmp_filename();
+    manifest_bin::compile(csv, bin, block_size, inline_limit, 3);
+    return bin;
+}
+
+TEST(manifest_bin, detect) {
+    string csv = tmp_manifest_file(4, {16, 16});
+    ASSERT_FALSE(manifest_bin::is_likely_binary(csv));
+    ASSERT_TRUE(manifest_bin::is_likely_binary(compiled(csv, 2, 0)));
+    ASSERT_THROW(manifest_bin(csv, false), std::runtime_error);
+}
+
+// overwrite the 8 bytes at `offset` of a copy of `bin`
+static string patched(const string& bin, size_t offset, uint64_t value)
+{
+    string copy = tmp_filename();
+    {
+        ifstream in(bin, ios::binary);
+        ofstream out(copy, ios::binary);
+        out << in.rdbuf();
+    }
+    fstream f(copy, ios::binary | ios::in | ios::out);
+    f.seekp(offset);
+    f.write((const char*)&value, sizeof(value));
+    return copy;
+}
+
+static uint64_t header_field(const string& bin, size_t offset)
+{
+    ifstream f(bin, ios::binary);
+    f.seekg(offset);
+    uint64_t value = 0;
+    f.read((char*)&value, sizeof(value));
+    return value;
+}
+
+TEST(manifest_bin, corrupt) {
+    // 3 rows of 2 fields in blocks of 2, with the second field inline
+    string bin = compiled(tmp_manifest_file(3, {16, 4}), 2, 8);
+    ASSERT_NO_THROW(manifest_bin(bin, false));
+    uint64_t entries     = header_field(bin, 40);
+    uint64_t block_table = header_field(bin, 48);
+
+    // a block past the last row
+    ASSERT_THROW(manifest_bin(patched(bin, block_table + 8, 4), false), std::runtime_error);
+    // a path offset past the path section
+    ASSERT_THROW(manifest_bin(patched(bin, entries, 1 << 20), false), std::runtime_error);
+    // an inline value running past the end of the file
+    ASSERT_THROW(manifest_bin(patched(bin, entries + 24 + 8, 1 << 20), false), std::runtime_error);
+    // more rows than the file could hold
+    ASSERT_THROW(manifest_bin(patched(bin, 16, 1ULL << 62), false), std::runtime_error);
+    // an offset that would wrap around
+    ASSERT_THROW(manifest_bin(patched(bin, 40, ~0ULL), false), std::runtime_error);
+}
+
+TEST(manifest_bin, rows) {
+    // paths are resolved, sizes recorded and small files held inline
+    string csv = tmp_manifest_file(7, {1000, 20});
+    manifest_csv text(csv, false);
+    manifest_bin bin(compiled(csv, 3, 100), false);
+
+    ASSERT_EQ(7, bin.objectCount());
+    ASSERT_EQ(2, bin.fieldCount());
+    ASSERT_EQ(3, bin.blockSize());
+    ASSERT_EQ(make_pair((size_t)3, (size_t)6), bin.blockRange(1));
+    ASSERT_EQ(make_pair((size_t)6, (size_t)7), bin.blockRange(2));
+    for(size_t row = 0; row < 7; row++) {
+        const manifest_bin::entry& object = bin.at(row, 0);
+        ASSERT_FALSE(bin.isInline(object));
+        ASSERT_EQ(1000, object.size);
+        ASSERT_EQ(text.filename(row, 0), bin.path(object));
+
+        const manifest_bin::entry& target = bin.at(row, 1);
+        ASSERT_TRUE(bin.isInline(target));
+        ifstream f(text.filename(row, 1), ios::binary);
+        vector<char> bytes(20);
+        f.read(bytes.data(), bytes.size());
+        ASSERT_EQ(bytes, vector<char>(bin.data(target), bin.data(target) + target.size));
+    }
+}
+
+TEST(manifest_bin, shuffle) {
+    // rows are shuffled into the order of the shuffled csv manifest
+    string csv = tmp_manifest_file(50, {4, 4});
+    manifest_csv text(csv, true);
+    manifest_bin bin(compiled(csv, 8, 0), true);
+    for(size_t row = 0; row < 50; row++) {
+        ASSERT_EQ(text.filename(row, 0), bin.path(bin.at(row, 0)));
+        ASSERT_EQ(text.filename(row, 1), bin.path(bin.at(row, 1)));
+    }
+}
+
+TEST(manifest_bin, loadBlock) {
+    // a block loads the same records from either manifest, with or
+    // without the io_engine, and whatever the block size it was built for
+    string csv = tmp_manifest_file(12, {1000, 20});
+    auto text = make_shared<manifest_csv>(csv, true);
+    block_loader_file expected_loader(text, 1.0, 5);
+
+    for(uint compiled_size : {5, 4}) {
+        auto bin = make_shared<manifest_bin>(compiled(csv, compiled_size, 64), true);
+        for(int depth : {1, 4}) {
+            block_loader_bin loader(bin, 1.0, 5, depth);
+            ASSERT_EQ(expected_loader.blockCount(), loader.blockCount());
+            for(uint block = 0; block < loader.blockCount(); block++) {
+                ASSERT_EQ(expected_loader.recordRange(block), loader.recordRange(block));
+                buffer_in_array expected(2);
+                buffer_in_array actual(2);
+                expected_loader.loadBlock(expected, block);
+                loader.loadBlock(actual, block);
+
+                ASSERT_EQ(expected[0]->get_item_count(), actual[0]->get_item_count());
+                for(int i = 0; i < expected[0]->get_item_count(); i++) {
+                    ASSERT_EQ(expected[0]->get_item(i), actual[0]->get_item(i));
+                    ASSERT_EQ(expected[1]->get_item(i), actual[1]->get_item(i));
+                }
+            }
+        }
+    }
+}
+
+TEST(manifest_bin, missing_file) {
+    block_loader_bin loader(
+        make_shared<manifest_bin>(compiled(tmp_manifest_file_with_invalid_filename(), 1, 0), false),
+        1.0,
+        1
+    );
+
+    buffer_in_array bp(2);
+    loader.loadBlock(bp, 0);
+
+    try {
+        bp[0]->get_item(0);
+        FAIL();
+    } catch (std::exception& e) {
+        ASSERT_EQ(string("Could not find "), string(e.what()).substr(0, 15));
+    }
+}
+
+TEST(manifest_bin, fingerprint) {
+    // a file changed in place is noticed once the manifest is compiled again
+    string csv = tmp_manifest_file(8, {16, 16});
+    block_loader_bin before(make_shared<manifest_bin>(compiled(csv, 4, 0), false), 1.0, 4);
+    string first = before.fingerprint(0, 4);
+    string second = before.fingerprint(4, 8);
+    ASSERT_EQ(16, first.size());
+    ASSERT_NE(first, second);
+
+    manifest_csv text(csv, false);
+    ofstream(text.filename(1, 0), ios::app) << "longer";
+
+    block_loader_bin after(make_shared<manifest_bin>(compiled(csv, 4, 0), false), 1.0, 4);
+    ASSERT_NE(first, after.fingerprint(0, 4));
+    ASSERT_EQ(second, after.fingerprint(4, 8));
+}
+
+TEST(manifest_bin, inline_values) {
+    // values held inline by the csv manifest stay inline, whatever the limit
+    string csv = tmp_filename();
+    ofstream(csv) << tmp_zero_file(16) << ",@int:7\n" << tmp_zero_file(16) << ",@base64:AAECAw==\n";
+    manifest_bin bin(compiled(csv, 2, 0), false);
+    ASSERT_FALSE(bin.isInline(bin.at(0, 0)));
+    ASSERT_TRUE(bin.isInline(bin.at(0, 1)));
+    ASSERT_EQ(7, *(const int*)bin.data(bin.at(0, 1)));
+    const manifest_bin::entry& e = bin.at(1, 1);
+    ASSERT_EQ(vector<char>({0, 1, 2, 3}), vector<char>(bin.data(e), bin.data(e) + e.size));
+
+    ofstream(csv, ios::app) << tmp_zero_file(16) << ",@int:seven\n";
+    ASSERT_THROW(compiled(csv, 2, 0), std::runtime_error);
+}
@@ -0,0 +1,73 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "pipeline_stats.hpp"
+
+using namespace std;
+using namespace nervana;
+
+TEST(pipeline_stats, stage_timer) {
+    stage_stats s;
+    {
+        stage_timer timer(s.busy_ns);
+        this_thread::sleep_for(chrono::milliseconds(5));
+    }
+    ASSERT_GE(s.busy_ns, 5000000);
+    ASSERT_EQ(s.wait_input_ns, 0);
+}
+
+TEST(pipeline_stats, verdict) {
+    pipeline_stats stats(4);
+    ASSERT_EQ(stats.verdict(), "no minibatches consumed yet");
+
+    this_thread::sleep_for(chrono::milliseconds(20));
+    stats.consumer->items = 10;
+    ASSERT_EQ(stats.verdict().find("consumer-bound"), 0);
+
+    // decode time is shared by its 4 threads, so transfer is the busier stage
+    stats.consumer->wait_input_ns = 10000000;
+    stats.decode->busy_ns         = 40000000;
+    stats.transfer->busy_ns       = 15000000;
+    ASSERT_EQ(stats.verdict().find("transfer-bound"), 0);
+
+    // block loading happens inside the read stage and is not counted twice
+    stats.load->busy_ns = 18000000;
+    stats.read->busy_ns = 19000000;
+    ASSERT_EQ(stats.verdict().find("io-bound"), 0);
+
+    // with prefetching the read stage only waits for blocks, and the
+    // readers' load time decides whether io is the limit
+    pipeline_stats prefetched(4, 2);
+    this_thread::sleep_for(chrono::milliseconds(20));
+    prefetched.consumer->items         = 10;
+    prefetched.consumer->wait_input_ns = 10000000;
+    prefetched.load->busy_ns           = 18000000;
+    prefetched.read->busy_ns           = 19000000;
+    prefetched.transfer->busy_ns       = 15000000;
+    prefetched.io->items               = 5;
+    prefetched.io->busy_ns             = 20000000;
+    ASSERT_EQ(prefetched.verdict().find("transfer-bound"), 0);
+    ASSERT_NE(prefetched.verdict().find("for blocks"), string::npos);
+    prefetched.io->busy_ns             = 36000000;
+    ASSERT_EQ(prefetched.verdict().find("io-bound"), 0);
+
+    auto js = stats.to_json();
+    ASSERT_EQ(js["decode_threads"], 4);
+    ASSERT_EQ(js["consumer"]["items"], 10);
+}
@@ -0,0 +1,178 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "loader.hpp"
+#include "batch_iterator.hpp"
+#include "block_iterator_sequential.hpp"
+
+using namespace std;
+using namespace nervana;
+
+// 26 blocks of 4 records, read in minibatches of 8, so an epoch is 13
+// minibatches and minibatch k of an epoch starts with record "<A+2k>a"
+static const int block_size = 4;
+static const int batch_size = 8;
+static const int epoch_batches = 13;
+static const int depth = 4;
+
+static string first_of(int k)
+{
+    return string(1, 'A' + 2 * k) + "a";
+}
+
+// the consumer side of loader: takes the next minibatch from `pool`,
+// skipping up to minibatch `discard_until` as loader::next does, and
+// returns its first record
+static string next(buffer_pool_in& pool, uint64_t& consumed, uint64_t discard_until)
+{
+    while (true) {
+        if (pool.wait_for_not_empty() == false) {
+            return "";
+        }
+        buffer_in_array& slot = pool.get_for_read();
+        consumed++;
+        const buffer_item& item = slot[0]->get_item(0);
+        string first(item.data(), item.size());
+        pool.advance_read_pos();
+        if (consumed > discard_until) {
+            return first;
+        }
+    }
+}
+
+class read_stage {
+public:
+    read_stage(bool prefetch_next_epoch)
+    : pool(make_shared<buffer_pool_in>(2, depth)),
+      reader(pool,
+             make_shared<batch_iterator>(make_shared<block_iterator_sequential>(
+                 make_shared<block_loader_alphabet>(block_size)), batch_size),
+             prefetch_next_epoch ? 26 * block_size : 0)
+    {
+    }
+
+    ~read_stage()
+    {
+        reader.stop();
+    }
+
+    // consume `count` minibatches and check they are the next ones of an
+    // epoch starting at minibatch `from`
+    void expect(int from, int count)
+    {
+        for (int k = from; k < from + count; k++) {
+            ASSERT_EQ(first_of(k % epoch_batches), next(*pool, consumed, discard_until));
+        }
+    }
+
+    // let the reader run ahead until the pool is full, so it has read
+    // exactly `depth` minibatches more than were consumed
+    void wait_full()
+    {
+        while (!pool->full()) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+
+    uint64_t reset()
+    {
+        discard_until = reader.reset(consumed);
+        return discard_until;
+    }
+
+    shared_ptr<buffer_pool_in> pool;
+    read_thread_pool           reader;
+    uint64_t                   consumed = 0;
+    uint64_t                   discard_until = 0;
+};
+
+TEST(read_thread_pool, reset_before_read) {
+    for (bool prefetch_next_epoch : {false, true}) {
+        // before the thread runs there is nothing to skip
+        read_stage stage(prefetch_next_epoch);
+        ASSERT_EQ(0, stage.reset());
+        stage.reader.start();
+        stage.expect(0, 3);
+
+        // a reset racing the first reads skips whatever it read
+        read_stage racing(prefetch_next_epoch);
+        racing.reader.start();
+        racing.reset();
+        racing.expect(0, epoch_batches + 2);
+
+        // so does one after it read ahead, before anything was consumed
+        read_stage ahead(prefetch_next_epoch);
+        ahead.reader.start();
+        ahead.wait_full();
+        ASSERT_EQ(depth, ahead.reset());
+        ahead.expect(0, epoch_batches + 2);
+    }
+}
+
+TEST(read_thread_pool, reset_mid_epoch) {
+    for (bool prefetch_next_epoch : {false, true}) {
+        // the minibatches read ahead of the reset are dropped
+        read_stage stage(prefetch_next_epoch);
+        stage.reader.start();
+        stage.expect(0, 3);
+        stage.wait_full();
+        ASSERT_EQ(stage.consumed + depth, stage.reset());
+        stage.expect(0, epoch_batches + 2);
+
+        // and again, right after the previous reset
+        stage.wait_full();
+        ASSERT_EQ(stage.consumed + depth, stage.reset());
+        stage.expect(0, 5);
+    }
+}
+
+TEST(read_thread_pool, reset_at_epoch_end) {
+    // without prefetch_next_epoch the iterator wraps on its own, and what
+    // it read of the next epoch is read again after the reset
+    read_stage stage(false);
+    stage.reader.start();
+    stage.expect(0, epoch_batches);
+    stage.wait_full();
+    ASSERT_EQ(stage.consumed + depth, stage.reset());
+    stage.expect(0, epoch_batches);
+}
+
+TEST(read_thread_pool, prefetch_next_epoch) {
+    // the minibatches read after the epoch end already start the next
+    // epoch, so a reset there keeps them all
+    read_stage stage(true);
+    stage.reader.start();
+    for (int epoch = 0; epoch < 3; epoch++) {
+        stage.expect(0, epoch_batches);
+        stage.wait_full();
+        ASSERT_EQ(stage.consumed, stage.reset());
+    }
+
+    // late in an epoch, only the rest of that epoch is skipped
+    stage.expect(0, epoch_batches - 2);
+    stage.wait_full();
+    ASSERT_EQ(stage.consumed + 2, stage.reset());
+    stage.expect(0, epoch_batches + 2);
+
+    // and an epoch that ended before the last reset is not used again
+    stage.expect(epoch_batches + 2, 3);
+    stage.wait_full();
+    ASSERT_EQ(stage.consumed + depth, stage.reset());
+    stage.expect(0, 3);
+}
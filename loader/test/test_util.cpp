@@ -13,6 +13,10 @@
  limitations under the License.
 */
 
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
 #include <vector>
 #include <string>
 #include <sstream>
@@ -380,3 +384,15 @@ TEST(util,split) {
     }
 }
 
+TEST(util,mtime_ns) {
+    char filename[] = "/tmp/aeon_mtime_XXXXXX";
+    int fd = mkstemp(filename);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    struct timeval times[2] = {{1000000000, 250000}, {1000000000, 500000}};
+    ASSERT_EQ(0, utimes(filename, times));
+    struct stat stats;
+    ASSERT_EQ(0, stat(filename, &stats));
+    EXPECT_EQ(1000000000500000000LL, mtime_ns(stats));
+    unlink(filename);
+}
@@ -0,0 +1,69 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+/* build_cache
+ *
+ * Fills the cache_directory of a loader config with every block of its
+ * manifest, so training starts against a warm cache.  Progress goes to
+ * stderr once a second and a JSON summary to stdout at the end.  It exits
+ * with 1 if any block could not be written.
+ *
+ * usage: build_cache config.json [threads]
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "cache_builder.hpp"
+
+using namespace std;
+using namespace nervana;
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " config.json [threads]" << endl;
+        return 1;
+    }
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+
+    ifstream f(argv[1]);
+    if (!f) {
+        cerr << "could not open " << argv[1] << endl;
+        return 1;
+    }
+    stringstream config;
+    config << f.rdbuf();
+
+    try {
+        cache_builder builder(config.str(), threads);
+        builder.build([](const nlohmann::json& p) {
+            cerr << p["blocks_done"] << " built, " << p["blocks_skipped"] << " cached, "
+                 << p["blocks_failed"] << " failed of " << p["blocks"] << " blocks, "
+                 << p["mb_per_sec"].get<double>() << " MB/s" << endl;
+        });
+        auto progress = builder.progress();
+        cout << progress.dump(4) << endl;
+        if (progress["blocks_failed"].get<uint>() > 0) {
+            return 1;
+        }
+    } catch (std::exception& e) {
+        cerr << "error building cache: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
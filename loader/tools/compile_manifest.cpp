@@ -0,0 +1,73 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+/* compile_manifest
+ *
+ * Compiles a csv manifest into a binary one, see manifest_bin.hpp.  Paths
+ * are resolved against the current directory, as the loader would, and
+ * files of at most `inline_bytes` (default 4096) are copied into it, as
+ * are values the csv manifest holds inline.
+ * `block_size` should match the macrobatch_size of the loader using it.
+ * The loader recognises the result by its first bytes, so manifest_filename
+ * can simply point at it.
+ *
+ * usage: compile_manifest manifest.csv manifest.bin block_size [inline_bytes] [threads]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "manifest_bin.hpp"
+
+using namespace std;
+using namespace nervana;
+
+int main(int argc, char** argv)
+{
+    if (argc < 4) {
+        cerr << "usage: " << argv[0]
+             << " manifest.csv manifest.bin block_size [inline_bytes] [threads]" << endl;
+        return 1;
+    }
+    int block_size      = atoi(argv[3]);
+    size_t inline_bytes = argc > 4 ? strtoull(argv[4], nullptr, 10) : 4096;
+    int threads         = argc > 5 ? atoi(argv[5]) : 0;
+    if (block_size < 1) {
+        cerr << "block_size must be at least 1" << endl;
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    try {
+        manifest_bin::compile(argv[1], argv[2], block_size, inline_bytes, threads);
+        manifest_bin manifest(argv[2], false);
+        size_t inlined = 0, missing = 0;
+        for (size_t row = 0; row < manifest.objectCount(); row++) {
+            for (size_t i = 0; i < manifest.fieldCount(); i++) {
+                const manifest_bin::entry& e = manifest.at(row, i);
+                inlined += manifest.isInline(e);
+                missing += manifest.isMissing(e);
+            }
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cerr << manifest.objectCount() << " records, " << inlined << " files inline, "
+             << missing << " missing, " << elapsed.count() << " s" << endl;
+    } catch (std::exception& e) {
+        cerr << "error compiling manifest: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}